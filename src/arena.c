@@ -0,0 +1,171 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_GROW_STEP (64 * 1024)
+
+// Every block is preceded by its size so realloc can copy without being told
+typedef struct {
+    size_t size;
+    size_t pad;
+} BlockHeader;
+
+#define HEADER_SIZE ((sizeof(BlockHeader) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+// Blocks that overflow to malloc are also linked in front of their header,
+// so reset can free the ones nobody released
+typedef struct OverflowLink {
+    struct OverflowLink *prev, *next;
+} OverflowLink;
+
+#define LINK_SIZE ((sizeof(OverflowLink) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static bool owns(const Arena *a, const void *p) {
+    const unsigned char *c = (const unsigned char*)p;
+    return a->base && c >= a->base && c < a->base + a->size;
+}
+
+static size_t block_size(const void *p) {
+    return ((const BlockHeader*)((const unsigned char*)p - HEADER_SIZE))->size;
+}
+
+void arena_init(Arena *a, size_t size, size_t limit) {
+    memset(a, 0, sizeof(*a));
+    a->limit = limit;
+    if (size > limit) size = limit;
+    if (size > 0) {
+        a->base = malloc(size);
+        if (a->base) a->size = size;
+    }
+}
+
+static OverflowLink *link_of(void *p) {
+    return (OverflowLink*)((unsigned char*)p - HEADER_SIZE - LINK_SIZE);
+}
+
+static void free_overflow(Arena *a) {
+    OverflowLink *l = a->overflow_blocks;
+    while (l) {
+        OverflowLink *next = l->next;
+        free(l);
+        l = next;
+    }
+    a->overflow_blocks = NULL;
+    a->overflow = 0;
+}
+
+void arena_destroy(Arena *a) {
+    free_overflow(a);
+    free(a->base);
+    memset(a, 0, sizeof(*a));
+}
+
+void arena_reset(Arena *a) {
+    if (a->high_water > a->size && a->size < a->limit) {
+        size_t want = (a->high_water + ARENA_GROW_STEP - 1) / ARENA_GROW_STEP * ARENA_GROW_STEP;
+        if (want > a->limit) want = a->limit;
+        unsigned char *grown = malloc(want);
+        if (grown) {
+            free(a->base);
+            a->base = grown;
+            a->size = want;
+        }
+    }
+    free_overflow(a);
+    a->used = 0;
+    a->last = 0;
+}
+
+static void note_usage(Arena *a) {
+    size_t live = a->used + a->overflow;
+    if (live > a->high_water) a->high_water = live;
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+    if (size > SIZE_MAX - LINK_SIZE - HEADER_SIZE - ARENA_ALIGN) return NULL;
+    size_t need = HEADER_SIZE + align_up(size);
+    BlockHeader *h;
+
+    if (a->base && need <= a->size - a->used) {
+        h = (BlockHeader*)(a->base + a->used);
+        a->last = a->used;
+        a->used += need;
+    } else {
+        OverflowLink *l = malloc(LINK_SIZE + need);
+        if (!l) return NULL;
+        l->prev = NULL;
+        l->next = a->overflow_blocks;
+        if (l->next) l->next->prev = l;
+        a->overflow_blocks = l;
+        a->overflow += need;
+        h = (BlockHeader*)((unsigned char*)l + LINK_SIZE);
+    }
+    h->size = size;
+    note_usage(a);
+    return (unsigned char*)h + HEADER_SIZE;
+}
+
+void *arena_realloc(Arena *a, void *p, size_t size) {
+    if (!p) return arena_alloc(a, size);
+    if (size == 0) {
+        arena_release(a, p);
+        return NULL;
+    }
+
+    size_t old = block_size(p);
+    if (owns(a, p)) {
+        // The newest block can grow or shrink in place
+        size_t offset = (size_t)((unsigned char*)p - a->base) - HEADER_SIZE;
+        if (offset == a->last && size <= SIZE_MAX - HEADER_SIZE - ARENA_ALIGN &&
+            offset + HEADER_SIZE + align_up(size) <= a->size) {
+            a->used = offset + HEADER_SIZE + align_up(size);
+            ((BlockHeader*)(a->base + offset))->size = size;
+            note_usage(a);
+            return p;
+        }
+        if (size <= old) {
+            ((BlockHeader*)(a->base + offset))->size = size;
+            return p;
+        }
+    }
+
+    void *q = arena_alloc(a, size);
+    if (!q) return NULL;
+    memcpy(q, p, old < size ? old : size);
+    arena_release(a, p);
+    return q;
+}
+
+void arena_release(Arena *a, void *p) {
+    if (!p) return;
+    if (!owns(a, p)) {
+        size_t need = HEADER_SIZE + align_up(block_size(p));
+        a->overflow = (a->overflow > need) ? a->overflow - need : 0;
+        OverflowLink *l = link_of(p);
+        if (l->prev) l->prev->next = l->next;
+        else a->overflow_blocks = l->next;
+        if (l->next) l->next->prev = l->prev;
+        free(l);
+        return;
+    }
+    size_t offset = (size_t)((unsigned char*)p - a->base) - HEADER_SIZE;
+    if (offset == a->last && a->used > offset) a->used = offset;
+}
+
+void *arena_cb_malloc(size_t size, void *user) {
+    return arena_alloc((Arena*)user, size);
+}
+
+void *arena_cb_realloc(void *p, size_t size, void *user) {
+    return arena_realloc((Arena*)user, p, size);
+}
+
+void arena_cb_free(void *p, void *user) {
+    arena_release((Arena*)user, p);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bump allocator for allocations that all die together (one track's decoder,
+// one metadata load). Not thread safe; each arena has a single owner.
+// Requests that do not fit fall back to malloc. The next reset frees those
+// and grows the block to the high-water mark (up to limit), so steady state
+// never hits the system allocator.
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    size_t last;            // offset of the newest allocation, for in-place realloc/free
+    size_t overflow;        // live bytes that fell back to malloc
+    void *overflow_blocks;  // those blocks, freed by reset and destroy
+    size_t high_water;      // largest used + overflow over the arena's lifetime
+    size_t limit;
+} Arena;
+
+void arena_init(Arena *a, size_t size, size_t limit);
+void arena_destroy(Arena *a);
+
+// Drop every allocation at once
+void arena_reset(Arena *a);
+
+void *arena_alloc(Arena *a, size_t size);
+void *arena_realloc(Arena *a, void *p, size_t size);
+
+// Frees overflow blocks; arena blocks are only reclaimed when they are the newest
+void arena_release(Arena *a, void *p);
+
+// Signatures match the dr_libs allocation callbacks (pUserData is the Arena)
+void *arena_cb_malloc(size_t size, void *user);
+void *arena_cb_realloc(void *p, size_t size, void *user);
+void arena_cb_free(void *p, void *user);
@@ -0,0 +1,128 @@
+#include "artcache.h"
+#include "thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Entry {
+    ArtImage image;             // first, so an ArtImage pointer is its entry
+    char *key;
+    size_t bytes;
+    int refs;
+    struct Entry *prev, *next;  // most recently used first
+} Entry;
+
+static Mutex *lock = NULL;
+static Entry *head = NULL, *tail = NULL;
+static size_t total = 0;        // bytes of pixels held, in use or not
+static size_t budget = 16 * 1024 * 1024;
+
+static void unlink_entry(Entry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void push_front(Entry *e) {
+    e->next = head;
+    e->prev = NULL;
+    if (head) head->prev = e;
+    head = e;
+    if (!tail) tail = e;
+}
+
+static void free_entry(Entry *e) {
+    unlink_entry(e);
+    total -= e->bytes;
+    free(e->image.rgb);
+    free(e->key);
+    free(e);
+}
+
+// Drop unused images, oldest first, until the cache fits its budget (lock held)
+static void trim(void) {
+    for (Entry *e = tail; e && total > budget;) {
+        Entry *prev = e->prev;
+        if (e->refs == 0) free_entry(e);
+        e = prev;
+    }
+}
+
+void artcache_init(void) {
+    if (!lock) lock = mutex_create();
+}
+
+void artcache_deinit(void) {
+    while (head) free_entry(head);
+    total = 0;
+    if (lock) mutex_free(lock);
+    lock = NULL;
+}
+
+void artcache_set_budget(size_t bytes) {
+    if (!lock) return;
+    mutex_lock(lock);
+    budget = bytes;
+    trim();
+    mutex_unlock(lock);
+}
+
+const ArtImage *artcache_get(const char *key) {
+    if (!lock || !key) return NULL;
+    mutex_lock(lock);
+    Entry *e = head;
+    while (e && strcmp(e->key, key) != 0) e = e->next;
+    if (e) {
+        e->refs++;
+        unlink_entry(e);
+        push_front(e);
+    }
+    mutex_unlock(lock);
+    return e ? &e->image : NULL;
+}
+
+const ArtImage *artcache_put(const char *key, uint8_t *rgb, int w, int h) {
+    Entry *e = lock ? calloc(1, sizeof(Entry)) : NULL;
+    char *k = e ? strdup(key) : NULL;
+    if (!k) {
+        free(e);
+        free(rgb);
+        return NULL;
+    }
+
+    mutex_lock(lock);
+    // Decoded on two threads at once: keep the first
+    Entry *old = head;
+    while (old && strcmp(old->key, key) != 0) old = old->next;
+    if (old) {
+        old->refs++;
+        mutex_unlock(lock);
+        free(k);
+        free(e);
+        free(rgb);
+        return &old->image;
+    }
+
+    e->image.rgb = rgb;
+    e->image.w = w;
+    e->image.h = h;
+    e->key = k;
+    e->bytes = (size_t)w * h * 3;
+    e->refs = 1;
+    push_front(e);
+    total += e->bytes;
+    trim();
+    mutex_unlock(lock);
+    return &e->image;
+}
+
+void artcache_release(const ArtImage *img) {
+    if (!img || !lock) return;
+    Entry *e = (Entry*)img;
+    mutex_lock(lock);
+    e->refs--;
+    trim();
+    mutex_unlock(lock);
+}
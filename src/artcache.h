@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Album art decoded to RGB888, kept by source so that tracks sharing a cover
+// (an album folder's image, the same embedded picture) show it without
+// decoding it again. Images are shared: every holder takes a reference, and
+// images nobody holds are dropped least recently used first once the cache
+// is over its memory budget.
+
+typedef struct {
+    uint8_t *rgb;
+    int w, h;
+} ArtImage;
+
+void artcache_init(void);
+void artcache_deinit(void);
+
+// Bytes of pixels kept for reuse; 0 keeps only the images in use
+void artcache_set_budget(size_t bytes);
+
+// Image stored under key with a reference taken, NULL if there is none
+const ArtImage *artcache_get(const char *key);
+
+// Store rgb (malloc'd, taken over) under key and return the image with a
+// reference taken. NULL, with rgb freed, when out of memory.
+const ArtImage *artcache_put(const char *key, uint8_t *rgb, int w, int h);
+
+// Drop a reference (img may be NULL)
+void artcache_release(const ArtImage *img);
@@ -0,0 +1,115 @@
+#include "artdir.h"
+#include "dirscan.h"
+#include "playlist.h"
+#include "thread.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ARTDIR_SLOTS 8              // folders kept, the least recently used goes
+#define ARTDIR_PATH 1024
+
+typedef struct {
+    char dir[ARTDIR_PATH];
+    Playlist images;                // full paths
+    uint64_t used;                  // lookup clock when last used, 0 for a free slot
+} Listing;
+
+static Listing slots[ARTDIR_SLOTS];
+static uint64_t clock_now = 0;
+static Mutex *lock = NULL;
+
+static int fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+}
+
+// file's name (after the last separator) is name.ext, ignoring case
+static bool name_matches(const char *file, const char *name, const char *ext) {
+    const char *slash = strrchr(file, '/');
+    const char *bs = strrchr(file, '\\');
+    if (bs && (!slash || bs > slash)) slash = bs;
+    const char *base = slash ? slash + 1 : file;
+    size_t name_len = strlen(name);
+    for (size_t i = 0; i < name_len; i++) {
+        if (fold((unsigned char)base[i]) != fold((unsigned char)name[i])) return false;
+    }
+    base += name_len;
+    if (*base++ != '.') return false;
+    while (*ext && fold((unsigned char)*base) == fold((unsigned char)*ext)) {
+        base++;
+        ext++;
+    }
+    return !*base && !*ext;
+}
+
+// Listing of dir, or NULL (lock held)
+static Listing *find_listing(const char *dir) {
+    for (int i = 0; i < ARTDIR_SLOTS; i++) {
+        if (slots[i].used && strcmp(slots[i].dir, dir) == 0) return &slots[i];
+    }
+    return NULL;
+}
+
+// Take images as dir's listing, replacing the oldest one (lock held)
+static Listing *store_listing(const char *dir, Playlist *images) {
+    Listing *slot = &slots[0];
+    for (int i = 1; i < ARTDIR_SLOTS && slot->used; i++) {
+        if (slots[i].used < slot->used) slot = &slots[i];
+    }
+    playlist_free(&slot->images);
+    snprintf(slot->dir, sizeof(slot->dir), "%s", dir);
+    slot->images = *images;
+    playlist_init(images);
+    return slot;
+}
+
+void artdir_init(void) {
+    if (!lock) lock = mutex_create();
+}
+
+void artdir_clear(void) {
+    if (!lock) return;
+    mutex_lock(lock);
+    for (int i = 0; i < ARTDIR_SLOTS; i++) {
+        playlist_free(&slots[i].images);
+        slots[i].used = 0;
+    }
+    mutex_unlock(lock);
+}
+
+void artdir_deinit(void) {
+    artdir_clear();
+    if (lock) mutex_free(lock);
+    lock = NULL;
+}
+
+bool artdir_find(const char *dir, const char *name, const char *ext, char *out, size_t out_size) {
+    if (!lock || !dir || !dir[0] || strlen(dir) >= ARTDIR_PATH) return false;
+    if (*ext == '.') ext++;
+
+    mutex_lock(lock);
+    Listing *l = find_listing(dir);
+    if (!l) {
+        // List without the lock: on a network share it takes a while
+        mutex_unlock(lock);
+        Playlist images;
+        playlist_init(&images);
+        dirscan_list(dir, ARTDIR_EXTENSIONS, &images);
+        mutex_lock(lock);
+        l = find_listing(dir);
+        if (!l) l = store_listing(dir, &images);
+        playlist_free(&images);
+    }
+    l->used = ++clock_now;
+
+    bool found = false;
+    for (int i = 0; i < l->images.count && !found; i++) {
+        const char *path = playlist_get(&l->images, i);
+        if (name_matches(path, name, ext)) {
+            found = true;
+            snprintf(out, out_size, "%s", path);
+        }
+    }
+    mutex_unlock(lock);
+    return found;
+}
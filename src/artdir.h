@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Image files of the folders the art search looks in, listed once per folder
+// and kept for the tracks after it, so candidate names are looked up in
+// memory instead of each being tried with an open that mostly fails.
+
+#define ARTDIR_EXTENSIONS "jpg|jpeg|png|bmp"
+
+void artdir_init(void);
+void artdir_deinit(void);
+
+// Forget every listing (new content: files may have changed)
+void artdir_clear(void);
+
+// Path of the image named name + ext in dir, in any letter case. False if
+// the folder has none.
+bool artdir_find(const char *dir, const char *name, const char *ext, char *out, size_t out_size);
@@ -1,6 +1,17 @@
 #include "audio.h"
+#include "gapless.h"
+#include "resampler.h"
+#include "downmix.h"
+#include "seekindex.h"
+#include "fileio.h"
+#include "arena.h"
+#include "metadata.h"
+#include "thread.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <limits.h>
 
 #define DR_MP3_IMPLEMENTATION
 #include "dr_mp3.h"
@@ -10,21 +21,151 @@
 #include "dr_flac.h"
 #include "stb_vorbis.c"
 
-// Global audio state
+// Global audio state (the track currently being heard)
 AudioType current_type = AUDIO_NONE;
 void *decoder = NULL;
 uint32_t source_rate = 44100;
 int source_channels = 2;
 uint64_t total_frames = 0;
 uint64_t cur_frame = 0;
+uint32_t output_rate = OUT_RATE;
 
-// Resample state
-static double resample_phase = 0.0;
-static int16_t resample_in_buf[SAMPLES_PER_FRAME * 8 * MAX_CHANNELS];
-static int16_t resample_cache[RESAMPLE_CACHE_FRAMES * MAX_CHANNELS];
-static int resample_cache_frames = 0;
+// One decoder instance. The worker keeps two: the playing track and the
+// upcoming one, which is opened and pre-rolled ahead of time so the switch
+// happens at the sample level.
+typedef struct {
+    AudioType type;
+    void *handle;
+    uint32_t rate;
+    uint32_t out_rate;   // rate the voice is resampled to (its own rate in native mode)
+    int channels;
+    uint64_t total;      // playable frames (after encoder delay/padding trim)
+    uint64_t lead;       // decoded frames dropped at the start
+    uint64_t read_pos;   // playable frames read from the decoder
+    uint32_t prefetch;   // seconds before the end at which the next track is opened
+    bool input_done;     // decoder drained, resampler is flushing its tail
+    bool eof;
+    DownmixMatrix mix;
+    Resampler rs;
+    drmp3_seek_point *seek_points;   // bound MP3 seek table, owned by the voice
+    uint32_t seek_count;
+    TrackTags *tags;                 // tags read during open, until posted
+    FileData file;                   // decoder input when the file is mapped
+    FileStream stream;               // decoder input read as it goes otherwise
+    Arena arena;                     // decoder allocations, reset when the voice closes
+    char path[1024];
+} Voice;
+
+typedef struct {
+    AudioType type;
+    void *handle;
+    uint32_t rate;
+    uint32_t out_rate;
+    int channels;
+    uint64_t total;
+} VoiceInfo;
+
+// State of the second voice slot
+typedef enum {
+    NEXT_NONE,     // closed
+    NEXT_QUEUED,   // path known, opened once the current track nears its end
+    NEXT_READY,    // open and pre-rolled
+    NEXT_FAILED,   // open failed
+    NEXT_RETIRED   // holds the previous track until the reader crosses the boundary
+} NextState;
+
+static Voice voices[2];
+static Voice *cur_voice = &voices[0];
+static Voice *next_voice = &voices[1];
+static NextState next_state = NEXT_NONE;
+
+// Decode ring: stereo frames at the playing voice's output rate, written by the decode worker and
+// read by audio_read_frame. Indices free-run and wrap via RING_MASK.
+#define RING_FRAMES 32768
+#define RING_MASK (RING_FRAMES - 1)
+static int16_t ring_buf[RING_FRAMES * 2];
+static atomic_uint ring_write;
+static atomic_uint ring_read;
+static atomic_uint ring_flush_pos;  // ring_write at the last flush
+static atomic_bool ring_eof;        // worker hit end of the last track, ring holds the tail
+
+// Track boundary inside the ring. Set by the worker when it switches to the
+// next voice, cleared by the reader once playback reaches it.
+static atomic_bool boundary_pending;
+static uint32_t boundary_pos;
+static VoiceInfo boundary_info;
+static bool track_advanced = false;
+
+// Worker commands. Only one slot: a newer seek replaces an unhandled one,
+// open/close wait for completion so they are never overwritten.
+typedef enum { AUDIO_CMD_NONE, AUDIO_CMD_OPEN, AUDIO_CMD_SEEK, AUDIO_CMD_CLOSE, AUDIO_CMD_QUIT } AudioCmdType;
+
+typedef struct {
+    AudioCmdType type;
+    char path[1024];
+    uint64_t frame;
+    unsigned gen;
+} AudioCmd;
+
+static Thread *worker = NULL;
+static Mutex *cmd_mutex = NULL;
+static Cond *cmd_cond = NULL;    // wakes the worker
+static Cond *done_cond = NULL;   // wakes callers waiting on a command
+static AudioCmd cmd;
+static bool cmd_result = false;
+static unsigned gen_posted = 0;     // last command generation posted (play_mutex)
+static atomic_uint gen_done;        // last command generation the worker finished
+static unsigned consumer_gen = 0;   // generation the ring reader has synced to
+static atomic_bool worker_paused;
+
+// Next-track queue, guarded by cmd_mutex
+static char queued_path[1024];
+static unsigned queued_gen = 0;
+static unsigned queued_seen = 0;
+
+// Tags captured at voice open, waiting for the frontend. Guarded by cmd_mutex.
+#define TAG_MAILBOX_SLOTS 2
+static TrackTags *tag_mailbox[TAG_MAILBOX_SLOTS];
+static unsigned tag_mailbox_next = 0;
+static atomic_int tags_waiting;
+
+// Playback position: source frame at the last open/seek plus output frames played since
+static uint64_t play_base_frame = 0;
+static uint64_t play_out_frames = 0;
+
+// Guards the reader side: the published track globals, the position above,
+// consumer_gen, gen_posted and track_advanced. audio_read_frame may run on
+// the frontend's audio thread while the frontend thread seeks or opens.
+// Lock order: play_mutex before cmd_mutex.
+static Mutex *play_mutex = NULL;
+
+// Resampler quality tier, applied on the next open or seek
+static atomic_int resample_quality = RESAMPLE_BALANCED;
+
+// Output at each track's own rate instead of OUT_RATE, applied on the next open
+static atomic_bool native_rate = false;
+
+// Per-voice decoder arena: starting size and the most it may grow to.
+// stb_vorbis gets a slice of it, doubled from VORBIS_ARENA_START until setup fits.
+#define VOICE_ARENA_SIZE (1024 * 1024)
+#define VOICE_ARENA_LIMIT (16 * 1024 * 1024)
+#define VORBIS_ARENA_START (256 * 1024)
+#define VORBIS_ARENA_MAX (8 * 1024 * 1024)
+
+// Tag region read ahead of a streamed MP3 for its tags and gapless header: the
+// ID3v2 tag, up to MP3_TAG_READ_MAX of it, and the first audio frame
+#define MP3_TAG_READ_MAX (16 * 1024 * 1024)
+#define MP3_FIRST_FRAME_READ 4096
+
+// A track read whole (an Ogg file only the VFS can open) may sit on a slow
+// share: the next one is opened one more second early per this many bytes
+#define WHOLE_READ_BYTES_PER_SECOND (1024 * 1024)
+#define PREFETCH_MAX_SECONDS 60
+
+// Decoder output scratch (worker only)
+#define DECODE_CHUNK_FRAMES 4096
+static int16_t resample_in_buf[DECODE_CHUNK_FRAMES * MAX_CHANNELS + DOWNMIX_PAD_SAMPLES];
 
-// Case-insensitive string compare
 static int strcasecmp_simple(const char *s1, const char *s2) {
     while (*s1 && *s2) {
         char c1 = (*s1 >= 'A' && *s1 <= 'Z') ? *s1 + 32 : *s1;
@@ -42,255 +183,931 @@ int16_t clamp_i16(float v) {
     return (int16_t)v;
 }
 
-static void downmix_frame_lr(const int16_t *buf, int channels, int frame, float *l, float *r, bool vorbis_order) {
-    if (channels <= 1) {
-        int16_t s = buf[frame * ((channels > 0) ? channels : 1)];
-        *l = (float)s;
-        *r = (float)s;
-        return;
-    }
-    if (channels == 2) {
-        int idx = frame * 2;
-        *l = (float)buf[idx];
-        *r = (float)buf[idx + 1];
-        return;
+static void voice_close(Voice *v) {
+    if (v->handle) {
+        if (v->type == AUDIO_MP3) drmp3_uninit((drmp3*)v->handle);
+        else if (v->type == AUDIO_WAV) drwav_uninit((drwav*)v->handle);
+        else if (v->type == AUDIO_FLAC) drflac_close((drflac*)v->handle);
+        else if (v->type == AUDIO_OGG) stb_vorbis_close((stb_vorbis*)v->handle);
+        v->handle = NULL;
     }
+    file_unload(&v->file);
+    file_stream_close(&v->stream);
+    arena_reset(&v->arena);
+    free(v->seek_points);
+    v->seek_points = NULL;
+    v->seek_count = 0;
+    resampler_free(&v->rs);
+    v->type = AUDIO_NONE;
+    v->eof = false;
+}
 
-    int idx = frame * channels;
-    if (channels == 3) {
-        float fl = (float)buf[idx];
-        float fr = (float)buf[idx + 1];
-        float fc = (float)buf[idx + 2];
-        if (vorbis_order) {
-            fc = (float)buf[idx + 1];
-            fr = (float)buf[idx + 2];
-        }
-        *l = fl + 0.707f * fc;
-        *r = fr + 0.707f * fc;
-        return;
+static bool voice_raw_seek(Voice *v, uint64_t raw_frame) {
+    if (v->type == AUDIO_MP3) return drmp3_seek_to_pcm_frame((drmp3*)v->handle, raw_frame);
+    if (v->type == AUDIO_WAV) return drwav_seek_to_pcm_frame((drwav*)v->handle, raw_frame);
+    if (v->type == AUDIO_OGG) return stb_vorbis_seek((stb_vorbis*)v->handle, (unsigned int)raw_frame);
+    if (v->type == AUDIO_FLAC) return drflac_seek_to_pcm_frame((drflac*)v->handle, raw_frame);
+    return false;
+}
+
+// Attach the MP3 seek table once the index builder has it
+static void voice_bind_seek_table(Voice *v) {
+    if (v->type != AUDIO_MP3 || v->seek_points || !v->handle) return;
+    drmp3_seek_point *points;
+    uint32_t count;
+    if (!seekindex_take(v->path, &points, &count)) return;
+    if (drmp3_bind_seek_table((drmp3*)v->handle, count, points)) {
+        v->seek_points = points;
+        v->seek_count = count;
+    } else {
+        free(points);
     }
-    if (channels == 4) {
-        float fl = (float)buf[idx];
-        float fr = (float)buf[idx + 1];
-        float fsl = (float)buf[idx + 2];
-        float fsr = (float)buf[idx + 3];
-        *l = fl + 0.707f * fsl;
-        *r = fr + 0.707f * fsr;
-        return;
+}
+
+static void voice_seek(Voice *v, uint64_t frame) {
+    if (!v->handle) return;
+    voice_bind_seek_table(v);
+    if (v->total > 0 && frame > v->total) frame = v->total;
+    voice_raw_seek(v, v->lead + frame);
+    v->read_pos = frame;
+    v->input_done = false;
+    v->eof = false;
+
+    int quality = atomic_load_explicit(&resample_quality, memory_order_relaxed);
+    if (quality != v->rs.quality) resampler_init(&v->rs, v->rate, v->out_rate, (ResampleQuality)quality);
+    else resampler_reset(&v->rs);
+}
+
+// Collect Vorbis comments and the picture while dr_flac parses the stream header
+static void voice_flac_meta(void *user, drflac_metadata *meta) {
+    TrackTags *t = ((Voice*)user)->tags;
+    if (!t || !meta) return;
+
+    if (meta->type == DRFLAC_METADATA_BLOCK_TYPE_VORBIS_COMMENT) {
+        drflac_vorbis_comment_iterator iter;
+        drflac_init_vorbis_comment_iterator(&iter, meta->data.vorbis_comment.commentCount,
+                                            meta->data.vorbis_comment.pComments);
+        drflac_uint32 len = 0;
+        const char *comment;
+        while ((comment = drflac_next_vorbis_comment(&iter, &len)) != NULL)
+            metadata_tags_add_comment(t, comment, len);
+    } else if (meta->type == DRFLAC_METADATA_BLOCK_TYPE_PICTURE) {
+        if (meta->data.picture.pPictureData)
+            metadata_tags_set_picture(t, meta->data.picture.pPictureData, meta->data.picture.pictureDataSize);
+        else
+            t->picture_unread = true;
     }
-    if (channels == 5) {
-        float fl = (float)buf[idx];
-        float fr = (float)buf[idx + 1];
-        float fc = (float)buf[idx + 2];
-        float fsl = (float)buf[idx + 3];
-        float fsr = (float)buf[idx + 4];
-        if (vorbis_order) {
-            fc = (float)buf[idx + 1];
-            fr = (float)buf[idx + 2];
-            fsl = (float)buf[idx + 3];
-            fsr = (float)buf[idx + 4];
-        }
-        *l = fl + 0.707f * fc + 0.707f * fsl;
-        *r = fr + 0.707f * fc + 0.707f * fsr;
-        return;
+}
+
+// Hand a voice's tags to the frontend (audio_take_tags)
+static void post_tags(TrackTags *t) {
+    mutex_lock(cmd_mutex);
+    int slot = -1;
+    for (int i = 0; i < TAG_MAILBOX_SLOTS; i++) {
+        if (tag_mailbox[i] && strcmp(tag_mailbox[i]->path, t->path) == 0) slot = i;
     }
-    if (channels == 6) {
-        float fl = (float)buf[idx];
-        float fr = (float)buf[idx + 1];
-        float fc = (float)buf[idx + 2];
-        float flfe = (float)buf[idx + 3];
-        float fsl = (float)buf[idx + 4];
-        float fsr = (float)buf[idx + 5];
-        if (vorbis_order) {
-            fc = (float)buf[idx + 1];
-            fr = (float)buf[idx + 2];
-            fsl = (float)buf[idx + 3];
-            fsr = (float)buf[idx + 4];
-            flfe = (float)buf[idx + 5];
-        }
-        *l = fl + 0.707f * fc + 0.707f * fsl + 0.5f * flfe;
-        *r = fr + 0.707f * fc + 0.707f * fsr + 0.5f * flfe;
-        return;
+    if (slot < 0) {
+        slot = (int)tag_mailbox_next;
+        tag_mailbox_next = (tag_mailbox_next + 1) % TAG_MAILBOX_SLOTS;
     }
+    if (tag_mailbox[slot]) metadata_tags_free(tag_mailbox[slot]);
+    else atomic_fetch_add(&tags_waiting, 1);
+    tag_mailbox[slot] = t;
+    mutex_unlock(cmd_mutex);
+}
 
-    int32_t sum = 0;
-    for (int c = 0; c < channels; c++) sum += buf[idx + c];
-    float mono = (float)sum / (float)channels;
-    *l = mono;
-    *r = mono;
+// Decoder input of a file that is not mapped, read from the voice's stream
+static size_t voice_read(void *user, void *buf, size_t bytes) {
+    return file_stream_read(&((Voice*)user)->stream, buf, bytes);
 }
 
-void audio_init(void) {
-    current_type = AUDIO_NONE;
-    decoder = NULL;
-    resample_phase = 0.0;
-    resample_cache_frames = 0;
+static bool voice_stream_seek(Voice *v, int offset, bool from_start, bool from_end) {
+    return file_stream_seek(&v->stream, offset, from_start ? SEEK_SET : from_end ? SEEK_END : SEEK_CUR);
 }
 
-void audio_close(void) {
-    if (decoder) {
-        if (current_type == AUDIO_MP3) drmp3_uninit((drmp3*)decoder);
-        else if (current_type == AUDIO_WAV) drwav_uninit((drwav*)decoder);
-        else if (current_type == AUDIO_FLAC) drflac_close((drflac*)decoder);
-        else if (current_type == AUDIO_OGG) stb_vorbis_close((stb_vorbis*)decoder);
-        if (current_type != AUDIO_OGG && current_type != AUDIO_FLAC) free(decoder);
-        decoder = NULL;
+static bool voice_stream_tell(Voice *v, int64_t *cursor) {
+    *cursor = file_stream_tell(&v->stream);
+    return *cursor >= 0;
+}
+
+static drmp3_bool32 voice_mp3_seek(void *user, int offset, drmp3_seek_origin origin) {
+    return voice_stream_seek((Voice*)user, offset, origin == DRMP3_SEEK_SET, origin == DRMP3_SEEK_END);
+}
+
+static drmp3_bool32 voice_mp3_tell(void *user, drmp3_int64 *cursor) {
+    int64_t at;
+    bool ok = voice_stream_tell((Voice*)user, &at);
+    *cursor = at;
+    return ok;
+}
+
+static drflac_bool32 voice_flac_seek(void *user, int offset, drflac_seek_origin origin) {
+    return voice_stream_seek((Voice*)user, offset, origin == DRFLAC_SEEK_SET, origin == DRFLAC_SEEK_END);
+}
+
+static drflac_bool32 voice_flac_tell(void *user, drflac_int64 *cursor) {
+    int64_t at;
+    bool ok = voice_stream_tell((Voice*)user, &at);
+    *cursor = at;
+    return ok;
+}
+
+static drwav_bool32 voice_wav_seek(void *user, int offset, drwav_seek_origin origin) {
+    return voice_stream_seek((Voice*)user, offset, origin == DRWAV_SEEK_SET, origin == DRWAV_SEEK_END);
+}
+
+static drwav_bool32 voice_wav_tell(void *user, drwav_int64 *cursor) {
+    int64_t at;
+    bool ok = voice_stream_tell((Voice*)user, &at);
+    *cursor = at;
+    return ok;
+}
+
+// stb_vorbis takes one fixed buffer up front; grow it until setup and the
+// decoder's temp memory fit, then fall back to malloc. It streams from a FILE
+// when the file is not mapped.
+static stb_vorbis *vorbis_open(Voice *v, int *err, const stb_vorbis_alloc *alloc) {
+    if (v->stream.fp) {
+        if (!file_stream_seek(&v->stream, 0, SEEK_SET)) return NULL;
+        return stb_vorbis_open_file(v->stream.fp, 0, err, alloc);
     }
-    current_type = AUDIO_NONE;
+    return stb_vorbis_open_memory(v->file.data, (int)v->file.size, err, alloc);
 }
 
-void audio_deinit(void) {
-    audio_close();
+static stb_vorbis *voice_open_vorbis(Voice *v) {
+    if (!v->stream.fp && v->file.size > INT_MAX) return NULL;
+    int err = 0;
+    for (int bytes = VORBIS_ARENA_START; bytes <= VORBIS_ARENA_MAX; bytes *= 2) {
+        stb_vorbis_alloc alloc = { arena_alloc(&v->arena, (size_t)bytes), bytes };
+        if (!alloc.alloc_buffer) break;
+        stb_vorbis *ogg = vorbis_open(v, &err, &alloc);
+        if (ogg) return ogg;
+        arena_release(&v->arena, alloc.alloc_buffer);
+        if (err != VORBIS_outofmem) return NULL;
+    }
+    return vorbis_open(v, &err, NULL);
 }
 
-bool audio_open_track(const char *path) {
-    audio_close();
+// Read a streamed MP3's tag region (malloc'd) and rewind the stream for the decoder
+static unsigned char *voice_read_mp3_head(Voice *v, size_t *size) {
+    unsigned char header[10];
+    size_t want = MP3_FIRST_FRAME_READ;
+    if (file_stream_read(&v->stream, header, sizeof(header)) == sizeof(header) && memcmp(header, "ID3", 3) == 0) {
+        size_t tag = 10 + (((size_t)(header[6] & 0x7F) << 21) | ((size_t)(header[7] & 0x7F) << 14) |
+                           ((size_t)(header[8] & 0x7F) << 7) | (size_t)(header[9] & 0x7F));
+        if (header[5] & 0x10) tag += 10;
+        want += tag < MP3_TAG_READ_MAX ? tag : MP3_TAG_READ_MAX;
+    }
+    unsigned char *head = file_stream_seek(&v->stream, 0, SEEK_SET) ? malloc(want) : NULL;
+    *size = head ? file_stream_read(&v->stream, head, want) : 0;
+    if (!file_stream_seek(&v->stream, 0, SEEK_SET) || *size == 0) {
+        free(head);
+        return NULL;
+    }
+    return head;
+}
+
+static bool voice_open(Voice *v, const char *path) {
+    voice_close(v);
+    metadata_tags_free(v->tags);
+    v->tags = metadata_tags_create(path);
 
     const char *ext = strrchr(path, '.');
+    bool ogg_file = ext && strcasecmp_simple(ext, ".ogg") == 0;
     bool load_success = false;
+    uint64_t decoded_frames = 0;
+
+    // A mapped file is decoded in place. Anything else is streamed, so opening
+    // reads only the headers and playing holds no copy of the file; stb_vorbis
+    // streams from a FILE only, so an Ogg file the VFS alone can open is read whole.
+    if (!file_map(&v->file, path) && !file_stream_open(&v->stream, path, ogg_file) &&
+        !(ogg_file && file_load(&v->file, path))) {
+        metadata_tags_free(v->tags);
+        v->tags = NULL;
+        return false;
+    }
+    bool streamed = v->file.data == NULL;
+    const unsigned char *data = v->file.data;
+    size_t size = v->file.size;
+    unsigned char *head = NULL;     // streamed MP3: the tag region
+    size_t head_size = 0;
 
     if (ext && strcasecmp_simple(ext, ".mp3") == 0) {
-        decoder = malloc(sizeof(drmp3));
-        if (decoder && drmp3_init_file((drmp3*)decoder, path, NULL)) {
-            current_type = AUDIO_MP3;
-            source_rate = ((drmp3*)decoder)->sampleRate;
-            source_channels = ((drmp3*)decoder)->channels;
-            total_frames = ((drmp3*)decoder)->totalPCMFrameCount;
+        drmp3_allocation_callbacks alloc = { &v->arena, arena_cb_malloc, arena_cb_realloc, arena_cb_free };
+        if (streamed) head = voice_read_mp3_head(v, &head_size);
+        v->handle = arena_alloc(&v->arena, sizeof(drmp3));
+        if (v->handle && (streamed ? drmp3_init((drmp3*)v->handle, voice_read, voice_mp3_seek, voice_mp3_tell, NULL, v, &alloc)
+                                   : drmp3_init_memory((drmp3*)v->handle, data, size, &alloc))) {
+            v->type = AUDIO_MP3;
+            v->rate = ((drmp3*)v->handle)->sampleRate;
+            v->channels = ((drmp3*)v->handle)->channels;
+            decoded_frames = ((drmp3*)v->handle)->totalPCMFrameCount;
             load_success = true;
         }
-    } else if (ext && strcasecmp_simple(ext, ".ogg") == 0) {
-        int err = 0;
-        stb_vorbis* ogg = stb_vorbis_open_filename(path, &err, NULL);
+    } else if (ogg_file) {
+        stb_vorbis* ogg = voice_open_vorbis(v);
         if (ogg) {
-            current_type = AUDIO_OGG;
-            decoder = ogg;
+            v->type = AUDIO_OGG;
+            v->handle = ogg;
             stb_vorbis_info info = stb_vorbis_get_info(ogg);
-            source_rate = info.sample_rate;
-            source_channels = info.channels;
-            total_frames = stb_vorbis_stream_length_in_samples(ogg);
+            v->rate = info.sample_rate;
+            v->channels = info.channels;
+            decoded_frames = stb_vorbis_stream_length_in_samples(ogg);
             load_success = true;
+
+            if (v->tags) {
+                stb_vorbis_comment comments = stb_vorbis_get_comment(ogg);
+                for (int i = 0; i < comments.comment_list_length; i++) {
+                    if (comments.comment_list[i])
+                        metadata_tags_add_comment(v->tags, comments.comment_list[i], strlen(comments.comment_list[i]));
+                }
+                v->tags->complete = true;
+            }
         }
     } else if (ext && strcasecmp_simple(ext, ".flac") == 0) {
-        drflac* flac = drflac_open_file(path, NULL);
+        drflac_allocation_callbacks alloc = { &v->arena, arena_cb_malloc, arena_cb_realloc, arena_cb_free };
+        drflac* flac;
+        if (streamed)
+            flac = v->tags ? drflac_open_with_metadata(voice_read, voice_flac_seek, voice_flac_tell, voice_flac_meta, v, &alloc)
+                           : drflac_open(voice_read, voice_flac_seek, voice_flac_tell, v, &alloc);
+        else
+            flac = v->tags ? drflac_open_memory_with_metadata(data, size, voice_flac_meta, v, &alloc)
+                           : drflac_open_memory(data, size, &alloc);
         if (flac) {
-            current_type = AUDIO_FLAC;
-            decoder = flac;
-            source_rate = flac->sampleRate;
-            source_channels = flac->channels;
-            total_frames = flac->totalPCMFrameCount;
+            if (v->tags) v->tags->complete = true;
+            v->type = AUDIO_FLAC;
+            v->handle = flac;
+            v->rate = flac->sampleRate;
+            v->channels = flac->channels;
+            decoded_frames = flac->totalPCMFrameCount;
             load_success = true;
         }
     } else {
-        decoder = malloc(sizeof(drwav));
-        if (decoder && drwav_init_file((drwav*)decoder, path, NULL)) {
-            current_type = AUDIO_WAV;
-            source_rate = ((drwav*)decoder)->sampleRate;
-            source_channels = ((drwav*)decoder)->channels;
-            total_frames = ((drwav*)decoder)->totalPCMFrameCount;
+        drwav_allocation_callbacks alloc = { &v->arena, arena_cb_malloc, arena_cb_realloc, arena_cb_free };
+        v->handle = arena_alloc(&v->arena, sizeof(drwav));
+        if (v->handle && (streamed ? drwav_init((drwav*)v->handle, voice_read, voice_wav_seek, voice_wav_tell, v, &alloc)
+                                   : drwav_init_memory((drwav*)v->handle, data, size, &alloc))) {
+            v->type = AUDIO_WAV;
+            v->rate = ((drwav*)v->handle)->sampleRate;
+            v->channels = ((drwav*)v->handle)->channels;
+            decoded_frames = ((drwav*)v->handle)->totalPCMFrameCount;
             load_success = true;
         }
     }
 
     if (!load_success) {
-        if (decoder) { free(decoder); decoder = NULL; }
+        free(head);
+        v->handle = NULL;
+        file_unload(&v->file);
+        file_stream_close(&v->stream);
+        arena_reset(&v->arena);
+        v->type = AUDIO_NONE;
+        metadata_tags_free(v->tags);
+        v->tags = NULL;
         return false;
     }
 
-    if (source_channels <= 0) source_channels = 2;
-    if (source_channels > MAX_CHANNELS) {
-        audio_close();
+    if (v->channels <= 0) v->channels = 2;
+    if (v->channels > MAX_CHANNELS) {
+        free(head);
+        voice_close(v);
+        metadata_tags_free(v->tags);
+        v->tags = NULL;
         return false;
     }
 
-    resample_phase = 0.0;
-    resample_cache_frames = 0;
-    cur_frame = 0;
+    strncpy(v->path, path, sizeof(v->path) - 1);
+    v->path[sizeof(v->path) - 1] = '\0';
+
+    // Opening streams only the headers; a file read whole most likely has
+    // neighbours of its kind, so the next track gets time to be read too.
+    v->prefetch = AUDIO_PREFETCH_SECONDS;
+    if (v->file.data && v->file.source != FILE_SOURCE_MMAP) {
+        size_t extra = v->file.size / WHOLE_READ_BYTES_PER_SECOND;
+        v->prefetch += extra < PREFETCH_MAX_SECONDS ? (uint32_t)extra : PREFETCH_MAX_SECONDS;
+    }
+
+    // MP3 encoder delay/padding; the other formats are sample exact.
+    v->lead = 0;
+    v->total = decoded_frames;
+    if (v->type == AUDIO_MP3) {
+        // One read of the tag region serves the gapless header and the metadata
+        const unsigned char *tag_data = streamed ? head : data;
+        size_t tag_size = streamed ? head_size : size;
+        uint64_t lead = 0, valid = 0;
+        if (v->tags && tag_data) metadata_tags_read_mp3(v->tags, tag_data, tag_size, !streamed);
+        if (v->tags && tag_data && gapless_mp3_trim(v->tags->id3_size ? tag_data : NULL, v->tags->id3_size,
+                                                    tag_data + v->tags->frame_offset, v->tags->frame_size,
+                                                    decoded_frames, &lead, &valid)) {
+            v->lead = lead;
+            v->total = valid;
+        }
+        free(head);
+        seekindex_request(path, decoded_frames, v->rate);
+    }
 
+    // Pre-roll: position the decoder on the first playable frame.
+    if (v->lead > 0) voice_raw_seek(v, v->lead);
+    v->read_pos = 0;
+    v->input_done = false;
+    v->eof = false;
+    downmix_init(&v->mix, v->channels, v->type == AUDIO_OGG);
+    v->out_rate = OUT_RATE;
+    if (atomic_load_explicit(&native_rate, memory_order_relaxed) &&
+        v->rate >= AUDIO_MIN_NATIVE_RATE && v->rate <= AUDIO_MAX_NATIVE_RATE)
+        v->out_rate = v->rate;
+    resampler_init(&v->rs, v->rate, v->out_rate,
+                   (ResampleQuality)atomic_load_explicit(&resample_quality, memory_order_relaxed));
+
+    // WAV tags stay incomplete, metadata falls back to reading the file for those
+    if (v->tags) post_tags(v->tags);
+    v->tags = NULL;
     return true;
 }
 
-void audio_seek(uint64_t frame) {
-    cur_frame = frame;
-    if (current_type == AUDIO_MP3) drmp3_seek_to_pcm_frame((drmp3*)decoder, cur_frame);
-    else if (current_type == AUDIO_WAV) drwav_seek_to_pcm_frame((drwav*)decoder, cur_frame);
-    else if (current_type == AUDIO_OGG) stb_vorbis_seek((stb_vorbis*)decoder, cur_frame);
-    else if (current_type == AUDIO_FLAC) drflac_seek_to_pcm_frame((drflac*)decoder, cur_frame);
+static VoiceInfo voice_info(const Voice *v) {
+    VoiceInfo info;
+    info.type = v->type;
+    info.handle = v->handle;
+    info.rate = v->rate;
+    info.out_rate = v->out_rate;
+    info.channels = v->channels;
+    info.total = v->total;
+    return info;
+}
+
+static void publish_voice(const VoiceInfo *info) {
+    current_type = info->type;
+    decoder = info->handle;
+    source_rate = info->handle ? info->rate : 44100;
+    source_channels = info->handle ? info->channels : 2;
+    total_frames = info->handle ? info->total : 0;
+    output_rate = info->handle ? info->out_rate : OUT_RATE;
 }
 
-int audio_read_frame(int16_t *out_buf) {
-    if (!decoder) return 0;
+// Decode and resample up to one SAMPLES_PER_FRAME block.
+// Returns the number of output frames written, 0 at end of track.
+static int voice_decode(Voice *v, int16_t *out_buf) {
+    if (!v->handle || v->eof) return 0;
 
-    double ratio = (double)source_rate / (double)OUT_RATE;
-    double advance_d = resample_phase + (double)SAMPLES_PER_FRAME * ratio;
-    uint32_t advance_frames = (uint32_t)advance_d;
-    double new_phase = advance_d - (double)advance_frames;
+    int channels = v->channels;
+    int out_count = resampler_process(&v->rs, out_buf, SAMPLES_PER_FRAME);
 
-    double max_src_pos = resample_phase + (double)(SAMPLES_PER_FRAME - 1) * ratio;
-    uint32_t i2_max = (uint32_t)max_src_pos + 1;
-    uint32_t required_frames = i2_max + 1;
-    uint32_t frames_to_read = required_frames;
-    if (frames_to_read < advance_frames) frames_to_read = advance_frames;
-    if (frames_to_read > SAMPLES_PER_FRAME * 8) frames_to_read = SAMPLES_PER_FRAME * 8;
+    while (out_count < SAMPLES_PER_FRAME && !v->input_done) {
+        uint32_t want = (uint32_t)resampler_input_needed(&v->rs, SAMPLES_PER_FRAME - out_count);
+        if (want == 0) break;
+        if (want > DECODE_CHUNK_FRAMES) want = DECODE_CHUNK_FRAMES;
 
-    uint64_t read = 0;
-    int channels = source_channels;
+        uint32_t need_read = want;
+        if (v->total > 0) {
+            uint64_t left = (v->read_pos < v->total) ? v->total - v->read_pos : 0;
+            if (need_read > left) need_read = (uint32_t)left;
+        }
+
+        uint64_t read = 0;
+        if (need_read > 0) {
+            if (v->type == AUDIO_MP3) {
+                read = drmp3_read_pcm_frames_s16((drmp3*)v->handle, need_read, resample_in_buf);
+            } else if (v->type == AUDIO_WAV) {
+                read = drwav_read_pcm_frames_s16((drwav*)v->handle, need_read, resample_in_buf);
+            } else if (v->type == AUDIO_OGG) {
+                read = stb_vorbis_get_samples_short_interleaved((stb_vorbis*)v->handle, channels, resample_in_buf, need_read * channels);
+            } else if (v->type == AUDIO_FLAC) {
+                read = drflac_read_pcm_frames_s16((drflac*)v->handle, need_read, resample_in_buf);
+            }
+        }
+        v->read_pos += read;
 
-    uint32_t cache_frames = (resample_cache_frames > (int)frames_to_read) ? frames_to_read : (uint32_t)resample_cache_frames;
-    if (cache_frames > 0) {
-        memcpy(resample_in_buf, resample_cache, cache_frames * (uint32_t)channels * sizeof(int16_t));
+        // Fold the whole chunk to stereo straight into the resampler's input.
+        float *l, *r;
+        resampler_input_space(&v->rs, &l, &r);
+        downmix_block(&v->mix, resample_in_buf, (int)read, l, r);
+        resampler_commit(&v->rs, (int)read);
+
+        // Short read: this is the tail, let the filter drain.
+        if (read < want) {
+            resampler_flush(&v->rs);
+            v->input_done = true;
+        }
+
+        out_count += resampler_process(&v->rs, out_buf + out_count * 2, SAMPLES_PER_FRAME - out_count);
     }
-    uint32_t need_read = (frames_to_read > cache_frames) ? (frames_to_read - cache_frames) : 0;
 
-    if (current_type == AUDIO_MP3) {
-        read = drmp3_read_pcm_frames_s16((drmp3*)decoder, need_read, resample_in_buf + cache_frames * channels);
-    } else if (current_type == AUDIO_WAV) {
-        read = drwav_read_pcm_frames_s16((drwav*)decoder, need_read, resample_in_buf + cache_frames * channels);
-    } else if (current_type == AUDIO_OGG) {
-        read = stb_vorbis_get_samples_short_interleaved((stb_vorbis*)decoder, channels, resample_in_buf + cache_frames * channels, need_read * channels);
-    } else if (current_type == AUDIO_FLAC) {
-        read = drflac_read_pcm_frames_s16((drflac*)decoder, need_read, resample_in_buf + cache_frames * channels);
+    if (v->input_done && out_count < SAMPLES_PER_FRAME) v->eof = true;
+    return out_count;
+}
+
+static bool voice_near_end(const Voice *v) {
+    if (v->eof) return true;
+    if (v->total == 0) return false;
+    uint64_t left = (v->read_pos < v->total) ? v->total - v->read_pos : 0;
+    return left < (uint64_t)v->rate * v->prefetch;
+}
+
+static uint32_t ring_free(void) {
+    uint32_t used = atomic_load_explicit(&ring_write, memory_order_relaxed) -
+                    atomic_load_explicit(&ring_read, memory_order_acquire);
+    return (used >= RING_FRAMES) ? 0 : RING_FRAMES - used;
+}
+
+static void ring_push(const int16_t *frames, uint32_t count) {
+    uint32_t w = atomic_load_explicit(&ring_write, memory_order_relaxed);
+    uint32_t start = w & RING_MASK;
+    uint32_t first = RING_FRAMES - start;
+    if (first > count) first = count;
+    memcpy(ring_buf + start * 2, frames, first * 2 * sizeof(int16_t));
+    if (count > first)
+        memcpy(ring_buf, frames + first * 2, (count - first) * 2 * sizeof(int16_t));
+    atomic_store_explicit(&ring_write, w + count, memory_order_release);
+}
+
+// Drop everything queued so far. The reader jumps to ring_flush_pos once it
+// sees the command generation complete, so the worker never touches ring_read.
+static void ring_flush(void) {
+    atomic_store_explicit(&boundary_pending, false, memory_order_relaxed);
+    atomic_store_explicit(&ring_eof, false, memory_order_relaxed);
+    atomic_store_explicit(&ring_flush_pos, atomic_load_explicit(&ring_write, memory_order_relaxed), memory_order_relaxed);
+}
+
+static void swap_voices(void) {
+    Voice *t = cur_voice;
+    cur_voice = next_voice;
+    next_voice = t;
+}
+
+// Start decoding the next voice right after the current one's tail.
+static void worker_switch_to_next(void) {
+    boundary_pos = atomic_load_explicit(&ring_write, memory_order_relaxed);
+    boundary_info = voice_info(next_voice);
+    swap_voices();
+    next_state = NEXT_RETIRED;
+    atomic_store_explicit(&ring_eof, false, memory_order_relaxed);
+    atomic_store_explicit(&boundary_pending, true, memory_order_release);
+}
+
+static bool worker_open(const char *path) {
+    bool pending = atomic_load_explicit(&boundary_pending, memory_order_relaxed);
+    if (next_state == NEXT_RETIRED) {
+        if (pending && strcmp(cur_voice->path, path) == 0) {
+            // Already switched to this track but not heard yet: rewind it.
+            voice_close(next_voice);
+            next_state = NEXT_NONE;
+            voice_seek(cur_voice, 0);
+            return true;
+        }
+        // The retired slot holds what is being heard; it is replaced anyway.
+        voice_close(next_voice);
+        next_state = NEXT_NONE;
     }
 
-    uint32_t total_available = cache_frames + (uint32_t)read;
-    if (total_available < 2 || (read < need_read && cur_frame > 1000)) {
-        return 0; // End of track
+    if (next_state == NEXT_READY && strcmp(next_voice->path, path) == 0) {
+        // Promote the prefetched voice instead of reopening the file.
+        voice_close(cur_voice);
+        swap_voices();
+        next_state = NEXT_NONE;
+        voice_seek(cur_voice, 0);
+        return true;
     }
 
-    bool vorbis_order = (current_type == AUDIO_OGG);
-    for (int i = 0; i < SAMPLES_PER_FRAME; i++) {
-        double src_pos = resample_phase + i * ratio;
-        int i1 = (int)src_pos;
-        int i2 = i1 + 1;
+    return voice_open(cur_voice, path);
+}
 
-        // Clamp indices
-        if (i1 < 0) i1 = 0;
-        if (i2 < 0) i2 = 0;
-        if (i1 >= (int)total_available) i1 = (int)total_available - 1;
-        if (i2 >= (int)total_available) i2 = i1;
+static void worker_seek(uint64_t frame) {
+    if (next_state == NEXT_RETIRED && atomic_load_explicit(&boundary_pending, memory_order_relaxed)) {
+        // The listener is still on the retired track: switch back to it.
+        swap_voices();
+        next_state = NEXT_READY;
+        voice_seek(next_voice, 0);
+    }
+    voice_seek(cur_voice, frame);
+}
+
+static bool worker_execute(const AudioCmd *c) {
+    bool ok = true;
+    switch (c->type) {
+        case AUDIO_CMD_OPEN:
+            ok = worker_open(c->path);
+            break;
+        case AUDIO_CMD_SEEK:
+            worker_seek(c->frame);
+            break;
+        case AUDIO_CMD_CLOSE:
+            voice_close(cur_voice);
+            voice_close(next_voice);
+            next_state = NEXT_NONE;
+            break;
+        default:
+            ok = false;
+            break;
+    }
+
+    // Open/close run while the caller waits, so the listener-facing state can be set here.
+    if (c->type == AUDIO_CMD_OPEN || c->type == AUDIO_CMD_CLOSE) {
+        VoiceInfo info = voice_info(cur_voice);
+        mutex_lock(play_mutex);
+        publish_voice(&info);
+        mutex_unlock(play_mutex);
+    }
+    return ok;
+}
+
+// Pick up a new audio_queue_next request. Called with cmd_mutex held.
+static void sync_next_queue(void) {
+    if (queued_seen == queued_gen || next_state == NEXT_RETIRED) return;
+    queued_seen = queued_gen;
+
+    if ((next_state == NEXT_QUEUED || next_state == NEXT_READY) && strcmp(next_voice->path, queued_path) == 0)
+        return;
+
+    voice_close(next_voice);
+    next_state = NEXT_NONE;
+    if (queued_path[0]) {
+        strcpy(next_voice->path, queued_path);
+        next_state = NEXT_QUEUED;
+    }
+}
+
+static void decode_worker(void *arg) {
+    (void)arg;
+    static int16_t block[SAMPLES_PER_FRAME * 2];
+
+    mutex_lock(cmd_mutex);
+    for (;;) {
+        if (cmd.type == AUDIO_CMD_QUIT) break;
+
+        if (cmd.type != AUDIO_CMD_NONE) {
+            AudioCmd c = cmd;
+            cmd.type = AUDIO_CMD_NONE;
+            mutex_unlock(cmd_mutex);
+
+            bool ok = worker_execute(&c);
+            ring_flush();
+
+            mutex_lock(cmd_mutex);
+            cmd_result = ok;
+            atomic_store_explicit(&gen_done, c.gen, memory_order_release);
+            cond_broadcast(done_cond);
+            continue;
+        }
+
+        sync_next_queue();
+
+        if (next_state == NEXT_RETIRED && !atomic_load_explicit(&boundary_pending, memory_order_acquire)) {
+            // The reader has crossed into the new track.
+            voice_close(next_voice);
+            next_state = NEXT_NONE;
+            continue;
+        }
+
+        if (next_state == NEXT_QUEUED && cur_voice->handle && voice_near_end(cur_voice)) {
+            char path[1024];
+            strcpy(path, next_voice->path);
+            mutex_unlock(cmd_mutex);
+            bool ok = voice_open(next_voice, path);
+            mutex_lock(cmd_mutex);
+            next_state = ok ? NEXT_READY : NEXT_FAILED;
+            continue;
+        }
+
+        if (cur_voice->handle && cur_voice->eof) {
+            if (next_state == NEXT_READY && !atomic_load_explicit(&boundary_pending, memory_order_acquire)) {
+                worker_switch_to_next();
+                continue;
+            }
+            if (next_state == NEXT_NONE || next_state == NEXT_FAILED)
+                atomic_store_explicit(&ring_eof, true, memory_order_release);
+        }
 
-        float frac = (float)(src_pos - i1);
+        if (!cur_voice->handle || cur_voice->eof || atomic_load(&worker_paused) || ring_free() < SAMPLES_PER_FRAME) {
+            cond_wait(cmd_cond, cmd_mutex);
+            continue;
+        }
 
-        float l1, r1, l2, r2;
-        downmix_frame_lr(resample_in_buf, channels, i1, &l1, &r1, vorbis_order);
-        downmix_frame_lr(resample_in_buf, channels, i2, &l2, &r2, vorbis_order);
-        float out_l = (1.0f - frac) * l1 + frac * l2;
-        float out_r = (1.0f - frac) * r1 + frac * r2;
-        out_buf[i*2]   = clamp_i16(out_l);
-        out_buf[i*2+1] = clamp_i16(out_r);
+        mutex_unlock(cmd_mutex);
+        voice_bind_seek_table(cur_voice);
+        int n = voice_decode(cur_voice, block);
+        if (n > 0) ring_push(block, (uint32_t)n);
+        mutex_lock(cmd_mutex);
     }
+    mutex_unlock(cmd_mutex);
+
+    voice_close(cur_voice);
+    voice_close(next_voice);
+    next_state = NEXT_NONE;
+}
+
+// Post a command for the worker (play_mutex held), returns its generation, 0 without a worker
+static unsigned post_command(AudioCmdType type, const char *path, uint64_t frame) {
+    if (!worker) return 0;
+
+    mutex_lock(cmd_mutex);
+    cmd.type = type;
+    cmd.frame = frame;
+    cmd.path[0] = '\0';
+    if (path) {
+        strncpy(cmd.path, path, sizeof(cmd.path) - 1);
+        cmd.path[sizeof(cmd.path) - 1] = '\0';
+    }
+    unsigned gen = cmd.gen = ++gen_posted;
+    cond_signal(cmd_cond);
+    mutex_unlock(cmd_mutex);
+    return gen;
+}
+
+// Wait for the worker to run command gen, returns its result
+static bool wait_command(unsigned gen) {
+    if (gen == 0) return false;
+
+    mutex_lock(cmd_mutex);
+    while (atomic_load_explicit(&gen_done, memory_order_acquire) != gen && cmd.type != AUDIO_CMD_QUIT)
+        cond_wait(done_cond, cmd_mutex);
+    bool result = cmd_result;
+    mutex_unlock(cmd_mutex);
+    return result;
+}
+
+void audio_init(void) {
+    current_type = AUDIO_NONE;
+    decoder = NULL;
+
+    if (worker) return;
+    atomic_store(&ring_write, 0);
+    atomic_store(&ring_read, 0);
+    atomic_store(&ring_flush_pos, 0);
+    atomic_store(&ring_eof, false);
+    atomic_store(&boundary_pending, false);
+    atomic_store(&gen_done, 0);
+    atomic_store(&worker_paused, false);
+    gen_posted = 0;
+    consumer_gen = 0;
+    queued_path[0] = '\0';
+    queued_gen = 0;
+    queued_seen = 0;
+    next_state = NEXT_NONE;
+    track_advanced = false;
+    cmd.type = AUDIO_CMD_NONE;
 
-    resample_phase = new_phase;
-    cur_frame += (uint64_t)advance_frames;
+    seekindex_init();
+    for (int i = 0; i < 2; i++) arena_init(&voices[i].arena, VOICE_ARENA_SIZE, VOICE_ARENA_LIMIT);
+    play_mutex = mutex_create();
+    cmd_mutex = mutex_create();
+    cmd_cond = cond_create();
+    done_cond = cond_create();
+    if (play_mutex && cmd_mutex && cmd_cond && done_cond)
+        worker = thread_create(decode_worker, NULL);
+    if (!worker)
+        fprintf(stderr, "[MusicCore] Failed to start decode worker\n");
+}
 
-    int overshoot = (int)total_available - (int)advance_frames;
-    if (overshoot < 0) overshoot = 0;
-    if (overshoot > RESAMPLE_CACHE_FRAMES) overshoot = RESAMPLE_CACHE_FRAMES;
-    resample_cache_frames = overshoot;
-    if (overshoot > 0) {
-        memcpy(resample_cache,
-               resample_in_buf + (total_available - (uint32_t)overshoot) * (uint32_t)channels,
-               (uint32_t)overshoot * (uint32_t)channels * sizeof(int16_t));
+void audio_deinit(void) {
+    if (worker) {
+        mutex_lock(cmd_mutex);
+        cmd.type = AUDIO_CMD_QUIT;
+        cond_signal(cmd_cond);
+        mutex_unlock(cmd_mutex);
+        thread_join(worker);
+        worker = NULL;
     }
+    seekindex_deinit();
+    for (int i = 0; i < 2; i++) arena_destroy(&voices[i].arena);
+    for (int i = 0; i < TAG_MAILBOX_SLOTS; i++) {
+        metadata_tags_free(tag_mailbox[i]);
+        tag_mailbox[i] = NULL;
+    }
+    atomic_store(&tags_waiting, 0);
+    cond_free(done_cond);
+    cond_free(cmd_cond);
+    mutex_free(cmd_mutex);
+    mutex_free(play_mutex);
+    done_cond = NULL;
+    cmd_cond = NULL;
+    cmd_mutex = NULL;
+    play_mutex = NULL;
+    current_type = AUDIO_NONE;
+    decoder = NULL;
+}
+
+void audio_close(void) {
+    if (!worker) return;
+    mutex_lock(cmd_mutex);
+    queued_path[0] = '\0';
+    queued_seen = ++queued_gen;
+    mutex_unlock(cmd_mutex);
+    mutex_lock(play_mutex);
+    unsigned gen = post_command(AUDIO_CMD_CLOSE, NULL, 0);
+    track_advanced = false;
+    mutex_unlock(play_mutex);
+    wait_command(gen);
+}
+
+bool audio_open_track(const char *path) {
+    if (!worker) return false;
+    // Post under play_mutex so the reader never counts old frames against the new track
+    mutex_lock(play_mutex);
+    play_base_frame = 0;
+    play_out_frames = 0;
+    cur_frame = 0;
+    track_advanced = false;
+    unsigned gen = post_command(AUDIO_CMD_OPEN, path, 0);
+    mutex_unlock(play_mutex);
+    return wait_command(gen);
+}
+
+void audio_queue_next(const char *path) {
+    if (!worker) return;
+    mutex_lock(cmd_mutex);
+    queued_path[0] = '\0';
+    if (path) {
+        strncpy(queued_path, path, sizeof(queued_path) - 1);
+        queued_path[sizeof(queued_path) - 1] = '\0';
+    }
+    queued_gen++;
+    cond_signal(cmd_cond);
+    mutex_unlock(cmd_mutex);
+}
+
+bool audio_take_track_advance(void) {
+    if (!worker) return false;
+    mutex_lock(play_mutex);
+    bool advanced = track_advanced;
+    track_advanced = false;
+    mutex_unlock(play_mutex);
+    return advanced;
+}
+
+void audio_seek(uint64_t frame) {
+    if (!worker) return;
+    mutex_lock(play_mutex);
+    if (decoder) {
+        play_base_frame = frame;
+        play_out_frames = 0;
+        cur_frame = frame;
+        post_command(AUDIO_CMD_SEEK, NULL, frame);
+    }
+    mutex_unlock(play_mutex);
+}
+
+// Every frame of the last track has been read (play_mutex held)
+static bool reader_at_end(void) {
+    if (!decoder) return false;
+    unsigned done = atomic_load_explicit(&gen_done, memory_order_acquire);
+    if (done != gen_posted || done != consumer_gen) return false;
+    if (atomic_load_explicit(&boundary_pending, memory_order_acquire) ||
+        !atomic_load_explicit(&ring_eof, memory_order_acquire)) return false;
+    return atomic_load_explicit(&ring_write, memory_order_acquire) ==
+           atomic_load_explicit(&ring_read, memory_order_relaxed);
+}
+
+void audio_get_position(AudioPosition *pos) {
+    if (play_mutex) mutex_lock(play_mutex);
+    pos->playing = decoder != NULL;
+    pos->ended = reader_at_end();
+    pos->frame = cur_frame;
+    pos->total = total_frames;
+    pos->rate = source_rate;
+    pos->channels = source_channels;
+    pos->out_rate = output_rate;
+    if (play_mutex) mutex_unlock(play_mutex);
+}
+
+void audio_set_resample_quality(int quality) {
+    if (quality < RESAMPLE_FAST || quality > RESAMPLE_HIGH) quality = RESAMPLE_BALANCED;
+    atomic_store_explicit(&resample_quality, quality, memory_order_relaxed);
+}
+
+TrackTags *audio_take_tags(const char *path) {
+    if (!worker || !path || atomic_load_explicit(&tags_waiting, memory_order_acquire) == 0) return NULL;
+
+    TrackTags *t = NULL;
+    mutex_lock(cmd_mutex);
+    for (int i = 0; i < TAG_MAILBOX_SLOTS; i++) {
+        if (tag_mailbox[i] && strcmp(tag_mailbox[i]->path, path) == 0) {
+            t = tag_mailbox[i];
+            tag_mailbox[i] = NULL;
+            atomic_fetch_sub(&tags_waiting, 1);
+            break;
+        }
+    }
+    mutex_unlock(cmd_mutex);
+    return t;
+}
+
+void audio_set_native_rate(bool enabled) {
+    atomic_store_explicit(&native_rate, enabled, memory_order_relaxed);
+}
+
+void audio_set_paused(bool paused) {
+    if (!worker) return;
+    mutex_lock(cmd_mutex);
+    atomic_store(&worker_paused, paused);
+    cond_signal(cmd_cond);
+    mutex_unlock(cmd_mutex);
+}
+
+// Reader reached the boundary: the next track is now the one being heard.
+static void cross_boundary(void) {
+    publish_voice(&boundary_info);
+    play_base_frame = 0;
+    play_out_frames = 0;
+    cur_frame = 0;
+    track_advanced = true;
+    atomic_store_explicit(&boundary_pending, false, memory_order_release);
+}
+
+static int read_frames(int16_t *out_buf, int frames) {
+    if (!decoder || frames <= 0) return 0;
+
+    // A posted command has not run yet: whatever is queued is stale.
+    unsigned done = atomic_load_explicit(&gen_done, memory_order_acquire);
+    if (done != gen_posted) {
+        memset(out_buf, 0, (size_t)frames * 2 * sizeof(int16_t));
+        return frames;
+    }
+    bool flushed = false;
+    if (done != consumer_gen) {
+        atomic_store_explicit(&ring_read, atomic_load_explicit(&ring_flush_pos, memory_order_relaxed), memory_order_release);
+        consumer_gen = done;
+        flushed = true;
+    }
+
+    uint32_t filled = 0;
+    bool ended = false;
+    bool rate_change = false;
+    uint32_t rate_before = output_rate;
+    while (filled < (uint32_t)frames) {
+        // Load the flags before the write index so a set flag implies its data is visible.
+        bool crossing = atomic_load_explicit(&boundary_pending, memory_order_acquire);
+        bool eof = atomic_load_explicit(&ring_eof, memory_order_acquire);
+        uint32_t r = atomic_load_explicit(&ring_read, memory_order_relaxed);
+        uint32_t avail = atomic_load_explicit(&ring_write, memory_order_acquire) - r;
+        uint32_t want = (uint32_t)frames - filled;
+
+        if (crossing) {
+            uint32_t to_boundary = boundary_pos - r;
+            if (to_boundary == 0) {
+                cross_boundary();
+                // Stop at a rate change: the new rate is published, so the
+                // frontend renegotiates before any of the new track is read.
+                if (output_rate != rate_before) {
+                    rate_change = true;
+                    break;
+                }
+                continue;
+            }
+            if (want > to_boundary) want = to_boundary;
+        }
+
+        uint32_t n = (avail < want) ? avail : want;
+        if (n == 0) {
+            ended = eof && !crossing;
+            break;
+        }
+
+        uint32_t start = r & RING_MASK;
+        uint32_t first = RING_FRAMES - start;
+        if (first > n) first = n;
+        memcpy(out_buf + filled * 2, ring_buf + start * 2, first * 2 * sizeof(int16_t));
+        if (n > first)
+            memcpy(out_buf + (filled + first) * 2, ring_buf, (n - first) * 2 * sizeof(int16_t));
+        atomic_store_explicit(&ring_read, r + n, memory_order_release);
+
+        filled += n;
+        play_out_frames += n;
+    }
+
+    // A read that ends right at a rate change crosses it now, or the next
+    // read would start the new track before the rate is renegotiated
+    if (!rate_change && atomic_load_explicit(&boundary_pending, memory_order_acquire) &&
+        boundary_pos == atomic_load_explicit(&ring_read, memory_order_relaxed) && boundary_info.out_rate != output_rate) {
+        cross_boundary();
+        rate_change = true;
+    }
+
+    // Dropping the stale frames frees the ring too: a worker waiting on a full ring must hear of it
+    if (filled > 0 || flushed) {
+        mutex_lock(cmd_mutex);
+        cond_signal(cmd_cond);
+        mutex_unlock(cmd_mutex);
+    }
+
+    if (filled == 0 && ended) return 0; // End of track
+
+    // Underrun or final partial block: pad with silence. The old track's last
+    // frames before a rate change go out alone, still at the old rate.
+    if (filled < (uint32_t)frames && !(rate_change && filled > 0)) {
+        memset(out_buf + filled * 2, 0, ((uint32_t)frames - filled) * 2 * sizeof(int16_t));
+        filled = (uint32_t)frames;
+    }
+
+    cur_frame = play_base_frame + play_out_frames * source_rate / output_rate;
+    if (total_frames > 0 && cur_frame > total_frames) cur_frame = total_frames;
+    return (int)filled;
+}
 
-    return SAMPLES_PER_FRAME;
+int audio_read_frame(int16_t *out_buf, int frames) {
+    if (!worker) return 0;
+    mutex_lock(play_mutex);
+    int n = read_frames(out_buf, frames);
+    mutex_unlock(play_mutex);
+    return n;
 }
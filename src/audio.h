@@ -2,11 +2,15 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "metadata.h"
 
 #define OUT_RATE 48000
 #define SAMPLES_PER_FRAME 800
+#define AUDIO_MIN_NATIVE_RATE 8000
+#define AUDIO_MAX_NATIVE_RATE 192000
+#define AUDIO_MAX_RUN_FRAMES (AUDIO_MAX_NATIVE_RATE / 50)
 #define MAX_CHANNELS 8
-#define RESAMPLE_CACHE_FRAMES 8
+#define AUDIO_PREFETCH_SECONDS 5
 
 typedef enum { AUDIO_NONE, AUDIO_MP3, AUDIO_WAV, AUDIO_OGG, AUDIO_FLAC } AudioType;
 
@@ -17,23 +21,65 @@ extern uint32_t source_rate;
 extern int source_channels;
 extern uint64_t total_frames;
 extern uint64_t cur_frame;
+extern uint32_t output_rate;   // rate of the frames audio_read_frame returns
 
-// Initialize audio subsystem
+// Snapshot of the track being heard
+typedef struct {
+    bool playing;
+    uint64_t frame;
+    uint64_t total;
+    uint32_t rate;
+    int channels;
+    uint32_t out_rate;
+    bool ended;         // audio_read_frame has returned everything, it will return 0
+} AudioPosition;
+
+// Initialize audio subsystem and start the decode worker
 void audio_init(void);
 
-// Deinitialize and free resources
+// Stop the decode worker and free resources
 void audio_deinit(void);
 
-// Open and decode a track file, returns true on success
+// Open a track on the decode worker, returns true on success
 bool audio_open_track(const char *path);
 
-// Read one frame of audio (resampled + downmixed to stereo)
-// Returns number of samples written, 0 if end of track
-int audio_read_frame(int16_t *out_buf);
+// Queue the track to play after the current one. The worker opens and
+// pre-rolls it AUDIO_PREFETCH_SECONDS before the end (longer after a track
+// that had to be read whole) and switches gaplessly.
+// Pass NULL to clear the queue.
+void audio_queue_next(const char *path);
+
+// Take the tags captured when the decoder for path was opened, NULL if none
+// are waiting. The caller owns the result (metadata_load/metadata_prefetch consume it).
+TrackTags *audio_take_tags(const char *path);
+
+// Returns true once after playback has crossed into the queued track
+bool audio_take_track_advance(void);
+
+// Copy the playback state consistently. The globals above are only safe to
+// read directly when audio_read_frame runs on the same thread.
+void audio_get_position(AudioPosition *pos);
 
-// Seek to position in current track
+// Read up to frames stereo frames (resampled + downmixed) from the decode ring.
+// Returns the number written: frames (silence-padded on underrun), fewer when
+// playback stops at a gapless switch to a track with a different output_rate,
+// 0 at end of track. At such a switch output_rate already holds the new rate
+// when this returns, so the frontend can be renegotiated before the next read.
+// May be called from another thread than the other audio_* calls.
+int audio_read_frame(int16_t *out_buf, int frames);
+
+// Seek to position in current track (queued to the decode worker)
 void audio_seek(uint64_t frame);
 
+// Resampler quality tier (0 = fast, 1 = balanced, 2 = high), used from the next open or seek
+void audio_set_resample_quality(int quality);
+
+// Output each track at its own sample rate (no resampling), used from the next open
+void audio_set_native_rate(bool enabled);
+
+// Stop the decode worker from running ahead while playback is paused
+void audio_set_paused(bool paused);
+
 // Close current decoder
 void audio_close(void);
 
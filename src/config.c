@@ -112,6 +112,15 @@ void config_update(retro_environment_t environ_cb) {
     cfg.viz_peak_hold = get_int_var(environ_cb, "media_viz_peak_hold", 30, 0, 300);
     cfg.track_text_mode = parse_track_text_mode(get_var_value(environ_cb, "media_use_filename"));
 
+    const char *quality_value = get_var_value(environ_cb, "media_resample_quality");
+    if (quality_value && !strcmp(quality_value, "Fast")) cfg.resample_quality = 0;
+    else if (quality_value && !strcmp(quality_value, "High")) cfg.resample_quality = 2;
+    else cfg.resample_quality = 1;
+    cfg.native_rate = get_bool_var(environ_cb, "media_native_rate", false);
+    cfg.async_audio = get_bool_var(environ_cb, "media_async_audio", true);
+    cfg.play_folder = get_bool_var(environ_cb, "media_play_folder", false);
+    cfg.art_cache_mb = get_int_var(environ_cb, "media_art_cache", 16, 0, 1024);
+
 }
 
 void config_declare_variables(retro_environment_t cb) {
@@ -135,6 +144,11 @@ void config_declare_variables(retro_environment_t cb) {
         { "media_viz_gradient", "Viz Gradient; On|Off" },
         { "media_viz_peak_hold", "Peak Hold; 30|0|15|45|60" },
         { "media_use_filename", "Track Text Mode; Show ID|Show filename with extension|Show Filename without extension" },
+        { "media_resample_quality", "Resampler Quality; Balanced|Fast|High" },
+        { "media_native_rate", "Native Sample Rate; Off|On" },
+        { "media_async_audio", "Async Audio (Restart); On|Off" },
+        { "media_play_folder", "Play Whole Folder (Restart); Off|On" },
+        { "media_art_cache", "Art Cache MB; 16|0|4|8|32|64" },
         { NULL, NULL }
     };
     cb(RETRO_ENVIRONMENT_SET_VARIABLES, (void*)vars);
@@ -20,6 +20,11 @@ typedef struct {
     int viz_bands, viz_mode, viz_peak_hold;
     bool viz_gradient;
     TrackTextMode track_text_mode;
+    int resample_quality;   // 0 = fast, 1 = balanced, 2 = high
+    bool native_rate;       // output at each track's own sample rate
+    bool async_audio;       // let the frontend pull audio (SET_AUDIO_CALLBACK), read at load
+    bool play_folder;       // a single loaded track brings the rest of its folder, read at load
+    int art_cache_mb;       // decoded art kept for reuse across tracks
 } Config;
 
 // Global configuration instance
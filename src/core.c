@@ -7,12 +7,25 @@
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
+#include <stdatomic.h>
 #include "libretro.h"
 
 #include "config.h"
 #include "layout.h"
 #include "video.h"
 #include "audio.h"
+#include "seekindex.h"
+#include "fileio.h"
+#include "thread.h"
+#include "playlist.h"
+#include "m3u.h"
+#include "cue.h"
+#include "dirscan.h"
+#include "plindex.h"
+#include "plcheck.h"
+#include "prescan.h"
+#include "artdir.h"
+#include "artcache.h"
 #include "metadata.h"
 #include "visualizer.h"
 
@@ -24,22 +37,74 @@ static retro_input_poll_t input_poll_cb;
 static retro_input_state_t input_state_cb;
 
 // Playlist state
-static char *tracks[256];
-static int track_count = 0;
+static Playlist playlist;
 static int current_idx = 0;
+static int next_idx = -1;
+static bool next_meta_prefetched = false;
 static char m3u_base_path[1024] = {0};
+static int track_seconds = 0;  // playlist's #EXTINF length of the current track
+static char scan_seed[1024];    // loaded track whose folder is being scanned
+
+// A CUE track plays frames track_start..track_end of its file (end 0 = to the
+// file's end) and the position shown is relative to track_start. file_frame is
+// where playback is in the file itself.
+static uint64_t track_start = 0;
+static uint64_t track_end = 0;
+static uint64_t file_frame = 0;
+
+// Track types the core plays, also what folder scans collect
+#define AUDIO_EXTENSIONS "mp3|wav|ogg|flac"
 
 // UI state
 static int scroll_x = 320;
 static int debounce = 0;
-static bool is_paused = false;
+static atomic_bool is_paused = false;
 static bool is_shuffle = false;
 static char time_str[32];
 static int ff_rw_icon_timer = 0;
 static int ff_rw_dir = 0;
 
+// Audio timing: the rate last reported to the frontend and the per-run
+// frame count remainder. Each run is worth frame_usec of audio when the
+// frontend reports frame times, 1 / CORE_FPS otherwise; the accumulator is
+// in units of 1 / (CORE_FPS * 1000000) frames so both divide exactly.
+#define CORE_FPS 60
+#define FRAME_TIME_MAX_USEC 50000
+static atomic_uint av_sample_rate = OUT_RATE;
+static uint64_t audio_frame_accum = 0;
+static retro_usec_t frame_usec = 0;
+
+// Playback state for this frame. Read through audio_get_position because in
+// async mode the frontend's audio thread moves it.
+static AudioPosition play;
+
+// Async audio: with SET_AUDIO_CALLBACK the frontend's audio thread pulls
+// AUDIO_CALLBACK_MS chunks through audio_callback, and retro_run only
+// reacts to what it produced (track end, visualizer).
+#define AUDIO_CALLBACK_MS 10
+static bool audio_async = false;              // callback registered for this content
+static atomic_bool audio_async_enabled;       // frontend has the callback running
+
+// Most recent callback output, so retro_run can feed the visualizer
+static Mutex *viz_lock = NULL;
+static int16_t viz_recent[AUDIO_MAX_RUN_FRAMES * 2];
+static int viz_recent_frames = 0;
+
+// Scrub: held LEFT/RIGHT moves a target position every frame, the decoder
+// only seeks every SCRUB_SEEK_INTERVAL frames and on release. Speed is in
+// track seconds per second held and ramps up the longer the button is down.
+#define SCRUB_TAP_SECONDS 3
+#define SCRUB_SEEK_INTERVAL 15
+#define SCRUB_BASE_SPEED 20
+#define SCRUB_MAX_SPEED 240
+static bool scrub_active = false;
+static int scrub_dir = 0;
+static int scrub_held = 0;
+static uint64_t scrub_target = 0;
+static uint64_t scrub_seeked = 0;
+
 // Forward declarations
-static void open_track(int idx);
+static void open_track(int idx, int dir);
 
 static int next_viz_mode(int mode) {
     if (mode == 0) return 3; // Bars -> VU Meter
@@ -74,200 +139,408 @@ static int strcasecmp_simple(const char *s1, const char *s2) {
     return *s1 - *s2;
 }
 
-static int strncasecmp_simple(const char *s1, const char *s2, size_t n) {
-    for (size_t i = 0; i < n; i++) {
-        char c1 = s1[i];
-        char c2 = s2[i];
-        if (!c1 || !c2) return c1 - c2;
-        if (c1 >= 'A' && c1 <= 'Z') c1 += 32;
-        if (c2 >= 'A' && c2 <= 'Z') c2 += 32;
-        if (c1 != c2) return c1 - c2;
+// rand() may only give 15 bits (RAND_MAX 32767 on Windows), too few for big playlists
+static int random_index(int count) {
+    uint32_t r = ((uint32_t)rand() << 15) ^ (uint32_t)rand();
+    return (int)(r % (uint32_t)count);
+}
+
+// First entry from idx on, stepping by dir, not known to be unplayable; -1 if all are
+static int skip_bad(int idx, int dir) {
+    for (int i = 0; i < playlist.count; i++, idx += dir) {
+        idx = (idx % playlist.count + playlist.count) % playlist.count;
+        if (!plcheck_bad(playlist_get(&playlist, idx))) return idx;
     }
-    return 0;
+    return -1;
 }
 
-static int is_drive_letter(char c) {
-    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+static int pick_next_idx(void) {
+    if (playlist.count == 0) return -1;
+    int idx = is_shuffle ? random_index(playlist.count) : current_idx + 1;
+    return skip_bad(idx, 1);
 }
 
-static int is_localhost_host(const char *s, size_t len) {
-    return len == 9 && strncasecmp_simple(s, "localhost", 9) == 0;
+// Have the entries playback can reach next checked before it gets there
+#define CHECK_AHEAD 8
+static void check_ahead(void) {
+    plcheck_queue(playlist_get(&playlist, next_idx));
+    for (int i = 1; i <= CHECK_AHEAD && i < playlist.count; i++)
+        plcheck_queue(playlist_get(&playlist, (current_idx + i) % playlist.count));
+    plcheck_queue(playlist_get(&playlist, (current_idx + playlist.count - 1) % playlist.count));
 }
 
-static int hex_value(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    return -1;
+// Entry idx is one track of a CUE sheet
+static bool entry_cue(int idx, PlaylistInfo *info) {
+    return playlist_get_info(&playlist, idx, info) && info->cue_track;
 }
 
-static void percent_decode_inplace(char *s) {
-    if (!s) return;
-    size_t r = 0;
-    size_t w = 0;
-    while (s[r]) {
-        if (s[r] == '%' && s[r + 1] && s[r + 2]) {
-            int hi = hex_value(s[r + 1]);
-            int lo = hex_value(s[r + 2]);
-            if (hi >= 0 && lo >= 0) {
-                s[w++] = (char)((hi << 4) | lo);
-                r += 3;
-                continue;
-            }
-        }
-        s[w++] = s[r++];
-    }
-    s[w] = '\0';
+// Entry idx is a CUE track of the file playing now, reached by seeking rather than opening
+static bool in_open_file(int idx) {
+    PlaylistInfo info;
+    const char *cur = playlist_get(&playlist, current_idx);
+    const char *p = playlist_get(&playlist, idx);
+    return play.playing && cur && p && strcmp(cur, p) == 0 && entry_cue(idx, &info);
 }
 
-static char *file_uri_path_start(char *uri, bool *file_is_unc) {
-    if (!uri || !uri[0]) return uri;
+// Entry idx is the CUE track that starts where the current one ends, in the same file
+static bool follows_in_file(int idx) {
+    PlaylistInfo cur, next;
+    return in_open_file(idx) && entry_cue(current_idx, &cur) && entry_cue(idx, &next) &&
+           cur.cue_end != 0 && next.cue_start == cur.cue_end;
+}
 
-    // Keep Windows-style file://C:/... URIs unchanged.
-    if (is_drive_letter(uri[0]) && uri[1] == ':') return uri;
+// Frames of entry idx within the open file, at its rate
+static void set_track_span(int idx) {
+    PlaylistInfo info;
+    track_start = track_end = 0;
+    if (!entry_cue(idx, &info) || play.rate == 0) return;
+    track_start = (uint64_t)info.cue_start * play.rate / CUE_FRAMES_PER_SECOND;
+    track_end = (uint64_t)info.cue_end * play.rate / CUE_FRAMES_PER_SECOND;
+}
 
-    char *sep = uri;
-    while (*sep && *sep != '/' && *sep != '\\') sep++;
+// Hand the upcoming track to the audio worker so it can switch gaplessly. CUE
+// tracks of the open file play on or are sought to, and a CUE track that does
+// not start at the beginning of its file can only be opened and sought.
+static void queue_next_track(void) {
+    next_idx = pick_next_idx();
+    next_meta_prefetched = false;
+    const char *path = next_idx >= 0 ? playlist_get(&playlist, next_idx) : NULL;
+    PlaylistInfo info;
+    if (path && entry_cue(next_idx, &info) && (info.cue_start > 0 || in_open_file(next_idx))) path = NULL;
+    audio_queue_next(path);
+    check_ahead();
+    prescan_focus(next_idx);
+}
 
-    // file://hostname with no path: treat as UNC host.
-    if (!*sep) {
-        if (!is_localhost_host(uri, strlen(uri))) *file_is_unc = true;
-        return uri;
+// Details of entry idx from the playlist index or the playlist itself, with
+// what the prescan read from the file filling in their gaps; NULL if none has any
+static const PlaylistInfo *entry_info(int idx, PlaylistInfo *info) {
+    bool known = plindex_get(idx, info) || playlist_get_info(&playlist, idx, info);
+    PlaylistInfo scanned;
+    if (!prescan_get(idx, &scanned)) return known ? info : NULL;
+    if (!known) {
+        *info = scanned;
+        return info;
     }
+    // A CUE track's file length is the whole album's
+    if (info->duration == 0 && !info->cue_track) info->duration = scanned.duration;
+    if (!info->title && !info->tags_known) {
+        info->artist = scanned.artist;
+        info->title = scanned.title;
+        info->album = scanned.album;
+        info->tags_known = true;
+    }
+    return info;
+}
 
-    size_t host_len = (size_t)(sep - uri);
-    if (host_len == 0) {
-        // file:///path...
-        uri = sep;
-    } else if (is_localhost_host(uri, host_len)) {
-        // file://localhost/path...
-        uri = sep;
-    } else {
-        // file://server/share...
-        *file_is_unc = true;
+// Snapshot the playback state, relative to the CUE track when one plays; the
+// playlist's length stands in when the decoder cannot tell
+static void update_position(void) {
+    audio_get_position(&play);
+    file_frame = play.frame;
+    if (play.playing && (track_start > 0 || track_end > 0)) {
+        uint64_t end = track_end > 0 && (play.total == 0 || track_end < play.total) ? track_end : play.total;
+        play.frame = play.frame > track_start ? play.frame - track_start : 0;
+        play.total = end > track_start ? end - track_start : 0;
     }
+    if (play.playing && play.total == 0 && track_seconds > 0)
+        play.total = (uint64_t)track_seconds * play.rate;
+}
 
-    // file:///C:/... -> C:/... (Windows drive path)
-    if ((uri[0] == '/' || uri[0] == '\\') && is_drive_letter(uri[1]) && uri[2] == ':')
-        uri++;
+// Load the text and art of entry idx, now the audio worker has opened it
+static void load_track_metadata(int idx) {
+    const char *p = playlist_get(&playlist, idx);
+    PlaylistInfo info;
+    const PlaylistInfo *hint = entry_info(idx, &info);
+    track_seconds = hint ? hint->duration : 0;
+    metadata_load(p, m3u_base_path, cfg.track_text_mode, audio_take_tags(p), hint);
+
+    // Remember what was found for the next time this playlist loads
+    PlaylistInfo learned;
+    metadata_get_info(&learned);
+    update_position();
+    if (play.playing) plindex_update(idx, p, &learned, play.total, play.rate);
+}
 
-    return uri;
+// Seek within the current track
+static void seek_track(uint64_t frame) {
+    audio_seek(track_start + frame);
 }
 
-static int read_utf16_line(FILE *f, char *out, size_t out_sz, bool le) {
-    if (!out || out_sz == 0) return 0;
-    size_t idx = 0;
-    for (;;) {
-        unsigned char b[2];
-        size_t r = fread(b, 1, 2, f);
-        if (r < 2) {
-            if (idx == 0) return 0;
-            break;
-        }
-        uint16_t ch = le ? (uint16_t)(b[0] | (b[1] << 8)) : (uint16_t)(b[1] | (b[0] << 8));
-        if (ch == 0xFEFF) continue;
-        if (ch == '\n') break;
-        if (ch == '\r') {
-            long pos = ftell(f);
-            if (pos >= 0) {
-                unsigned char nb[2];
-                size_t nr = fread(nb, 1, 2, f);
-                if (nr == 2) {
-                    uint16_t ch2 = le ? (uint16_t)(nb[0] | (nb[1] << 8)) : (uint16_t)(nb[1] | (nb[0] << 8));
-                    if (ch2 != '\n') fseek(f, pos, SEEK_SET);
-                }
-            }
-            break;
-        }
-        if (idx + 1 < out_sz) out[idx++] = (ch < 0x80) ? (char)ch : '?';
+// Make entry idx the one playing: seek to it in the open CUE file or open its
+// file. Returns false with the reason on screen when it cannot play.
+static bool start_track(int idx) {
+    bool same_file = in_open_file(idx);
+    current_idx = idx;
+    const char *p = playlist_get(&playlist, current_idx);
+
+    if (same_file) {
+        // Another track of the open CUE file: jump there in the same decoder
+        set_track_span(current_idx);
+        audio_seek(track_start);
+        return true;
     }
-    out[idx] = '\0';
-    return 1;
-}
-
-static size_t detect_m3u_encoding(FILE *f, bool *utf16_le, bool *utf16_be) {
-    unsigned char buf[64];
-    size_t n = fread(buf, 1, sizeof(buf), f);
-    size_t skip = 0;
-    *utf16_le = false;
-    *utf16_be = false;
-
-    if (n >= 2 && buf[0] == 0xFF && buf[1] == 0xFE) {
-        *utf16_le = true;
-        skip = 2;
-    } else if (n >= 2 && buf[0] == 0xFE && buf[1] == 0xFF) {
-        *utf16_be = true;
-        skip = 2;
-    } else if (n >= 3 && buf[0] == 0xEF && buf[1] == 0xBB && buf[2] == 0xBF) {
-        skip = 3; // UTF-8 BOM
-    } else if (n >= 4) {
-        size_t even_zero = 0;
-        size_t odd_zero = 0;
-        for (size_t i = 0; i + 1 < n; i += 2) {
-            if (buf[i] == 0) even_zero++;
-            if (buf[i + 1] == 0) odd_zero++;
-        }
-        if (odd_zero > even_zero * 2 && odd_zero >= 4) *utf16_le = true;
-        else if (even_zero > odd_zero * 2 && even_zero >= 4) *utf16_be = true;
+
+    // Open audio
+    track_start = track_end = 0;
+    if (!audio_open_track(p)) {
+        snprintf(display_str, sizeof(display_str), "ERROR LOADING: %.230s", p);
+        update_position();
+        return false;
     }
 
-    fseek(f, (long)skip, SEEK_SET);
-    return skip;
+    // Check channel limit
+    update_position();
+    if (play.channels > MAX_CHANNELS) {
+        audio_close();
+        snprintf(display_str, sizeof(display_str), "UNSUPPORTED CHANNELS: %d", play.channels);
+        update_position();
+        return false;
+    }
+    set_track_span(current_idx);
+    if (track_start > 0) audio_seek(track_start);
+    return true;
 }
 
-static int read_m3u_line(FILE *f, char *out, size_t out_sz, bool utf16_le, bool utf16_be) {
-    if (!utf16_le && !utf16_be) return fgets(out, (int)out_sz, f) != NULL;
-    return read_utf16_line(f, out, out_sz, utf16_le);
+// Play entry idx, or when it cannot play the next one in direction dir that
+// can. Entries the check worker found bad are passed over without opening
+// them; after OPEN_ATTEMPTS failed opens playback stops on the last error.
+#define OPEN_ATTEMPTS 3
+static void open_track(int idx, int dir) {
+    if (playlist.count == 0) return;
+
+    update_position();
+    scrub_active = false;
+    int failures = 0;
+    for (int tries = 0; tries < playlist.count && failures < OPEN_ATTEMPTS; tries++, idx += dir) {
+        idx = (idx % playlist.count + playlist.count) % playlist.count;
+        const char *p = playlist_get(&playlist, idx);
+        if (plcheck_bad(p)) continue;
+        if (!start_track(idx)) {
+            plcheck_mark_bad(p);
+            failures++;
+            continue;
+        }
+
+        // Load metadata and album art
+        load_track_metadata(current_idx);
+        scroll_x = cfg.responsive ? (layout.content_x + layout.content_w) : FB_WIDTH;
+
+        queue_next_track();
+        return;
+    }
+    if (failures == 0) snprintf(display_str, sizeof(display_str), "NO PLAYABLE TRACKS");
 }
 
-static int is_absolute_path(const char *p) {
-    if (!p || !p[0]) return 0;
-    if (p[0] == '/' || p[0] == '\\') return 1;
-    if (((p[0] >= 'A' && p[0] <= 'Z') || (p[0] >= 'a' && p[0] <= 'z')) && p[1] == ':')
-        return 1;
-    return 0;
+// Move the scrub target for this frame's LEFT/RIGHT state (dir 0 = released)
+static void update_scrub(int dir) {
+    if (dir != 0 && (!scrub_active || dir != scrub_dir)) {
+        // New press: jump by a fixed step from where playback is
+        scrub_active = true;
+        scrub_dir = dir;
+        scrub_held = 0;
+        scrub_target = play.frame;
+        scrub_seeked = play.frame;
+    }
+
+    if (!scrub_active) return;
+
+    if (dir == 0) {
+        // Released: land on the target
+        if (play.playing && scrub_target != scrub_seeked) seek_track(scrub_target);
+        scrub_active = false;
+        return;
+    }
+
+    uint64_t step;
+    if (scrub_held == 0) {
+        step = (uint64_t)play.rate * SCRUB_TAP_SECONDS;
+    } else {
+        uint64_t speed = (uint64_t)SCRUB_BASE_SPEED * (1 + (uint64_t)scrub_held / 60);
+        if (speed > SCRUB_MAX_SPEED) speed = SCRUB_MAX_SPEED;
+        step = (uint64_t)play.rate * speed / 60;
+    }
+
+    if (dir > 0) {
+        scrub_target += step;
+        if (play.total > 0 && scrub_target >= play.total) scrub_target = play.total - 1;
+    } else {
+        scrub_target = (scrub_target < step) ? 0 : scrub_target - step;
+    }
+
+    if (scrub_held % SCRUB_SEEK_INTERVAL == 0 && scrub_target != scrub_seeked) {
+        seek_track(scrub_target);
+        scrub_seeked = scrub_target;
+    }
+    scrub_held++;
+    ff_rw_icon_timer = 15;
+    ff_rw_dir = dir;
 }
 
-static void open_track(int idx) {
-    if (track_count == 0) return;
+// Position shown by the progress bar and clock
+static uint64_t display_frame(void) {
+    return scrub_active ? scrub_target : play.frame;
+}
 
-    current_idx = (idx + track_count) % track_count;
-    const char *p = tracks[current_idx];
+// Playback crossed into the queued track (or the next CUE track of the same
+// file) without reopening anything
+static void advance_to_next_track(void) {
+    if (next_idx < 0 || next_idx >= playlist.count) return;
+    current_idx = next_idx;
+    scrub_active = false;
+    update_position();
+    set_track_span(current_idx);
+    load_track_metadata(current_idx);
+    scroll_x = cfg.responsive ? (layout.content_x + layout.content_w) : FB_WIDTH;
+    queue_next_track();
+}
 
-    // Open audio
-    if (!audio_open_track(p)) {
-        snprintf(display_str, sizeof(display_str), "ERROR LOADING: %.230s", p);
+// While a folder scan runs, add what it finds. Once it is done, switch to the
+// full list in natural order, keeping the current and queued tracks.
+static void poll_folder_scan(void) {
+    if (!dirscan_active()) return;
+
+    Playlist sorted;
+    playlist_init(&sorted);
+    if (!dirscan_take_sorted(&sorted)) {
+        // A lone track queues itself; requeue once there is something else
+        if (dirscan_poll(&playlist, scan_seed[0] ? scan_seed : NULL) > 0 && next_idx == current_idx)
+            queue_next_track();
         return;
     }
 
-    // Check channel limit
-    if (source_channels > MAX_CHANNELS) {
-        audio_close();
-        snprintf(display_str, sizeof(display_str), "UNSUPPORTED CHANNELS: %d", source_channels);
+    // The current track is normally in the scan; keep it if its path was spelled differently
+    const char *cur = playlist_get(&playlist, current_idx);
+    int cur_idx = cur ? playlist_find(&sorted, cur) : -1;
+    if (cur && cur_idx < 0 && playlist_add(&sorted, cur)) cur_idx = sorted.count - 1;
+    if (cur_idx < 0) {
+        playlist_free(&sorted);
         return;
     }
 
-    // Load metadata and album art
-    metadata_load(p, m3u_base_path, cfg.track_text_mode);
-    scroll_x = cfg.responsive ? (layout.content_x + layout.content_w) : FB_WIDTH;
+    prescan_stop();
+    char queued[1024] = {0};
+    bool requeue = next_idx < 0 || next_idx == current_idx;
+    if (!requeue) snprintf(queued, sizeof(queued), "%s", playlist_get(&playlist, next_idx));
+    playlist_free(&playlist);
+    playlist = sorted;
+    current_idx = cur_idx;
+    next_idx = requeue ? -1 : playlist_find(&playlist, queued);
+    prescan_start(&playlist);
+    if (next_idx < 0 || next_idx == current_idx) queue_next_track();
+    else prescan_focus(next_idx);
 }
 
 static void refresh_config_and_layout(void) {
     TrackTextMode old_track_text_mode = cfg.track_text_mode;
     config_update(environ_cb);
+    audio_set_resample_quality(cfg.resample_quality);
+    audio_set_native_rate(cfg.native_rate);
+    artcache_set_budget((size_t)cfg.art_cache_mb * 1024 * 1024);
     if (cfg.responsive)
         layout_compute();
 
     if (old_track_text_mode != cfg.track_text_mode &&
-        track_count > 0 &&
-        current_idx >= 0 &&
-        current_idx < track_count &&
-        tracks[current_idx]) {
-        metadata_refresh_display(tracks[current_idx], cfg.track_text_mode);
+        playlist_get(&playlist, current_idx)) {
+        PlaylistInfo info;
+        metadata_refresh_display(playlist_get(&playlist, current_idx), cfg.track_text_mode,
+                                 entry_info(current_idx, &info));
         scroll_x = cfg.responsive ? (layout.content_x + layout.content_w) : FB_WIDTH;
     }
 }
 
+// Album art scaled to the size it is drawn at, redone when the art or that size changes
+static struct {
+    uint16_t *pixels;
+    size_t cap;             // pixels allocated, kept across sizes
+    int w, h;
+    uint32_t serial;
+} art_view;
+
+static void free_art_view(void) {
+    free(art_view.pixels);
+    memset(&art_view, 0, sizeof(art_view));
+}
+
+static const uint16_t *art_at_size(int w, int h) {
+    if (!art_buffer || w <= 0 || h <= 0) return NULL;
+    if (art_view.pixels && art_view.serial == art_serial && art_view.w == w && art_view.h == h)
+        return art_view.pixels;
+
+    size_t count = (size_t)w * h;
+    if (count > art_view.cap) {
+        free_art_view();
+        art_view.pixels = malloc(count * sizeof(uint16_t));
+        if (!art_view.pixels) return NULL;
+        art_view.cap = count;
+    }
+    // Straight from the decoded colors, so the art is filtered and reduced to RGB565 once
+    video_scale_rgb888(art_buffer, art_w_src, art_h_src, art_view.pixels, w, h);
+    art_view.w = w;
+    art_view.h = h;
+    art_view.serial = art_serial;
+    return art_view.pixels;
+}
+
+// Keep the newest AUDIO_MAX_RUN_FRAMES frames the callback produced (viz_lock held)
+static void viz_recent_push(const int16_t *buf, int frames) {
+    if (frames >= AUDIO_MAX_RUN_FRAMES) {
+        memcpy(viz_recent, buf + (frames - AUDIO_MAX_RUN_FRAMES) * 2, sizeof(viz_recent));
+        viz_recent_frames = AUDIO_MAX_RUN_FRAMES;
+        return;
+    }
+    int keep = viz_recent_frames;
+    if (keep > AUDIO_MAX_RUN_FRAMES - frames) keep = AUDIO_MAX_RUN_FRAMES - frames;
+    memmove(viz_recent, viz_recent + (viz_recent_frames - keep) * 2, (size_t)keep * 2 * sizeof(int16_t));
+    memcpy(viz_recent + keep * 2, buf, (size_t)frames * 2 * sizeof(int16_t));
+    viz_recent_frames = keep + frames;
+}
+
+// Copy up to frames of the newest callback output, returns the count
+static int viz_recent_take(int16_t *out, int frames) {
+    mutex_lock(viz_lock);
+    int n = (frames < viz_recent_frames) ? frames : viz_recent_frames;
+    memcpy(out, viz_recent + (viz_recent_frames - n) * 2, (size_t)n * 2 * sizeof(int16_t));
+    mutex_unlock(viz_lock);
+    return n;
+}
+
+// Frontend audio thread: produce one chunk. Only reads while the frontend runs
+// at the track's rate; retro_run renegotiates and opens the next track.
+static void audio_callback(void) {
+    static int16_t buf[AUDIO_MAX_RUN_FRAMES * 2];
+    uint32_t rate = atomic_load(&av_sample_rate);
+    int frames = (int)(rate * AUDIO_CALLBACK_MS / 1000);
+    if (frames > AUDIO_MAX_RUN_FRAMES) frames = AUDIO_MAX_RUN_FRAMES;
+
+    AudioPosition pos;
+    audio_get_position(&pos);
+    int produced = 0;
+    if (pos.playing && pos.out_rate == rate && !is_paused)
+        produced = audio_read_frame(buf, frames);
+
+    if (produced == 0) {
+        memset(buf, 0, (size_t)frames * 2 * sizeof(int16_t));
+        produced = frames;
+    }
+    mutex_lock(viz_lock);
+    viz_recent_push(buf, produced);
+    mutex_unlock(viz_lock);
+    audio_batch_cb(buf, (size_t)produced);
+}
+
+static void audio_set_state(bool enabled) {
+    atomic_store(&audio_async_enabled, enabled);
+}
+
+// Real time since the last run (the reference while fast-forwarding or paused).
+// Hitches are capped so one slow frame does not dump a burst into the buffer.
+static void frame_time_callback(retro_usec_t usec) {
+    if (usec <= 0) usec = 1000000 / CORE_FPS;
+    if (usec > FRAME_TIME_MAX_USEC) usec = FRAME_TIME_MAX_USEC;
+    frame_usec = usec;
+}
+
 // External declaration for viz_set_audio_for_vu
 void viz_set_audio_for_vu(const int16_t *audio_buf, int samples_per_frame);
 
@@ -282,65 +555,109 @@ void retro_run(void) {
             refresh_config_and_layout();
     }
     input_poll_cb();
+    update_position();
+    bool async = audio_async && atomic_load(&audio_async_enabled);
+
+    poll_folder_scan();
+
+    // The check worker may have found the queued track unplayable since it was queued
+    if (next_idx >= 0 && plcheck_bad(playlist_get(&playlist, next_idx))) queue_next_track();
 
     // 1. Handle Inputs
-    if (decoder && !is_paused) {
-        int seek_speed = source_rate * 3;
-        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT)) {
-            uint64_t next = cur_frame + (uint64_t)seek_speed;
-            if (next < cur_frame) next = cur_frame; // overflow guard
-            if (total_frames > 0 && next >= total_frames) next = total_frames - 1;
-            audio_seek(next);
-            ff_rw_icon_timer = 15; ff_rw_dir = 1;
-        } else if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT)) {
-            uint64_t next = (cur_frame < (uint64_t)seek_speed) ? 0 : cur_frame - (uint64_t)seek_speed;
-            audio_seek(next);
-            ff_rw_icon_timer = 15; ff_rw_dir = -1;
-        }
+    if (play.playing && !is_paused) {
+        int dir = 0;
+        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT)) dir = 1;
+        else if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT)) dir = -1;
+        update_scrub(dir);
+    } else {
+        update_scrub(0);
     }
 
     if (debounce > 0) debounce--;
     else {
-        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y)) { is_shuffle = !is_shuffle; debounce = 20; }
-        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_B)) { is_paused = !is_paused; debounce = 20; }
+        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_Y)) { is_shuffle = !is_shuffle; queue_next_track(); debounce = 20; }
+        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_B)) { is_paused = !is_paused; audio_set_paused(is_paused); debounce = 20; }
         if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_X)) {
             cfg.viz_mode = next_viz_mode(cfg.viz_mode);
             if (cfg.responsive) layout_compute();
             debounce = 20;
         }
-        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R)) { open_track(is_shuffle && track_count > 0 ? rand()%track_count : current_idx + 1); debounce = 20; }
-        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L)) { open_track(current_idx - 1); debounce = 20; }
+        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R)) { open_track(next_idx >= 0 ? next_idx : pick_next_idx(), 1); debounce = 20; }
+        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_L)) { open_track(current_idx - 1, -1); debounce = 20; }
     }
 
     // 2. Audio Core
-    int16_t out_buf[SAMPLES_PER_FRAME * 2] = {0};
+    update_position();
+    if (play.playing && play.out_rate != atomic_load(&av_sample_rate)) {
+        // Native-rate mode: the track's rate differs from what the frontend was told
+        struct retro_system_av_info av;
+        retro_get_system_av_info(&av);
+        if (!environ_cb(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &av)) {
+            fprintf(stderr, "[MusicCore] Frontend refused %u Hz output, disabling native rate\n", (unsigned)play.out_rate);
+            audio_set_native_rate(false);
+        }
+        audio_frame_accum = 0;
+    }
 
-    if (decoder && !is_paused) {
-        int samples = audio_read_frame(out_buf);
-        if (samples == 0) {
-            // End of track, go to next
-            open_track(is_shuffle && track_count > 0 ? rand()%track_count : current_idx + 1);
+    const uint64_t accum_unit = (uint64_t)CORE_FPS * 1000000;
+    uint64_t run_time = frame_usec > 0 ? (uint64_t)frame_usec * CORE_FPS : 1000000;
+    audio_frame_accum += (uint64_t)atomic_load(&av_sample_rate) * run_time;
+    int frames = (int)(audio_frame_accum / accum_unit);
+    audio_frame_accum -= (uint64_t)frames * accum_unit;
+    if (frames > AUDIO_MAX_RUN_FRAMES) frames = AUDIO_MAX_RUN_FRAMES;
+
+    int16_t out_buf[AUDIO_MAX_RUN_FRAMES * 2] = {0};
+    int samples = 0;
+
+    if (play.playing && !is_paused) {
+        bool ended;
+        if (async) {
+            // The callback already played this audio, only show it
+            samples = viz_recent_take(out_buf, frames);
+            ended = play.ended;
+        } else {
+            samples = audio_read_frame(out_buf, frames);
+            ended = samples == 0;
+        }
+
+        if (audio_take_track_advance()) {
+            advance_to_next_track();
+        } else if (ended) {
+            // End of track without a gapless switch, go to next
+            open_track(next_idx >= 0 ? next_idx : pick_next_idx(), 1);
+        } else if (track_end > 0 && file_frame >= track_end) {
+            // Into the next CUE track: it plays on when it follows in this file
+            if (next_idx >= 0 && follows_in_file(next_idx)) advance_to_next_track();
+            else open_track(next_idx >= 0 ? next_idx : pick_next_idx(), 1);
+        }
+
+        // Load the upcoming track's art once its decoder is open and has read the tags
+        if (!next_meta_prefetched && next_idx >= 0) {
+            const char *next_path = playlist_get(&playlist, next_idx);
+            TrackTags *tags = audio_take_tags(next_path);
+            // A CUE track of the open file is never opened, so no tags come for it
+            if (tags || in_open_file(next_idx)) {
+                PlaylistInfo info;
+                metadata_prefetch(next_path, m3u_base_path, cfg.track_text_mode, tags, entry_info(next_idx, &info));
+                next_meta_prefetched = true;
+            }
         }
     }
 
     // 3. Visualizer & Audio Batch
-    viz_update_levels(out_buf, SAMPLES_PER_FRAME);
-    viz_set_audio_for_vu(out_buf, SAMPLES_PER_FRAME);
-    audio_batch_cb(out_buf, SAMPLES_PER_FRAME);
+    int batch = (samples > 0) ? samples : frames;
+    viz_update_levels(out_buf, batch);
+    viz_set_audio_for_vu(out_buf, batch);
+    if (!async) audio_batch_cb(out_buf, (size_t)batch);
+
+    update_position();
 
     // 4. Rendering Section
     video_clear(cfg.bg_rgb);
 
     if (cfg.responsive) {
-        if (cfg.show_art && art_buffer && layout.art.w > 0 && layout.art.h > 0) {
-            for (int y = 0; y < layout.art.h; y++) {
-                int src_y = y * art_h_src / layout.art.h;
-                for (int x = 0; x < layout.art.w; x++) {
-                    int src_x = x * art_w_src / layout.art.w;
-                    draw_pixel(layout.art.x + x, layout.art.y + y, art_buffer[src_y * art_w_src + src_x]);
-                }
-            }
-        }
+        const uint16_t *art = cfg.show_art ? art_at_size(layout.art.w, layout.art.h) : NULL;
+        if (art) video_blit(layout.art.x, layout.art.y, art, layout.art.w, layout.art.h);
 
         if (cfg.show_txt && layout.text.w > 0) {
             int right_edge = layout.text.x + layout.text.w;
@@ -356,14 +673,14 @@ void retro_run(void) {
             viz_draw();
         }
 
-        if (cfg.show_bar && total_frames > 0 && layout.bar.w > 0) {
-            float p = (float)cur_frame / total_frames;
+        if (cfg.show_bar && play.total > 0 && layout.bar.w > 0) {
+            float p = (float)display_frame() / play.total;
             for (int w = 0; w < layout.bar.w; w++) draw_pixel(layout.bar.x + w, layout.bar.y, cfg.bg_rgb | 0x18C3);
             for (int w = 0; w < (int)(p * layout.bar.w); w++) draw_pixel(layout.bar.x + w, layout.bar.y, cfg.fg_rgb);
         }
 
         if (cfg.show_tim && layout.time.w > 0) {
-            int sec = source_rate ? (int)(cur_frame / source_rate) : 0;
+            int sec = play.rate ? (int)(display_frame() / play.rate) : 0;
             sprintf(time_str, "%02d:%02d", sec / 60, sec % 60);
             int time_x = layout.time.x + (layout.time.w - ((int)strlen(time_str) * 8)) / 2;
             draw_text(time_x, layout.time.y, time_str, cfg.fg_rgb);
@@ -390,13 +707,8 @@ void retro_run(void) {
             draw_rect_outline(layout.time.x, layout.time.y, layout.time.w, layout.time.h, 0x001F);
         }
     } else {
-        if (cfg.show_art && art_buffer) {
-            for (int y = 0; y < 80; y++) {
-                for (int x = 0; x < 80; x++) {
-                    draw_pixel(120 + x, cfg.art_y + y, art_buffer[(y * art_h_src / 80) * art_w_src + (x * art_w_src / 80)]);
-                }
-            }
-        }
+        const uint16_t *art = cfg.show_art ? art_at_size(80, 80) : NULL;
+        if (art) video_blit(120, cfg.art_y, art, 80, 80);
         if (cfg.show_txt) {
             draw_text(scroll_x, cfg.txt_y, display_str, cfg.fg_rgb);
             scroll_x--;
@@ -405,13 +717,13 @@ void retro_run(void) {
         if (cfg.show_viz) {
             viz_draw();
         }
-        if (cfg.show_bar && total_frames > 0) {
-            float p = (float)cur_frame / (float)total_frames;
+        if (cfg.show_bar && play.total > 0) {
+            float p = (float)display_frame() / (float)play.total;
             for (int w = 0; w < 200; w++) draw_pixel(60 + w, cfg.bar_y, cfg.bg_rgb | 0x18C3);
             for (int w = 0; w < (int)(p * 200); w++) draw_pixel(60 + w, cfg.bar_y, cfg.fg_rgb);
         }
         if (cfg.show_tim) {
-            int sec = source_rate ? (int)(cur_frame / source_rate) : 0;
+            int sec = play.rate ? (int)(display_frame() / play.rate) : 0;
             sprintf(time_str, "%02d:%02d", sec / 60, sec % 60);
             draw_text(140, cfg.tim_y, time_str, cfg.fg_rgb);
         }
@@ -432,131 +744,137 @@ void retro_set_environment(retro_environment_t cb) {
     config_declare_variables(cb);
     enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_RGB565;
     cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt);
+
+    // Files that cannot be memory-mapped are read through the frontend's VFS
+    struct retro_vfs_interface_info vfs_info = { 1, NULL };
+    if (cb(RETRO_ENVIRONMENT_GET_VFS_INTERFACE, &vfs_info)) fileio_set_vfs(vfs_info.iface);
+    else fileio_set_vfs(NULL);
 }
 
 bool retro_load_game(const struct retro_game_info *g) {
     if (!g || !g->path) return false;
 
     // Free existing tracks before loading new ones
-    for (int i = 0; i < track_count; i++) {
-        if (tracks[i]) {
-            free(tracks[i]);
-            tracks[i] = NULL;
-        }
-    }
-    track_count = 0;
+    audio_close();
+    metadata_cancel_prefetch();
+    dirscan_stop();
+    plindex_close();
+    plcheck_stop();
+    prescan_stop();
+    artdir_clear();
+    next_idx = -1;
+    playlist_free(&playlist);
     m3u_base_path[0] = '\0';
-    char m3u_dir[1024] = {0};
+    scan_seed[0] = '\0';
+    track_start = track_end = 0;
+    config_update(environ_cb);
+
+    const char *save_dir = NULL;
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY, &save_dir) || !save_dir || !save_dir[0])
+        save_dir = NULL;
+    seekindex_set_cache_dir(save_dir);
 
     // Check for M3U extension
     const char* ext = strrchr(g->path, '.');
     if (ext && strcasecmp_simple(ext, ".m3u") == 0) {
         fprintf(stderr, "[MusicCore] Attempting to open M3U: %s\n", g->path);
 
-        FILE *f = fopen(g->path, "rb");
-        if (!f) {
-            fprintf(stderr, "[MusicCore] Failed to open M3U at %s\n", g->path);
-            return false;
+        // A current index skips parsing the playlist altogether
+        if (!plindex_load(&playlist, g->path, save_dir)) {
+            if (!m3u_load(&playlist, g->path)) {
+                fprintf(stderr, "[MusicCore] Failed to open M3U at %s\n", g->path);
+                return false;
+            }
+            plindex_begin(&playlist, g->path, save_dir);
         }
-        bool m3u_utf16_le = false;
-        bool m3u_utf16_be = false;
-        detect_m3u_encoding(f, &m3u_utf16_le, &m3u_utf16_be);
-        strncpy(m3u_base_path, g->path, 1023);
+        strncpy(m3u_base_path, g->path, sizeof(m3u_base_path) - 1);
         m3u_base_path[sizeof(m3u_base_path) - 1] = '\0';
-        const char* last = strrchr(g->path, '/');
-        if (!last) last = strrchr(g->path, '\\');
-        if (last) {
-            size_t dir_len = (size_t)(last - g->path);
-            if (dir_len >= sizeof(m3u_dir)) dir_len = sizeof(m3u_dir) - 1;
-            memcpy(m3u_dir, g->path, dir_len);
-            m3u_dir[dir_len] = '\0';
-        } else {
-            strncpy(m3u_dir, ".", sizeof(m3u_dir) - 1);
-            m3u_dir[sizeof(m3u_dir) - 1] = '\0';
-        }
-        char line[1024];
-        while (read_m3u_line(f, line, sizeof(line), m3u_utf16_le, m3u_utf16_be) && track_count < 256) {
-            // Clean the line aggressively
-            line[strcspn(line, "\r\n")] = 0;
-
-            // Trim leading/trailing spaces
-            char* trimmed = line;
-            while (*trimmed == ' ' || *trimmed == '\t') trimmed++;
-            size_t tlen = strlen(trimmed);
-            if (tlen == 0) continue;
-            char* end = trimmed + tlen - 1;
-            while (end >= trimmed && (*end == ' ' || *end == '\t' || *end == '\r')) {
-                *end = '\0';
-                end--;
-            }
-
-            // Strip UTF-8 BOM if present (common in M3U files)
-            if ((unsigned char)trimmed[0] == 0xEF && (unsigned char)trimmed[1] == 0xBB && (unsigned char)trimmed[2] == 0xBF)
-                trimmed += 3;
-
-            // Strip surrounding quotes
-            tlen = strlen(trimmed);
-            if (tlen >= 2 && ((trimmed[0] == '"' && trimmed[tlen - 1] == '"') || (trimmed[0] == '\'' && trimmed[tlen - 1] == '\''))) {
-                trimmed[tlen - 1] = '\0';
-                trimmed++;
-            }
-
-            if (trimmed[0] == '\0' || trimmed[0] == '#') continue;
-
-            // Handle file:// URIs
-            bool file_is_unc = false;
-            if (strncasecmp_simple(trimmed, "file://", 7) == 0) {
-                trimmed = file_uri_path_start(trimmed + 7, &file_is_unc);
-                percent_decode_inplace(trimmed);
-            }
-
-            // Fix backslashes for standard C file handling
-            for (int i = 0; trimmed[i]; i++) {
-                if (trimmed[i] == '\\') trimmed[i] = '/';
-            }
-            char resolved[1024];
-            int written = 0;
-            if (is_absolute_path(trimmed) || file_is_unc || !m3u_dir[0]) {
-                if (file_is_unc)
-                    written = snprintf(resolved, sizeof(resolved), "//%s", trimmed);
-                else
-                    written = snprintf(resolved, sizeof(resolved), "%s", trimmed);
-            } else {
-                written = snprintf(resolved, sizeof(resolved), "%s/%s", m3u_dir, trimmed);
-            }
-            if (written <= 0 || written >= (int)sizeof(resolved)) continue;
-            for (int i = 0; resolved[i]; i++) {
-                if (resolved[i] == '\\') resolved[i] = '/';
-            }
-            tracks[track_count++] = strdup(resolved);
+    } else if (ext && strcasecmp_simple(ext, ".cue") == 0) {
+        // Each track of the sheet plays its part of the album file
+        if (!cue_load(&playlist, g->path)) {
+            fprintf(stderr, "[MusicCore] Failed to open CUE at %s\n", g->path);
+            return false;
         }
-        fclose(f);
+        strncpy(m3u_base_path, g->path, sizeof(m3u_base_path) - 1);
+        m3u_base_path[sizeof(m3u_base_path) - 1] = '\0';
+    } else if (dirscan_is_dir(g->path)) {
+        // A folder plays everything under it; start once the first track turns up
+        fprintf(stderr, "[MusicCore] Scanning folder: %s\n", g->path);
+        if (!dirscan_start(g->path, AUDIO_EXTENSIONS, true)) return false;
+        dirscan_wait_first();
+        dirscan_poll(&playlist, NULL);
     } else {
         // Single track logic
-        tracks[track_count++] = strdup(g->path);
+        snprintf(scan_seed, sizeof(scan_seed), "%s", g->path);
+        for (char *c = scan_seed; *c; c++) {
+            if (*c == '\\') *c = '/';
+        }
+        playlist_add(&playlist, scan_seed);
+
+        // The rest of its folder follows from a background scan
+        char *slash = strrchr(scan_seed, '/');
+        char dir[1024];
+        snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - scan_seed) : 1, slash ? scan_seed : ".");
+        if (slash == scan_seed) strcpy(dir, "/");
+        if (!cfg.play_folder || !dirscan_start(dir, AUDIO_EXTENSIONS, false)) scan_seed[0] = '\0';
     }
 
-    if (track_count == 0) return false;
+    if (playlist.count == 0) {
+        dirscan_stop();
+        plindex_close();
+        return false;
+    }
 
-    config_update(environ_cb);
+    audio_set_resample_quality(cfg.resample_quality);
+    audio_set_native_rate(cfg.native_rate);
+    artcache_set_budget((size_t)cfg.art_cache_mb * 1024 * 1024);
     if (cfg.responsive)
         layout_compute();
 
-    open_track(0);
+    // Size each run's audio batch from the real frame interval when the frontend reports it
+    struct retro_frame_time_callback frame_time = { frame_time_callback, 1000000 / CORE_FPS };
+    frame_usec = 0;
+    if (!environ_cb(RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK, &frame_time))
+        fprintf(stderr, "[MusicCore] No frame time callback, assuming %d fps\n", CORE_FPS);
+
+    // Let the frontend pull audio on its own thread when it can
+    if (cfg.async_audio && !audio_async) {
+        struct retro_audio_callback audio_cb = { audio_callback, audio_set_state };
+        audio_async = environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, &audio_cb);
+        atomic_store(&audio_async_enabled, audio_async);
+        if (audio_async) fprintf(stderr, "[MusicCore] Using the frontend audio callback\n");
+    }
+
+    plcheck_start();
+    // A folder still being scanned is prescanned once its list is complete
+    if (!dirscan_active()) prescan_start(&playlist);
+    open_track(0, 1);
     return true;
 }
 
 void retro_init(void) {
     video_init();
     audio_init();
+    viz_lock = mutex_create();
+    artdir_init();
+    artcache_init();
     srand((unsigned int)time(NULL));
 }
 
 void retro_deinit(void) {
     audio_deinit();
+    mutex_free(viz_lock);
+    viz_lock = NULL;
     video_deinit();
-    metadata_free_art();
-    for (int i = 0; i < track_count; i++) free(tracks[i]);
+    metadata_deinit();
+    free_art_view();
+    artdir_deinit();
+    artcache_deinit();
+    dirscan_stop();
+    plindex_close();
+    plcheck_stop();
+    prescan_stop();
+    playlist_free(&playlist);
 }
 
 void retro_set_video_refresh(retro_video_refresh_t cb) { video_cb = cb; }
@@ -567,12 +885,15 @@ unsigned retro_api_version(void) { return RETRO_API_VERSION; }
 void retro_get_system_info(struct retro_system_info *i) {
     i->library_name = "UltiMedia UGC";
     i->library_version = "17.0";
-    i->valid_extensions = "mp3|wav|m3u|ogg|flac";
+    i->valid_extensions = AUDIO_EXTENSIONS "|m3u|cue";
     i->need_fullpath = true;
 }
 void retro_get_system_av_info(struct retro_system_av_info *info) {
-    info->timing.fps = 60.0;
-    info->timing.sample_rate = (double)OUT_RATE;
+    AudioPosition pos;
+    audio_get_position(&pos);
+    av_sample_rate = pos.playing ? pos.out_rate : OUT_RATE;
+    info->timing.fps = (double)CORE_FPS;
+    info->timing.sample_rate = (double)av_sample_rate;
     info->geometry.base_width = FB_WIDTH;
     info->geometry.base_height = FB_HEIGHT;
     info->geometry.max_width = FB_WIDTH;
@@ -582,14 +903,17 @@ void retro_get_system_av_info(struct retro_system_av_info *info) {
 void retro_set_audio_sample(retro_audio_sample_t cb) { (void)cb; }
 void retro_unload_game(void) {
     audio_close();
+    audio_async = false;
+    atomic_store(&audio_async_enabled, false);
+    metadata_cancel_prefetch();
     metadata_free_art();
-    for (int i = 0; i < track_count; i++) {
-        if (tracks[i]) {
-            free(tracks[i]);
-            tracks[i] = NULL;
-        }
-    }
-    track_count = 0;
+    free_art_view();
+    dirscan_stop();
+    plindex_close();
+    plcheck_stop();
+    prescan_stop();
+    next_idx = -1;
+    playlist_free(&playlist);
 }
 void retro_reset(void) {}
 size_t retro_serialize_size(void) { return 0; }
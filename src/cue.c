@@ -0,0 +1,282 @@
+#include "cue.h"
+#include "fileio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define CUE_MAX_PATH 1024
+#define CUE_MAX_TEXT 256
+
+typedef struct {
+    int file;               // index into the sheet's FILE paths
+    char title[CUE_MAX_TEXT];
+    char performer[CUE_MAX_TEXT];
+    uint32_t index0, index1;
+    bool has_index0, has_index1;
+} CueTrack;
+
+typedef struct {
+    char dir[CUE_MAX_PATH];
+    char title[CUE_MAX_TEXT];
+    char performer[CUE_MAX_TEXT];
+    char (*files)[CUE_MAX_PATH];
+    int file_count;
+    CueTrack *tracks;
+    int track_count, track_cap;
+} CueSheet;
+
+static int strncasecmp_simple(const char *s1, const char *s2, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        char c1 = s1[i];
+        char c2 = s2[i];
+        if (!c1 || !c2) return c1 - c2;
+        if (c1 >= 'A' && c1 <= 'Z') c1 += 32;
+        if (c2 >= 'A' && c2 <= 'Z') c2 += 32;
+        if (c1 != c2) return c1 - c2;
+    }
+    return 0;
+}
+
+static char *trim_spaces(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char *e = s + strlen(s);
+    while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) e--;
+    *e = '\0';
+    return s;
+}
+
+// Value after the command word when the line starts with it, NULL otherwise
+static char *command_value(char *line, const char *cmd) {
+    size_t len = strlen(cmd);
+    if (strncasecmp_simple(line, cmd, len) != 0 || (line[len] != ' ' && line[len] != '\t')) return NULL;
+    return trim_spaces(line + len);
+}
+
+// A quoted string up to its closing quote, or the first word
+static char *first_token(char *s, char **rest) {
+    char *end;
+    if (*s == '"') {
+        s++;
+        end = strchr(s, '"');
+    } else {
+        end = s + strcspn(s, " \t");
+    }
+    if (end && *end) {
+        *end = '\0';
+        *rest = end + 1;
+    } else {
+        *rest = s + strlen(s);
+    }
+    return s;
+}
+
+// FILE "name" TYPE: a quoted name, or everything before the type word
+static char *file_name(char *value) {
+    if (*value == '"') {
+        char *rest;
+        return first_token(value, &rest);
+    }
+    char *type = strrchr(value, ' ');
+    if (type) {
+        *type = '\0';
+        value = trim_spaces(value);
+    }
+    return value;
+}
+
+// mm:ss:ff, minutes may pass 99
+static bool parse_msf(const char *s, uint32_t *frames) {
+    unsigned m, sec, f;
+    if (sscanf(s, "%u:%u:%u", &m, &sec, &f) != 3 || sec >= 60 || f >= CUE_FRAMES_PER_SECOND) return false;
+    if (m > 900000) return false;
+    *frames = (m * 60 + sec) * CUE_FRAMES_PER_SECOND + f;
+    return true;
+}
+
+static bool file_exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+static bool is_absolute_path(const char *p) {
+    return p[0] == '/' || p[0] == '\\' ||
+           (((p[0] >= 'A' && p[0] <= 'Z') || (p[0] >= 'a' && p[0] <= 'z')) && p[1] == ':');
+}
+
+// Resolve a FILE name against the sheet's folder. A name that is not there is
+// tried with the other audio extensions before it is taken as is.
+static void resolve_file(const CueSheet *cue, const char *name, char *out, size_t out_size) {
+    static const char *const exts[] = { ".flac", ".wav", ".mp3", ".ogg" };
+    if (is_absolute_path(name)) snprintf(out, out_size, "%s", name);
+    else snprintf(out, out_size, "%s/%s", cue->dir, name);
+    for (char *c = out; *c; c++) {
+        if (*c == '\\') *c = '/';
+    }
+    if (file_exists(out)) return;
+
+    char *dot = strrchr(out, '.');
+    char *slash = strrchr(out, '/');
+    if (!dot || (slash && dot < slash)) return;
+    size_t stem = (size_t)(dot - out);
+    char alt[CUE_MAX_PATH];
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        if (snprintf(alt, sizeof(alt), "%.*s%s", (int)stem, out, exts[i]) >= (int)sizeof(alt)) continue;
+        if (file_exists(alt)) {
+            snprintf(out, out_size, "%s", alt);
+            return;
+        }
+    }
+}
+
+static bool add_file(CueSheet *cue, const char *name) {
+    char (*files)[CUE_MAX_PATH] = realloc(cue->files, (size_t)(cue->file_count + 1) * sizeof(*files));
+    if (!files) return false;
+    cue->files = files;
+    resolve_file(cue, name, cue->files[cue->file_count], CUE_MAX_PATH);
+    cue->file_count++;
+    return true;
+}
+
+static CueTrack *add_track(CueSheet *cue) {
+    if (cue->track_count == cue->track_cap) {
+        int cap = cue->track_cap ? cue->track_cap * 2 : 32;
+        CueTrack *tracks = realloc(cue->tracks, (size_t)cap * sizeof(CueTrack));
+        if (!tracks) return NULL;
+        cue->tracks = tracks;
+        cue->track_cap = cap;
+    }
+    CueTrack *t = &cue->tracks[cue->track_count++];
+    memset(t, 0, sizeof(*t));
+    t->file = cue->file_count - 1;
+    return t;
+}
+
+// One line of the sheet; commands other than these (REM, FLAGS, ISRC, ...) are skipped
+static bool parse_line(CueSheet *cue, char *line) {
+    CueTrack *t = cue->track_count > 0 ? &cue->tracks[cue->track_count - 1] : NULL;
+    char *value, *rest;
+
+    if ((value = command_value(line, "FILE"))) {
+        return add_file(cue, file_name(value));
+    }
+    if ((value = command_value(line, "TRACK"))) {
+        first_token(value, &rest);
+        if (cue->file_count == 0 || strncasecmp_simple(trim_spaces(rest), "AUDIO", 5) != 0) return true;
+        return add_track(cue) != NULL;
+    }
+    if ((value = command_value(line, "INDEX"))) {
+        if (!t) return true;
+        unsigned number = (unsigned)atoi(first_token(value, &rest));
+        uint32_t frames;
+        if (!parse_msf(trim_spaces(rest), &frames)) return true;
+        if (number == 1 && !t->has_index1) {
+            t->index1 = frames;
+            t->has_index1 = true;
+            // INDEX 01 sits in the file the sheet named last
+            t->file = cue->file_count - 1;
+        } else if (number == 0 && !t->has_index0) {
+            t->index0 = frames;
+            t->has_index0 = true;
+        }
+        return true;
+    }
+
+    char *text = NULL;
+    bool title = false;
+    if ((value = command_value(line, "TITLE"))) {
+        text = value;
+        title = true;
+    } else if ((value = command_value(line, "PERFORMER"))) {
+        text = value;
+    }
+    if (text) {
+        text = first_token(text, &rest);
+        // Text before the first TRACK describes the whole album
+        if (t) snprintf(title ? t->title : t->performer, CUE_MAX_TEXT, "%s", text);
+        else snprintf(title ? cue->title : cue->performer, CUE_MAX_TEXT, "%s", text);
+    }
+    return true;
+}
+
+// Add every track with a start, ending where the next track of its file starts
+static int add_tracks(Playlist *pl, const CueSheet *cue) {
+    int added = 0;
+    for (int i = 0; i < cue->track_count; i++) {
+        const CueTrack *t = &cue->tracks[i];
+        if (t->file < 0 || (!t->has_index1 && !t->has_index0)) continue;
+        uint32_t start = t->has_index1 ? t->index1 : t->index0;
+
+        uint32_t end = 0;
+        for (int j = i + 1; j < cue->track_count; j++) {
+            const CueTrack *n = &cue->tracks[j];
+            if (!n->has_index1 && !n->has_index0) continue;
+            if (n->file == t->file) end = n->has_index1 ? n->index1 : n->index0;
+            break;
+        }
+        if (end != 0 && end <= start) end = 0;
+
+        PlaylistInfo info;
+        memset(&info, 0, sizeof(info));
+        info.duration = end ? (int)((end - start) / CUE_FRAMES_PER_SECOND) : 0;
+        info.artist = t->performer[0] ? t->performer : (cue->performer[0] ? cue->performer : NULL);
+        info.title = t->title[0] ? t->title : NULL;
+        info.album = cue->title[0] ? cue->title : NULL;
+        info.cue_track = true;
+        info.cue_start = start;
+        info.cue_end = end;
+        if (!playlist_add_info(pl, cue->files[t->file], &info)) break;
+        added++;
+    }
+    return added;
+}
+
+bool cue_load(Playlist *pl, const char *path) {
+    FileData file;
+    if (!file_load(&file, path)) return false;
+
+    // One writable copy, split into lines in place
+    size_t skip = (file.size >= 3 && memcmp(file.data, "\xEF\xBB\xBF", 3) == 0) ? 3 : 0;
+    size_t len = file.size - skip;
+    char *text = malloc(len + 1);
+    if (text) {
+        memcpy(text, file.data + skip, len);
+        text[len] = '\0';
+    }
+    file_unload(&file);
+    if (!text) {
+        fprintf(stderr, "[MusicCore] Out of memory reading CUE %s\n", path);
+        return false;
+    }
+
+    CueSheet cue;
+    memset(&cue, 0, sizeof(cue));
+    const char *last = strrchr(path, '/');
+    const char *last_bs = strrchr(path, '\\');
+    if (!last || (last_bs && last_bs > last)) last = last_bs;
+    if (last) {
+        snprintf(cue.dir, sizeof(cue.dir), "%.*s", (int)(last - path), path);
+        for (char *c = cue.dir; *c; c++) {
+            if (*c == '\\') *c = '/';
+        }
+        if (!cue.dir[0]) strcpy(cue.dir, "/");
+    } else {
+        strcpy(cue.dir, ".");
+    }
+
+    char *p = text;
+    while (*p) {
+        char *eol = p + strcspn(p, "\r\n");
+        char next = *eol;
+        *eol = '\0';
+        if (!parse_line(&cue, trim_spaces(p))) break;
+        p = next ? eol + 1 : eol;
+    }
+    free(text);
+
+    int added = add_tracks(pl, &cue);
+    fprintf(stderr, "[MusicCore] Read %d tracks in %d files from CUE %s\n", added, cue.file_count, path);
+    free(cue.files);
+    free(cue.tracks);
+    return added > 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+#include "playlist.h"
+
+// CUE sheet times count frames of 1/75 second
+#define CUE_FRAMES_PER_SECOND 75
+
+// Append the tracks of a CUE sheet to pl, one entry per TRACK pointing at its
+// FILE with the span between its INDEX 01 and the next track's (PlaylistInfo
+// cue_start/cue_end). TITLE and PERFORMER become the entry text, the sheet's
+// own TITLE the album. A FILE that is missing is looked for with the other
+// audio extensions (rips are often re-encoded after the sheet was written).
+// Returns false if the file cannot be read or lists no tracks.
+bool cue_load(Playlist *pl, const char *path);
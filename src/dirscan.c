@@ -0,0 +1,376 @@
+#include "dirscan.h"
+#include "thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#define DIRSCAN_WORKERS 4
+#define DIRSCAN_MAX_DEPTH 16
+#define DIRSCAN_PATH_MAX 1024
+
+typedef struct {
+    char *path;
+    int depth;
+} PendingDir;
+
+static struct {
+    Thread *workers[DIRSCAN_WORKERS];
+    Mutex *mutex;
+    Cond *cond;
+    PendingDir *dirs;       // folders waiting to be listed
+    int dir_count, dir_cap;
+    int busy;               // workers listing a folder or sorting the result
+    bool quit;
+    bool walked;            // every folder is listed and sorted holds the result
+    bool recursive;
+    char exts[64];
+    Playlist found;         // in the order folders were listed
+    int polled;
+    Playlist sorted;
+} scan;
+
+static atomic_bool scan_active;
+
+// Digit runs compare by value and '/' before anything else, so "Disc 2" comes
+// before "Disc 10" and a folder's files stay together
+static int fold_char(unsigned char c) {
+    if (c == '/') return 1;
+    if (c >= 'A' && c <= 'Z') return c + 32;
+    return c;
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int natural_compare(const char *a, const char *b) {
+    while (*a && *b) {
+        if (is_digit(*a) && is_digit(*b)) {
+            while (*a == '0') a++;
+            while (*b == '0') b++;
+            const char *da = a, *db = b;
+            while (is_digit(*a)) a++;
+            while (is_digit(*b)) b++;
+            size_t la = (size_t)(a - da), lb = (size_t)(b - db);
+            if (la != lb) return la < lb ? -1 : 1;
+            int c = memcmp(da, db, la);
+            if (c) return c;
+            continue;
+        }
+        int ca = fold_char((unsigned char)*a), cb = fold_char((unsigned char)*b);
+        if (ca != cb) return ca - cb;
+        a++;
+        b++;
+    }
+    return fold_char((unsigned char)*a) - fold_char((unsigned char)*b);
+}
+
+static int compare_paths(const void *a, const void *b) {
+    const char *pa = *(const char * const *)a;
+    const char *pb = *(const char * const *)b;
+    int c = natural_compare(pa, pb);
+    return c ? c : strcmp(pa, pb);
+}
+
+// Append the entries of src to dst in natural order
+static bool add_sorted(Playlist *dst, const Playlist *src) {
+    if (src->count == 0) return true;
+    const char **v = malloc((size_t)src->count * sizeof(*v));
+    if (!v) return false;
+    for (int i = 0; i < src->count; i++) v[i] = playlist_get(src, i);
+    qsort(v, (size_t)src->count, sizeof(*v), compare_paths);
+    bool ok = true;
+    for (int i = 0; ok && i < src->count; i++) ok = playlist_add(dst, v[i]);
+    free(v);
+    return ok;
+}
+
+static bool has_extension(const char *name, const char *exts) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || !dot[1]) return false;
+    dot++;
+    size_t len = strlen(dot);
+    for (const char *e = exts; *e;) {
+        const char *bar = strchr(e, '|');
+        size_t elen = bar ? (size_t)(bar - e) : strlen(e);
+        if (elen == len) {
+            size_t i = 0;
+            while (i < len && fold_char((unsigned char)dot[i]) == fold_char((unsigned char)e[i])) i++;
+            if (i == len) return true;
+        }
+        if (!bar) break;
+        e = bar + 1;
+    }
+    return false;
+}
+
+#ifdef _WIN32
+static wchar_t *utf8_to_wide(const char *s) {
+    int n = MultiByteToWideChar(CP_UTF8, 0, s, -1, NULL, 0);
+    if (n <= 0) return NULL;
+    wchar_t *w = malloc((size_t)n * sizeof(wchar_t));
+    if (w && MultiByteToWideChar(CP_UTF8, 0, s, -1, w, n) <= 0) {
+        free(w);
+        w = NULL;
+    }
+    return w;
+}
+
+bool dirscan_is_dir(const char *path) {
+    wchar_t *w = utf8_to_wide(path);
+    if (!w) return false;
+    DWORD attr = GetFileAttributesW(w);
+    free(w);
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+// Split one folder into files matching exts and subfolders (full paths,
+// subdirs may be NULL)
+static void list_dir(const char *dir, const char *exts, Playlist *files, Playlist *subdirs) {
+    char child[DIRSCAN_PATH_MAX];
+    snprintf(child, sizeof(child), "%s/*", dir);
+    wchar_t *pattern = utf8_to_wide(child);
+    if (!pattern) return;
+    WIN32_FIND_DATAW fd;
+    HANDLE h = FindFirstFileExW(pattern, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    free(pattern);
+    if (h == INVALID_HANDLE_VALUE) return;
+
+    do {
+        if (fd.cFileName[0] == L'.' || (fd.dwFileAttributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM)))
+            continue;
+        char name[DIRSCAN_PATH_MAX];
+        if (WideCharToMultiByte(CP_UTF8, 0, fd.cFileName, -1, name, sizeof(name), NULL, NULL) <= 0) continue;
+        int n = snprintf(child, sizeof(child), "%s/%s", dir, name);
+        if (n <= 0 || n >= (int)sizeof(child)) continue;
+
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            // Junctions can point back up the tree
+            if (subdirs && !(fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) playlist_add(subdirs, child);
+        } else if (has_extension(name, exts)) {
+            playlist_add(files, child);
+        }
+    } while (FindNextFileW(h, &fd));
+    FindClose(h);
+}
+#else
+bool dirscan_is_dir(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Split one folder into files matching exts and subfolders (full paths,
+// subdirs may be NULL)
+static void list_dir(const char *dir, const char *exts, Playlist *files, Playlist *subdirs) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+
+    char child[DIRSCAN_PATH_MAX];
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        // ".", "..", hidden entries and macOS "._" resource files
+        if (e->d_name[0] == '.') continue;
+        // Without subfolders wanted, other files need no stat
+        bool wanted = has_extension(e->d_name, exts);
+        if (!subdirs && !wanted) continue;
+        int n = snprintf(child, sizeof(child), "%s/%s", dir, e->d_name);
+        if (n <= 0 || n >= (int)sizeof(child)) continue;
+
+        bool is_dir = false, is_file = false;
+#ifdef DT_DIR
+        if (e->d_type == DT_DIR) is_dir = true;
+        else if (e->d_type == DT_REG) is_file = true;
+        else if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+#endif
+        {
+            // Follow links to files but not to folders, which could loop
+            struct stat st;
+            if (lstat(child, &st) == 0) {
+                if (S_ISDIR(st.st_mode)) is_dir = true;
+                else if (S_ISREG(st.st_mode)) is_file = true;
+                else if (S_ISLNK(st.st_mode) && stat(child, &st) == 0 && S_ISREG(st.st_mode)) is_file = true;
+            }
+        }
+
+        if (is_dir && subdirs) playlist_add(subdirs, child);
+        else if (is_file && wanted) playlist_add(files, child);
+    }
+    closedir(d);
+}
+#endif
+
+void dirscan_list(const char *dir, const char *exts, Playlist *files) {
+    list_dir(dir, exts, files, NULL);
+}
+
+// List a folder and merge it into the scan (mutex held on return)
+static void scan_dir(const char *dir, int depth) {
+    Playlist files, subdirs;
+    playlist_init(&files);
+    playlist_init(&subdirs);
+    list_dir(dir, scan.exts, &files, &subdirs);
+
+    mutex_lock(scan.mutex);
+    add_sorted(&scan.found, &files);
+    if (scan.recursive && depth < DIRSCAN_MAX_DEPTH) {
+        for (int i = 0; i < subdirs.count; i++) {
+            if (scan.dir_count == scan.dir_cap) {
+                int cap = scan.dir_cap ? scan.dir_cap * 2 : 64;
+                PendingDir *dirs = realloc(scan.dirs, (size_t)cap * sizeof(PendingDir));
+                if (!dirs) break;
+                scan.dirs = dirs;
+                scan.dir_cap = cap;
+            }
+            char *path = strdup(playlist_get(&subdirs, i));
+            if (!path) break;
+            scan.dirs[scan.dir_count].path = path;
+            scan.dirs[scan.dir_count].depth = depth + 1;
+            scan.dir_count++;
+        }
+    }
+    playlist_free(&files);
+    playlist_free(&subdirs);
+}
+
+// Sort what was found once the last folder is listed (mutex held)
+static void finish_walk(void) {
+    scan.busy++;
+    mutex_unlock(scan.mutex);
+    // found no longer changes, so it can be read without the lock
+    Playlist sorted;
+    playlist_init(&sorted);
+    if (!add_sorted(&sorted, &scan.found))
+        fprintf(stderr, "[MusicCore] Out of memory sorting the folder scan\n");
+    mutex_lock(scan.mutex);
+    scan.busy--;
+    scan.sorted = sorted;
+    scan.walked = true;
+    fprintf(stderr, "[MusicCore] Folder scan found %d files\n", sorted.count);
+    cond_broadcast(scan.cond);
+}
+
+static void scan_worker(void *arg) {
+    (void)arg;
+    mutex_lock(scan.mutex);
+    while (!scan.quit && !scan.walked) {
+        if (scan.dir_count == 0) {
+            cond_wait(scan.cond, scan.mutex);
+            continue;
+        }
+        PendingDir d = scan.dirs[--scan.dir_count];
+        scan.busy++;
+        mutex_unlock(scan.mutex);
+
+        scan_dir(d.path, d.depth);
+        free(d.path);
+        scan.busy--;
+        if (scan.busy == 0 && scan.dir_count == 0 && !scan.quit) finish_walk();
+        cond_broadcast(scan.cond);
+    }
+    mutex_unlock(scan.mutex);
+}
+
+bool dirscan_start(const char *root, const char *exts, bool recursive) {
+    dirscan_stop();
+
+    char dir[DIRSCAN_PATH_MAX];
+    if (strlen(root) >= sizeof(dir) || strlen(exts) >= sizeof(scan.exts)) return false;
+    strcpy(dir, root);
+    for (char *c = dir; *c; c++) {
+        if (*c == '\\') *c = '/';
+    }
+    size_t len = strlen(dir);
+    while (len > 1 && dir[len - 1] == '/' && dir[len - 2] != ':') dir[--len] = '\0';
+
+    scan.mutex = mutex_create();
+    scan.cond = cond_create();
+    if (!scan.mutex || !scan.cond) {
+        dirscan_stop();
+        return false;
+    }
+    strcpy(scan.exts, exts);
+    scan.recursive = recursive;
+
+    // The top folder is listed here so playback can start on its first file
+    scan_dir(dir, 0);
+    int workers = 0;
+    if (scan.dir_count > 0) {
+        for (int i = 0; i < DIRSCAN_WORKERS; i++) {
+            scan.workers[i] = thread_create(scan_worker, NULL);
+            if (scan.workers[i]) workers++;
+        }
+        if (!workers) fprintf(stderr, "[MusicCore] Failed to start folder scan, only %s is used\n", dir);
+    }
+    if (!workers) finish_walk();
+    mutex_unlock(scan.mutex);
+
+    atomic_store(&scan_active, true);
+    return true;
+}
+
+void dirscan_stop(void) {
+    if (scan.mutex) {
+        mutex_lock(scan.mutex);
+        scan.quit = true;
+        cond_broadcast(scan.cond);
+        mutex_unlock(scan.mutex);
+    }
+    for (int i = 0; i < DIRSCAN_WORKERS; i++) {
+        if (scan.workers[i]) thread_join(scan.workers[i]);
+    }
+    for (int i = 0; i < scan.dir_count; i++) free(scan.dirs[i].path);
+    free(scan.dirs);
+    playlist_free(&scan.found);
+    playlist_free(&scan.sorted);
+    cond_free(scan.cond);
+    mutex_free(scan.mutex);
+    memset(&scan, 0, sizeof(scan));
+    atomic_store(&scan_active, false);
+}
+
+bool dirscan_active(void) {
+    return atomic_load_explicit(&scan_active, memory_order_acquire);
+}
+
+void dirscan_wait_first(void) {
+    if (!scan.mutex) return;
+    mutex_lock(scan.mutex);
+    while (scan.found.count == 0 && !scan.walked && !scan.quit)
+        cond_wait(scan.cond, scan.mutex);
+    mutex_unlock(scan.mutex);
+}
+
+int dirscan_poll(Playlist *pl, const char *skip) {
+    if (!dirscan_active()) return 0;
+    int added = 0;
+    mutex_lock(scan.mutex);
+    for (; scan.polled < scan.found.count; scan.polled++) {
+        const char *path = playlist_get(&scan.found, scan.polled);
+        if (skip && strcmp(path, skip) == 0) continue;
+        if (!playlist_add(pl, path)) break;
+        added++;
+    }
+    mutex_unlock(scan.mutex);
+    return added;
+}
+
+bool dirscan_take_sorted(Playlist *out) {
+    if (!dirscan_active()) return false;
+    mutex_lock(scan.mutex);
+    bool walked = scan.walked;
+    if (walked) {
+        *out = scan.sorted;
+        playlist_init(&scan.sorted);
+    }
+    mutex_unlock(scan.mutex);
+    if (walked) dirscan_stop();
+    return walked;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include "playlist.h"
+
+// True if path names a directory
+bool dirscan_is_dir(const char *path);
+
+// Add the files directly in dir whose extension is one of exts to files (full
+// paths, unsorted). Subfolders are not looked into.
+void dirscan_list(const char *dir, const char *exts, Playlist *files);
+
+// Start collecting the files under root whose extension is one of exts
+// ("mp3|wav|..."), descending into subfolders when recursive. root itself is
+// listed before returning, its files in natural order; subfolders are walked
+// by a small worker pool. Any previous scan is stopped.
+bool dirscan_start(const char *root, const char *exts, bool recursive);
+
+// Stop the workers and drop the results
+void dirscan_stop(void);
+
+// True from dirscan_start until the sorted list has been taken
+bool dirscan_active(void);
+
+// Block until at least one file has been found or the scan is over
+void dirscan_wait_first(void);
+
+// Append the files found since the last call to pl in the order they were
+// found, leaving out skip (may be NULL). Returns the number added.
+int dirscan_poll(Playlist *pl, const char *skip);
+
+// Once the walk is over, hand the complete list in natural order to *out
+// (which must be empty) and end the scan. Returns false while still walking.
+bool dirscan_take_sorted(Playlist *out);
@@ -0,0 +1,129 @@
+#include "downmix.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DOWNMIX_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DOWNMIX_NEON 1
+#endif
+
+typedef enum { CH_FL, CH_FR, CH_FC, CH_LFE, CH_BL, CH_BR, CH_SL, CH_SR, CH_BC } ChannelRole;
+
+// WAVE / FLAC channel order per channel count
+static const ChannelRole wave_layouts[DOWNMIX_MAX_CHANNELS + 1][DOWNMIX_MAX_CHANNELS] = {
+    [3] = { CH_FL, CH_FR, CH_FC },
+    [4] = { CH_FL, CH_FR, CH_BL, CH_BR },
+    [5] = { CH_FL, CH_FR, CH_FC, CH_BL, CH_BR },
+    [6] = { CH_FL, CH_FR, CH_FC, CH_LFE, CH_BL, CH_BR },
+    [7] = { CH_FL, CH_FR, CH_FC, CH_LFE, CH_BC, CH_SL, CH_SR },
+    [8] = { CH_FL, CH_FR, CH_FC, CH_LFE, CH_BL, CH_BR, CH_SL, CH_SR },
+};
+
+// Vorbis I channel order per channel count
+static const ChannelRole vorbis_layouts[DOWNMIX_MAX_CHANNELS + 1][DOWNMIX_MAX_CHANNELS] = {
+    [3] = { CH_FL, CH_FC, CH_FR },
+    [4] = { CH_FL, CH_FR, CH_BL, CH_BR },
+    [5] = { CH_FL, CH_FC, CH_FR, CH_BL, CH_BR },
+    [6] = { CH_FL, CH_FC, CH_FR, CH_BL, CH_BR, CH_LFE },
+    [7] = { CH_FL, CH_FC, CH_FR, CH_SL, CH_SR, CH_BC, CH_LFE },
+    [8] = { CH_FL, CH_FC, CH_FR, CH_SL, CH_SR, CH_BL, CH_BR, CH_LFE },
+};
+
+static void role_gains(ChannelRole role, float *l, float *r) {
+    switch (role) {
+        case CH_FL:  *l = 1.0f;   *r = 0.0f;   break;
+        case CH_FR:  *l = 0.0f;   *r = 1.0f;   break;
+        case CH_FC:  *l = 0.707f; *r = 0.707f; break;
+        case CH_LFE: *l = 0.5f;   *r = 0.5f;   break;
+        case CH_BL:
+        case CH_SL:  *l = 0.707f; *r = 0.0f;   break;
+        case CH_BR:
+        case CH_SR:  *l = 0.0f;   *r = 0.707f; break;
+        case CH_BC:  *l = 0.5f;   *r = 0.5f;   break;
+    }
+}
+
+void downmix_init(DownmixMatrix *m, int channels, bool vorbis_order) {
+    memset(m, 0, sizeof(*m));
+    if (channels < 1) channels = 1;
+    if (channels > DOWNMIX_MAX_CHANNELS) channels = DOWNMIX_MAX_CHANNELS;
+    m->channels = channels;
+
+    if (channels == 1) {
+        m->l[0] = m->r[0] = 1.0f;
+        return;
+    }
+    if (channels == 2) {
+        m->l[0] = 1.0f;
+        m->r[1] = 1.0f;
+        return;
+    }
+
+    const ChannelRole *layout = vorbis_order ? vorbis_layouts[channels] : wave_layouts[channels];
+    for (int c = 0; c < channels; c++)
+        role_gains(layout[c], &m->l[c], &m->r[c]);
+}
+
+static void downmix_block_generic(const DownmixMatrix *m, const int16_t *in, int frames, float *l, float *r) {
+    int ch = m->channels;
+#if defined(DOWNMIX_SSE2)
+    __m128 cl0 = _mm_loadu_ps(m->l), cl1 = _mm_loadu_ps(m->l + 4);
+    __m128 cr0 = _mm_loadu_ps(m->r), cr1 = _mm_loadu_ps(m->r + 4);
+    for (int i = 0; i < frames; i++, in += ch) {
+        __m128i s = _mm_loadu_si128((const __m128i*)in);
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+        __m128 al = _mm_add_ps(_mm_mul_ps(lo, cl0), _mm_mul_ps(hi, cl1));
+        __m128 ar = _mm_add_ps(_mm_mul_ps(lo, cr0), _mm_mul_ps(hi, cr1));
+        // Horizontal add of both sums at once
+        __m128 t0 = _mm_unpacklo_ps(al, ar);
+        __m128 t1 = _mm_unpackhi_ps(al, ar);
+        __m128 t = _mm_add_ps(t0, t1);
+        t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+        l[i] = _mm_cvtss_f32(t);
+        r[i] = _mm_cvtss_f32(_mm_shuffle_ps(t, t, 1));
+    }
+#elif defined(DOWNMIX_NEON)
+    float32x4_t cl0 = vld1q_f32(m->l), cl1 = vld1q_f32(m->l + 4);
+    float32x4_t cr0 = vld1q_f32(m->r), cr1 = vld1q_f32(m->r + 4);
+    for (int i = 0; i < frames; i++, in += ch) {
+        int16x8_t s = vld1q_s16(in);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+        float32x4_t al = vmlaq_f32(vmulq_f32(lo, cl0), hi, cl1);
+        float32x4_t ar = vmlaq_f32(vmulq_f32(lo, cr0), hi, cr1);
+        float32x2_t sl = vadd_f32(vget_low_f32(al), vget_high_f32(al));
+        float32x2_t sr = vadd_f32(vget_low_f32(ar), vget_high_f32(ar));
+        float32x2_t lr = vpadd_f32(sl, sr);
+        l[i] = vget_lane_f32(lr, 0);
+        r[i] = vget_lane_f32(lr, 1);
+    }
+#else
+    for (int i = 0; i < frames; i++, in += ch) {
+        float al = 0.0f, ar = 0.0f;
+        for (int c = 0; c < ch; c++) {
+            al += (float)in[c] * m->l[c];
+            ar += (float)in[c] * m->r[c];
+        }
+        l[i] = al;
+        r[i] = ar;
+    }
+#endif
+}
+
+void downmix_block(const DownmixMatrix *m, const int16_t *in, int frames, float *l, float *r) {
+    if (m->channels == 1) {
+        for (int i = 0; i < frames; i++) l[i] = r[i] = (float)in[i];
+        return;
+    }
+    if (m->channels == 2) {
+        for (int i = 0; i < frames; i++) {
+            l[i] = (float)in[i * 2];
+            r[i] = (float)in[i * 2 + 1];
+        }
+        return;
+    }
+    downmix_block_generic(m, in, frames, l, r);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DOWNMIX_MAX_CHANNELS 8
+
+// Padding (in samples) the input buffer needs past the last frame: the SIMD
+// path always loads DOWNMIX_MAX_CHANNELS samples per frame.
+#define DOWNMIX_PAD_SAMPLES DOWNMIX_MAX_CHANNELS
+
+// Channel-to-stereo fold-down coefficients for one track, in file channel order.
+// Lanes past the channel count are zero.
+typedef struct {
+    int channels;
+    float l[DOWNMIX_MAX_CHANNELS];
+    float r[DOWNMIX_MAX_CHANNELS];
+} DownmixMatrix;
+
+// Build the matrix from the channel count and the format's channel order
+// (WAV/FLAC use the WAVE order, Vorbis puts centre second and LFE last)
+void downmix_init(DownmixMatrix *m, int channels, bool vorbis_order);
+
+// Fold interleaved int16 frames down to separate float L/R
+void downmix_block(const DownmixMatrix *m, const int16_t *in, int frames, float *l, float *r);
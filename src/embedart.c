@@ -0,0 +1,447 @@
+#include "embedart.h"
+#include "fileio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EMBEDART_FIRST_READ (64 * 1024)
+#define EMBEDART_READ_MAX (16 * 1024 * 1024)    // tags larger than this are not followed
+#define PICTURE_FRONT_COVER 3
+#define PICTURE_KEY "METADATA_BLOCK_PICTURE="
+
+// Best picture found so far
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    int type;                   // -1 while there is none
+    bool unsync;                // ID3 frame data still unsynchronised
+    unsigned char *buffer;      // decoded copy data points into, if any
+} Candidate;
+
+static uint32_t be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t le32(const unsigned char *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint32_t syncsafe32(const unsigned char *p) {
+    return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) | ((uint32_t)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+// Keep the picture unless one is held already; a front cover replaces any other.
+// buffer (may be NULL) goes with the picture and is freed when it is not kept.
+static void consider(Candidate *best, const unsigned char *data, size_t size, int type, bool unsync, unsigned char *buffer) {
+    if (size == 0 || (best->type >= 0 && (best->type == PICTURE_FRONT_COVER || type != PICTURE_FRONT_COVER))) {
+        free(buffer);
+        return;
+    }
+    free(best->buffer);
+    best->data = data;
+    best->size = size;
+    best->type = type;
+    best->unsync = unsync;
+    best->buffer = buffer;
+}
+
+// Undo ID3 unsynchronisation (FF 00 -> FF) into a new buffer
+static unsigned char *undo_unsync(const unsigned char *src, size_t size, size_t *out_size) {
+    unsigned char *out = malloc(size ? size : 1);
+    if (!out) return NULL;
+    size_t n = 0;
+    for (size_t i = 0; i < size; i++) {
+        out[n++] = src[i];
+        if (src[i] == 0xFF && i + 1 < size && src[i + 1] == 0x00) i++;
+    }
+    *out_size = n;
+    return out;
+}
+
+// Turn the best picture into art. file_start is the file's first byte when
+// the buffer searched holds the file from its start; copy keeps data past it.
+static bool finish(Candidate *c, const unsigned char *file_start, bool copy, EmbeddedArt *art) {
+    memset(art, 0, sizeof(*art));
+    if (c->type < 0) return false;
+    if (c->unsync) {
+        art->owned = undo_unsync(c->data, c->size, &art->size);
+        art->data = art->owned;
+        free(c->buffer);
+    } else if (c->buffer) {
+        art->owned = c->buffer;
+        art->data = c->data;
+        art->size = c->size;
+    } else {
+        if (file_start) art->offset = (uint64_t)(c->data - file_start);
+        if (copy) {
+            art->owned = malloc(c->size);
+            if (art->owned) memcpy(art->owned, c->data, c->size);
+            art->data = art->owned;
+        } else {
+            art->data = c->data;
+        }
+        art->size = c->size;
+    }
+    c->buffer = NULL;
+    if (!art->data) {
+        embedart_free(art);
+        return false;
+    }
+    return true;
+}
+
+// APIC (v2.3/2.4) or PIC (v2.2) frame: encoding, MIME type or format, picture
+// type, description, then the image. *data_at is where the image starts.
+static bool parse_apic(const unsigned char *c, size_t n, bool v22, int *type, size_t *data_at) {
+    if (n < 5) return false;
+    unsigned encoding = c[0];
+    size_t p = 1;
+    if (v22) {
+        p += 3;
+    } else {
+        // "-->" means the image is only linked to
+        if (n >= 4 && memcmp(c + 1, "-->", 3) == 0) return false;
+        while (p < n && c[p]) p++;
+        p++;
+    }
+    if (p >= n) return false;
+    *type = c[p++];
+    // Description: ends with one NUL, or two on a character boundary in UTF-16
+    if (encoding == 1 || encoding == 2) {
+        while (p + 1 < n && (c[p] || c[p + 1])) p += 2;
+        p += 2;
+    } else {
+        while (p < n && c[p]) p++;
+        p++;
+    }
+    if (p >= n) return false;
+    *data_at = p;
+    return true;
+}
+
+// Picture frames of the ID3v2 tag at tag. An unsynchronised v2.2/2.3 tag is
+// undone into *plain first, which best then points into.
+static void scan_id3(const unsigned char *tag, size_t size, Candidate *best, unsigned char **plain) {
+    *plain = NULL;
+    if (size < 10 || memcmp(tag, "ID3", 3) != 0) return;
+    unsigned version = tag[3];
+    unsigned flags = tag[5];
+    if (version < 2 || version > 4) return;
+
+    size_t len = syncsafe32(tag + 6);
+    if (len > size - 10) len = size - 10;
+    const unsigned char *body = tag + 10;
+    if ((flags & 0x80) && version < 4) {
+        *plain = undo_unsync(body, len, &len);
+        if (!*plain) return;
+        body = *plain;
+    }
+
+    size_t pos = 0;
+    if ((flags & 0x40) && version >= 3 && len >= 4) {
+        // v2.3 counts the extended header without its size field, v2.4 with it
+        pos = version == 3 ? 4 + (size_t)be32(body) : syncsafe32(body);
+    }
+
+    size_t header = version == 2 ? 6 : 10;
+    while (pos + header <= len && body[pos] != 0) {
+        const unsigned char *h = body + pos;
+        size_t frame_size = version == 2 ? ((size_t)h[3] << 16) | ((size_t)h[4] << 8) | h[5]
+                          : version == 4 ? syncsafe32(h + 4) : be32(h + 4);
+        if (frame_size > len - pos - header) break;
+
+        bool picture = version == 2 ? memcmp(h, "PIC", 3) == 0 : memcmp(h, "APIC", 4) == 0;
+        const unsigned char *c = h + header;
+        size_t n = frame_size;
+        bool usable = picture, unsync = false;
+        if (picture && version == 4) {
+            // Compressed or encrypted frames are skipped; grouping and a data length come first
+            unsigned f = h[9];
+            if (f & 0x0C) usable = false;
+            if ((f & 0x40) && n >= 1) { c += 1; n -= 1; }
+            if ((f & 0x01) && n >= 4) { c += 4; n -= 4; }
+            unsync = (f & 0x02) || (flags & 0x80);
+        } else if (picture && version == 3) {
+            unsigned f = h[9];
+            if (f & 0xC0) usable = false;
+            if ((f & 0x20) && n >= 1) { c += 1; n -= 1; }
+        }
+
+        int type;
+        size_t data_at;
+        if (usable && parse_apic(c, n, version == 2, &type, &data_at))
+            consider(best, c + data_at, n - data_at, type, unsync, NULL);
+        pos += header + frame_size;
+    }
+}
+
+static bool id3_art(const unsigned char *tag, size_t size, const unsigned char *file_start, bool copy, EmbeddedArt *art) {
+    Candidate best = { .type = -1 };
+    unsigned char *plain;
+    scan_id3(tag, size, &best, &plain);
+    bool found = finish(&best, plain ? NULL : file_start, copy || plain, art);
+    free(plain);
+    return found;
+}
+
+// FLAC PICTURE block: type, MIME type, description, dimensions, then the image
+static bool picture_block(const unsigned char *b, size_t size, int *type, const unsigned char **data, size_t *data_size) {
+    if (size < 32) return false;
+    size_t p = 4;
+    uint32_t mime = be32(b + p);
+    p += 4;
+    if (mime > size - p || size - p - mime < 4) return false;
+    p += mime;
+    uint32_t desc = be32(b + p);
+    p += 4;
+    if (desc > size - p || size - p - desc < 20) return false;
+    p += desc + 16;
+    uint32_t len = be32(b + p);
+    p += 4;
+    if (len == 0 || len > size - p) return false;
+    *type = (int)be32(b);
+    *data = b + p;
+    *data_size = len;
+    return true;
+}
+
+static unsigned char *base64_decode(const char *s, size_t len, size_t *out_size) {
+    unsigned char *out = malloc(len / 4 * 3 + 3);
+    if (!out) return NULL;
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        int v;
+        if (c >= 'A' && c <= 'Z') v = c - 'A';
+        else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') v = c - '0' + 52;
+        else if (c == '+') v = 62;
+        else if (c == '/') v = 63;
+        else if (c == '=') break;
+        else continue;      // line breaks some taggers insert
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[n++] = (unsigned char)(acc >> bits);
+        }
+    }
+    *out_size = n;
+    return out;
+}
+
+// Decode a METADATA_BLOCK_PICTURE value into best
+static void comment_value_picture(const char *value, size_t len, Candidate *best) {
+    size_t size;
+    unsigned char *block = base64_decode(value, len, &size);
+    if (!block) return;
+    int type;
+    const unsigned char *data;
+    size_t data_size;
+    if (picture_block(block, size, &type, &data, &data_size)) consider(best, data, data_size, type, false, block);
+    else free(block);
+}
+
+static bool is_picture_comment(const char *c, size_t len) {
+    size_t key = strlen(PICTURE_KEY);
+    if (len <= key) return false;
+    for (size_t i = 0; i < key; i++) {
+        char ch = c[i];
+        if (ch >= 'a' && ch <= 'z') ch -= 32;
+        if (ch != PICTURE_KEY[i]) return false;
+    }
+    return true;
+}
+
+// Vorbis comment list (vendor, then length-prefixed "KEY=value" entries)
+static void scan_comments(const unsigned char *d, size_t size, Candidate *best) {
+    if (size < 8) return;
+    uint32_t vendor = le32(d);
+    size_t p = 4;
+    if (vendor > size - p || size - p - vendor < 4) return;
+    p += vendor;
+    uint32_t count = le32(d + p);
+    p += 4;
+    for (uint32_t i = 0; i < count && size - p >= 4; i++) {
+        uint32_t len = le32(d + p);
+        p += 4;
+        if (len > size - p) return;
+        const char *c = (const char*)d + p;
+        if (is_picture_comment(c, len))
+            comment_value_picture(c + strlen(PICTURE_KEY), len - strlen(PICTURE_KEY), best);
+        p += len;
+    }
+}
+
+bool embedart_from_id3(const unsigned char *tag, size_t size, EmbeddedArt *art) {
+    return id3_art(tag, size, tag, false, art);
+}
+
+bool embedart_from_comment(const char *value, size_t len, EmbeddedArt *art) {
+    Candidate best = { .type = -1 };
+    comment_value_picture(value, len, &best);
+    return finish(&best, NULL, false, art);
+}
+
+void embedart_free(EmbeddedArt *art) {
+    free(art->owned);
+    memset(art, 0, sizeof(*art));
+}
+
+// The head of a file, read further as the tags need
+typedef struct {
+    const char *path;
+    FileData file;
+    size_t asked;
+} Reader;
+
+// Have the file's first need bytes loaded; false past its end or the read limit
+static bool reader_need(Reader *r, uint64_t need) {
+    if (need <= r->file.size) return true;
+    if (need > EMBEDART_READ_MAX || r->file.source == FILE_SOURCE_MMAP || r->file.size < r->asked) return false;
+    size_t ask = r->asked * 2 > need ? r->asked * 2 : (size_t)need;
+    if (ask > EMBEDART_READ_MAX) ask = EMBEDART_READ_MAX;
+    file_unload(&r->file);
+    r->asked = ask;
+    return file_load_head(&r->file, r->path, ask) && need <= r->file.size;
+}
+
+// ID3v2 tag at at, no longer than max_len; cut short by the end of what can be read
+static bool read_id3_at(Reader *r, size_t at, size_t max_len, EmbeddedArt *art) {
+    if (!reader_need(r, at + 10)) return false;
+    size_t len = 10 + (size_t)syncsafe32(r->file.data + at + 6);
+    if (len > max_len) len = max_len;
+    if (!reader_need(r, at + len)) {
+        if (r->file.size < at + 10) return false;
+        len = r->file.size - at;
+    }
+    return id3_art(r->file.data + at, len, r->file.data, true, art);
+}
+
+// Metadata blocks after "fLaC" at at: PICTURE blocks and pictures in the
+// Vorbis comments. Blocks are located first and read once the walk is done,
+// as reading further may move the loaded data.
+static bool read_flac(Reader *r, size_t at, EmbeddedArt *art) {
+    size_t pic_at = 0, pic_len = 0, comments_at = 0, comments_len = 0;
+    int pic_type = -1;
+    size_t p = at + 4;
+    for (bool last = false; !last && reader_need(r, p + 4);) {
+        const unsigned char *h = r->file.data + p;
+        last = (h[0] & 0x80) != 0;
+        unsigned type = h[0] & 0x7F;
+        size_t len = ((size_t)h[1] << 16) | ((size_t)h[2] << 8) | h[3];
+        p += 4;
+        if (type == 4 && !comments_len) {
+            comments_at = p;
+            comments_len = len;
+        } else if (type == 6 && pic_type != PICTURE_FRONT_COVER && len >= 4 && reader_need(r, p + 4)) {
+            int t = (int)be32(r->file.data + p);
+            if (pic_type < 0 || t == PICTURE_FRONT_COVER) {
+                pic_at = p;
+                pic_len = len;
+                pic_type = t;
+            }
+        }
+        p += len;
+    }
+
+    Candidate best = { .type = -1 };
+    if (comments_len && reader_need(r, comments_at + comments_len))
+        scan_comments(r->file.data + comments_at, comments_len, &best);
+    const unsigned char *data;
+    size_t data_size;
+    int type;
+    if (pic_len && reader_need(r, pic_at + pic_len) &&
+        picture_block(r->file.data + pic_at, pic_len, &type, &data, &data_size))
+        consider(&best, data, data_size, type, false, NULL);
+    return finish(&best, r->file.data, true, art);
+}
+
+// Vorbis comment header: the second packet, which may span many pages
+static bool read_ogg(Reader *r, EmbeddedArt *art) {
+    unsigned char *packet = NULL;
+    size_t packet_len = 0, cap = 0;
+    int packet_no = 0;
+    bool done = false;
+    size_t p = 0;
+    while (!done && reader_need(r, p + 27)) {
+        const unsigned char *page = r->file.data + p;
+        if (memcmp(page, "OggS", 4) != 0) break;
+        unsigned segments = page[26];
+        if (!reader_need(r, p + 27 + segments)) break;
+        page = r->file.data + p;
+        size_t body = p + 27 + segments;
+        size_t body_len = 0;
+        for (unsigned i = 0; i < segments; i++) body_len += page[27 + i];
+        if (!reader_need(r, body + body_len)) break;
+        page = r->file.data + p;
+
+        size_t q = body;
+        for (unsigned i = 0; i < segments && !done; i++) {
+            unsigned lace = page[27 + i];
+            if (packet_no == 1) {
+                if (packet_len + lace > cap) {
+                    size_t grow = cap ? cap * 2 : 65536;
+                    while (grow < packet_len + lace) grow *= 2;
+                    unsigned char *n = grow <= EMBEDART_READ_MAX ? realloc(packet, grow) : NULL;
+                    if (!n) {
+                        free(packet);
+                        return false;
+                    }
+                    packet = n;
+                    cap = grow;
+                }
+                memcpy(packet + packet_len, r->file.data + q, lace);
+                packet_len += lace;
+            }
+            q += lace;
+            if (lace < 255) {
+                if (packet_no == 1) done = true;
+                packet_no++;
+            }
+        }
+        p = body + body_len;
+    }
+
+    Candidate best = { .type = -1 };
+    if (done && packet_len > 7 && memcmp(packet, "\x03vorbis", 7) == 0) scan_comments(packet + 7, packet_len - 7, &best);
+    free(packet);
+    return finish(&best, NULL, false, art);
+}
+
+// RIFF chunks: an "id3 " chunk holds an ID3v2 tag
+static bool read_wav(Reader *r, EmbeddedArt *art) {
+    for (size_t p = 12; reader_need(r, p + 8);) {
+        const unsigned char *h = r->file.data + p;
+        size_t len = le32(h + 4);
+        if (memcmp(h, "id3 ", 4) == 0 || memcmp(h, "ID3 ", 4) == 0) return read_id3_at(r, p + 8, len, art);
+        p += 8 + len + (len & 1);
+    }
+    return false;
+}
+
+bool embedart_read(const char *path, EmbeddedArt *art) {
+    memset(art, 0, sizeof(*art));
+    Reader r = { path, {0}, EMBEDART_FIRST_READ };
+    if (!file_load_head(&r.file, path, r.asked)) return false;
+
+    bool found = false;
+    const unsigned char *d = r.file.data;
+    if (r.file.size >= 4 && memcmp(d, "ID3", 3) == 0) {
+        // MP3, or a FLAC some tagger put an ID3 tag in front of
+        size_t len = 10 + (size_t)syncsafe32(d + 6) + ((d[5] & 0x10) ? 10 : 0);
+        found = read_id3_at(&r, 0, len, art);
+        if (!found && reader_need(&r, len + 4) && memcmp(r.file.data + len, "fLaC", 4) == 0)
+            found = read_flac(&r, len, art);
+    } else if (r.file.size >= 4 && memcmp(d, "fLaC", 4) == 0) {
+        found = read_flac(&r, 0, art);
+    } else if (r.file.size >= 4 && memcmp(d, "OggS", 4) == 0) {
+        found = read_ogg(&r, art);
+    } else if (r.file.size >= 12 && memcmp(d, "RIFF", 4) == 0 && memcmp(d + 8, "WAVE", 4) == 0) {
+        found = read_wav(&r, art);
+    }
+    file_unload(&r.file);
+    return found;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Cover art embedded in track files, found by walking the tag structures
+// (ID3v2 APIC/PIC frames, FLAC PICTURE blocks, Vorbis METADATA_BLOCK_PICTURE
+// comments) so that only the image itself is handed to the image decoder.
+// A front cover is preferred over other pictures.
+
+typedef struct {
+    const unsigned char *data;  // image bytes
+    size_t size;
+    uint64_t offset;            // where data starts in the file, 0 when it is not stored there as is
+    unsigned char *owned;       // buffer behind data when it was decoded or read, freed by embedart_free
+} EmbeddedArt;
+
+// Picture of an ID3v2 tag (tag[0..2] == "ID3") read from the start of the file
+bool embedart_from_id3(const unsigned char *tag, size_t size, EmbeddedArt *art);
+
+// Picture of a METADATA_BLOCK_PICTURE comment's value (base64 of a FLAC PICTURE block)
+bool embedart_from_comment(const char *value, size_t len, EmbeddedArt *art);
+
+// Read the picture embedded in a track file (MP3, FLAC, Ogg Vorbis, WAV with
+// an id3 chunk). Only the tag structures are read, however far in the image is.
+bool embedart_read(const char *path, EmbeddedArt *art);
+
+void embedart_free(EmbeddedArt *art);
@@ -0,0 +1,325 @@
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+#include "fileio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
+#endif
+
+static struct retro_vfs_interface *vfs = NULL;
+
+// stdio with 64-bit offsets: long is 32 bits on Windows, and a WAV album
+// image can be larger than 2 GB
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+#ifdef _WIN32
+// Paths are UTF-8 everywhere else; the wide API is the only way to open non-ASCII names.
+static wchar_t *utf8_to_wide(const char *s) {
+    int n = MultiByteToWideChar(CP_UTF8, 0, s, -1, NULL, 0);
+    if (n <= 0) return NULL;
+    wchar_t *w = malloc((size_t)n * sizeof(wchar_t));
+    if (w && MultiByteToWideChar(CP_UTF8, 0, s, -1, w, n) <= 0) {
+        free(w);
+        w = NULL;
+    }
+    return w;
+}
+
+// Only files on fixed disks are mapped: a view of a share or a removable
+// drive that goes away raises EXCEPTION_IN_PAGE_ERROR, where a read fails.
+static bool is_local_volume(const wchar_t *path) {
+    wchar_t root[MAX_PATH];
+    if (!GetVolumePathNameW(path, root, MAX_PATH)) return false;
+    UINT type = GetDriveTypeW(root);
+    return type == DRIVE_FIXED || type == DRIVE_RAMDISK;
+}
+
+static bool map_file(FileData *f, const char *path) {
+    wchar_t *wpath = utf8_to_wide(path);
+    if (!wpath) return false;
+    if (!is_local_volume(wpath)) {
+        free(wpath);
+        return false;
+    }
+    HANDLE file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    free(wpath);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 || (uint64_t)size.QuadPart > (uint64_t)SIZE_MAX) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    f->map_handle = mapping;
+    f->map_view = view;
+    f->map_size = (size_t)size.QuadPart;
+    return true;
+}
+
+static void unmap_file(FileData *f) {
+    UnmapViewOfFile(f->map_view);
+    CloseHandle((HANDLE)f->map_handle);
+    f->map_handle = NULL;
+}
+#else
+// Only files on local filesystems are mapped: a view of a network share that
+// drops raises SIGBUS on access, where a read fails.
+static bool is_local_fs(int fd) {
+#if defined(__linux__)
+    struct statfs sfs;
+    if (fstatfs(fd, &sfs) != 0) return false;
+    switch ((uint32_t)sfs.f_type) {
+        case 0x6969:        // NFS
+        case 0x517B:        // SMB
+        case 0xFF534D42:    // CIFS
+        case 0xFE534D42:    // SMB2
+        case 0x01021997:    // 9P
+        case 0x5346414F:    // AFS
+        case 0x00C36400:    // Ceph
+        case 0x65735546:    // FUSE (sshfs, rclone, ...)
+            return false;
+        default:
+            return true;
+    }
+#elif defined(MNT_LOCAL)
+    struct statfs sfs;
+    return fstatfs(fd, &sfs) == 0 && (sfs.f_flags & MNT_LOCAL);
+#else
+    (void)fd;
+    return true;
+#endif
+}
+
+static bool map_file(FileData *f, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (!is_local_fs(fd) || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        (uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+        close(fd);
+        return false;
+    }
+
+    void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) return false;
+    posix_madvise(view, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    f->map_view = view;
+    f->map_size = (size_t)st.st_size;
+    return true;
+}
+
+static void unmap_file(FileData *f) {
+    munmap(f->map_view, f->map_size);
+}
+#endif
+
+// What to load: the start of a file (all of it when mapped), its end, or a range
+typedef enum { LOAD_HEAD, LOAD_TAIL, LOAD_RANGE } LoadPart;
+
+// Where the part starts in a size-byte file and how long it is: max_bytes from
+// offset, or the last max_bytes. False when nothing of it is in the file.
+static bool file_span(uint64_t size, uint64_t offset, size_t max_bytes, LoadPart part, uint64_t *start, size_t *len) {
+    if (part == LOAD_TAIL) offset = size > max_bytes ? size - max_bytes : 0;
+    if (offset >= size) return false;
+    *start = offset;
+    *len = (size - offset < max_bytes) ? (size_t)(size - offset) : max_bytes;
+    return true;
+}
+
+static bool read_vfs(FileData *f, const char *path, uint64_t offset, size_t max_bytes, LoadPart part) {
+    if (part != LOAD_HEAD && !vfs->seek) return false;
+    struct retro_vfs_file_handle *h = vfs->open(path, RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+    if (!h) return false;
+
+    int64_t size = vfs->size(h);
+    uint64_t start;
+    size_t want;
+    bool ok = false;
+    if (size > 0 && file_span((uint64_t)size, offset, max_bytes, part, &start, &want) &&
+        (start == 0 || vfs->seek(h, (int64_t)start, RETRO_VFS_SEEK_POSITION_START) >= 0)) {
+        f->heap = malloc(want);
+        if (f->heap) {
+            size_t got = 0;
+            while (got < want) {
+                int64_t n = vfs->read(h, (unsigned char*)f->heap + got, want - got);
+                if (n <= 0) break;
+                got += (size_t)n;
+            }
+            if (got > 0) {
+                f->size = got;
+                ok = true;
+            } else {
+                free(f->heap);
+                f->heap = NULL;
+            }
+        }
+    }
+    vfs->close(h);
+    return ok;
+}
+
+static bool read_stdio(FileData *f, const char *path, uint64_t offset, size_t max_bytes, LoadPart part) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+
+    bool ok = false;
+    int64_t size = -1;
+    uint64_t start;
+    size_t want;
+    if (fseek64(fp, 0, SEEK_END) == 0) size = (int64_t)ftell64(fp);
+    if (size > 0 && file_span((uint64_t)size, offset, max_bytes, part, &start, &want) &&
+        fseek64(fp, (int64_t)start, SEEK_SET) == 0) {
+        f->heap = malloc(want);
+        if (f->heap) {
+            f->size = fread(f->heap, 1, want, fp);
+            ok = f->size > 0;
+            if (!ok) {
+                free(f->heap);
+                f->heap = NULL;
+            }
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+void fileio_set_vfs(struct retro_vfs_interface *iface) {
+    vfs = (iface && iface->open && iface->read && iface->size && iface->close) ? iface : NULL;
+}
+
+static bool load(FileData *f, const char *path, uint64_t offset, size_t max_bytes, LoadPart part) {
+    memset(f, 0, sizeof(*f));
+    if (!path || !path[0] || max_bytes == 0) return false;
+
+    if (map_file(f, path)) {
+        uint64_t start = 0;
+        size_t len = f->map_size;
+        if (part != LOAD_HEAD && !file_span(f->map_size, offset, max_bytes, part, &start, &len)) {
+            unmap_file(f);
+            memset(f, 0, sizeof(*f));
+            return false;
+        }
+        f->data = (const unsigned char*)f->map_view + start;
+        f->size = len;
+        f->source = FILE_SOURCE_MMAP;
+    } else if (vfs && read_vfs(f, path, offset, max_bytes, part)) {
+        f->data = f->heap;
+        f->source = FILE_SOURCE_VFS;
+    } else if (read_stdio(f, path, offset, max_bytes, part)) {
+        f->data = f->heap;
+        f->source = FILE_SOURCE_STDIO;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool file_load_head(FileData *f, const char *path, size_t max_bytes) {
+    return load(f, path, 0, max_bytes, LOAD_HEAD);
+}
+
+bool file_load_tail(FileData *f, const char *path, size_t max_bytes) {
+    return load(f, path, 0, max_bytes, LOAD_TAIL);
+}
+
+bool file_load_range(FileData *f, const char *path, uint64_t offset, size_t size) {
+    return load(f, path, offset, size, LOAD_RANGE);
+}
+
+bool file_load(FileData *f, const char *path) {
+    return file_load_head(f, path, SIZE_MAX);
+}
+
+bool file_map(FileData *f, const char *path) {
+    memset(f, 0, sizeof(*f));
+    if (!path || !path[0] || !map_file(f, path)) return false;
+    f->data = f->map_view;
+    f->size = f->map_size;
+    f->source = FILE_SOURCE_MMAP;
+    return true;
+}
+
+void file_unload(FileData *f) {
+    if (f->map_view) unmap_file(f);
+    free(f->heap);
+    memset(f, 0, sizeof(*f));
+}
+
+bool file_stream_open(FileStream *s, const char *path, bool stdio_only) {
+    memset(s, 0, sizeof(*s));
+    if (!path || !path[0]) return false;
+    if (!stdio_only && vfs && vfs->seek && vfs->tell) {
+        s->vfs_handle = vfs->open(path, RETRO_VFS_FILE_ACCESS_READ, RETRO_VFS_FILE_ACCESS_HINT_NONE);
+        s->vfs = vfs;
+        if (s->vfs_handle) return true;
+    }
+    s->fp = fopen(path, "rb");
+    return s->fp != NULL;
+}
+
+size_t file_stream_read(FileStream *s, void *buf, size_t bytes) {
+    if (s->fp) return fread(buf, 1, bytes, s->fp);
+    if (!s->vfs_handle) return 0;
+    size_t got = 0;
+    while (got < bytes) {
+        int64_t n = s->vfs->read(s->vfs_handle, (unsigned char*)buf + got, bytes - got);
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    return got;
+}
+
+bool file_stream_seek(FileStream *s, int64_t offset, int origin) {
+    if (s->fp) return fseek64(s->fp, offset, origin) == 0;
+    if (!s->vfs_handle) return false;
+    int position = origin == SEEK_CUR ? RETRO_VFS_SEEK_POSITION_CURRENT :
+                   origin == SEEK_END ? RETRO_VFS_SEEK_POSITION_END : RETRO_VFS_SEEK_POSITION_START;
+    return s->vfs->seek(s->vfs_handle, offset, position) >= 0;
+}
+
+int64_t file_stream_tell(FileStream *s) {
+    if (s->fp) return (int64_t)ftell64(s->fp);
+    return s->vfs_handle ? s->vfs->tell(s->vfs_handle) : -1;
+}
+
+void file_stream_close(FileStream *s) {
+    if (s->fp) fclose(s->fp);
+    if (s->vfs_handle) s->vfs->close(s->vfs_handle);
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "libretro.h"
+
+typedef enum { FILE_SOURCE_NONE, FILE_SOURCE_MMAP, FILE_SOURCE_VFS, FILE_SOURCE_STDIO } FileSource;
+
+// File contents in memory: mapped when the file is on a local disk and the OS
+// allows it, otherwise read into the heap through the frontend VFS or stdio
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    FileSource source;
+    void *heap;             // owned copy (VFS/stdio)
+    void *map_view;         // mapped view (mmap)
+    size_t map_size;
+#ifdef _WIN32
+    void *map_handle;
+#endif
+} FileData;
+
+// Use the frontend's VFS for files that cannot be mapped (NULL to disable)
+void fileio_set_vfs(struct retro_vfs_interface *vfs);
+
+// Load a whole file, returns false if it cannot be opened or is empty
+bool file_load(FileData *f, const char *path);
+
+// Load at least the first max_bytes (all of it when mapped)
+bool file_load_head(FileData *f, const char *path, size_t max_bytes);
+
+// Load only the last max_bytes (fewer when the file is smaller), for trailers
+// such as an ID3v1 tag or the final Ogg page
+bool file_load_tail(FileData *f, const char *path, size_t max_bytes);
+
+// Load size bytes from offset on (fewer when the file ends first), for a part
+// such as an embedded picture. False when the file ends before offset.
+bool file_load_range(FileData *f, const char *path, uint64_t offset, size_t size);
+
+// Map a whole file without reading it; false when it is not on a local disk
+// or cannot be mapped
+bool file_map(FileData *f, const char *path);
+
+// Release a loaded file
+void file_unload(FileData *f);
+
+// An open file read a piece at a time, for decoders that stream a file which
+// is not mapped instead of holding all of it: through the frontend VFS when
+// it can seek, otherwise stdio
+typedef struct {
+    struct retro_vfs_interface *vfs;    // the interface the handle came from
+    struct retro_vfs_file_handle *vfs_handle;
+    FILE *fp;
+} FileStream;
+
+// Open path for streaming. stdio_only skips the VFS, for a reader that needs
+// the FILE (stb_vorbis).
+bool file_stream_open(FileStream *s, const char *path, bool stdio_only);
+
+// Read up to bytes, fewer only at the end of the file or on an error
+size_t file_stream_read(FileStream *s, void *buf, size_t bytes);
+
+// origin is SEEK_SET, SEEK_CUR or SEEK_END
+bool file_stream_seek(FileStream *s, int64_t offset, int origin);
+
+// Current position, -1 on an error
+int64_t file_stream_tell(FileStream *s);
+
+// Close the stream (safe on one never opened)
+void file_stream_close(FileStream *s);
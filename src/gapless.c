@@ -0,0 +1,174 @@
+#include "gapless.h"
+#include <string.h>
+
+#define MP3_DECODER_DELAY 529
+
+typedef struct {
+    uint32_t xing_frames;       // audio frames counted by the Xing/Info header
+    uint32_t samples_per_frame;
+    uint32_t enc_delay, enc_padding;
+    bool has_lame;
+    uint64_t smpb_delay, smpb_padding, smpb_total;
+    bool has_smpb;
+} Mp3GaplessInfo;
+
+static uint32_t be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t syncsafe32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 21) | ((uint32_t)p[1] << 14) | ((uint32_t)p[2] << 7) | p[3];
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// iTunSMPB value: " 00000000 00000210 00000A2C 0000000000A3BE76 ..."
+// (unused, delay, padding, total samples). Text may be Latin-1 or UTF-16.
+static void parse_itunsmpb(const unsigned char *data, size_t len, Mp3GaplessInfo *info) {
+    char text[256];
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 1 < sizeof(text); i++) {
+        if (data[i] >= 32 && data[i] < 127) text[n++] = (char)data[i];
+    }
+    text[n] = '\0';
+
+    const char *p = strstr(text, "iTunSMPB");
+    if (!p) return;
+    p += 8;
+
+    uint64_t fields[4] = {0};
+    int count = 0;
+    while (*p && count < 4) {
+        while (*p && hex_digit(*p) < 0) p++;
+        if (!*p) break;
+        uint64_t v = 0;
+        while (*p && hex_digit(*p) >= 0) v = (v << 4) | (uint64_t)hex_digit(*p++);
+        fields[count++] = v;
+    }
+    if (count < 4 || fields[3] == 0) return;
+
+    info->smpb_delay = fields[1];
+    info->smpb_padding = fields[2];
+    info->smpb_total = fields[3];
+    info->has_smpb = true;
+}
+
+// Walk ID3v2 frame headers looking for an iTunSMPB COMM/TXXX frame.
+static void scan_id3v2_for_smpb(const unsigned char *tag, size_t tag_len, Mp3GaplessInfo *info) {
+    uint8_t version = tag[3];
+    int header_size = (version == 2) ? 6 : 10;
+    size_t pos = 10;
+
+    while (pos + (size_t)header_size < tag_len) {
+        const unsigned char *fh = tag + pos;
+        if (fh[0] == 0) return;
+
+        uint32_t frame_size;
+        bool is_comment;
+        if (version == 2) {
+            frame_size = ((uint32_t)fh[3] << 16) | ((uint32_t)fh[4] << 8) | fh[5];
+            is_comment = memcmp(fh, "COM", 3) == 0 || memcmp(fh, "TXX", 3) == 0;
+        } else {
+            frame_size = (version == 4) ? syncsafe32(fh + 4) : be32(fh + 4);
+            is_comment = memcmp(fh, "COMM", 4) == 0 || memcmp(fh, "TXXX", 4) == 0;
+        }
+        pos += (size_t)header_size;
+        if (frame_size == 0 || frame_size > tag_len - pos) return;
+
+        if (is_comment && frame_size <= 512) {
+            parse_itunsmpb(tag + pos, frame_size, info);
+            if (info->has_smpb) return;
+        }
+        pos += frame_size;
+    }
+}
+
+static bool read_mp3_gapless_info(const unsigned char *id3, size_t id3_size,
+                                  const unsigned char *buf, size_t n, Mp3GaplessInfo *info) {
+    memset(info, 0, sizeof(*info));
+
+    if (id3 && id3_size >= 10 && memcmp(id3, "ID3", 3) == 0 &&
+        id3[3] >= 2 && id3[3] <= 4 && !(id3[5] & 0x40))
+        scan_id3v2_for_smpb(id3, id3_size, info);
+
+    // The Xing/Info header lives in the first audio frame.
+    for (size_t i = 0; buf && i + 4 <= n; i++) {
+        if (buf[i] != 0xFF || (buf[i + 1] & 0xE0) != 0xE0) continue;
+        uint32_t h = be32(buf + i);
+        uint32_t version = (h >> 19) & 3;    // 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+        uint32_t layer = (h >> 17) & 3;      // 1 = Layer III
+        uint32_t rate_idx = (h >> 10) & 3;
+        uint32_t bitrate_idx = (h >> 12) & 15;
+        if (version == 1 || layer != 1 || rate_idx == 3 || bitrate_idx == 0 || bitrate_idx == 15) continue;
+
+        bool mono = ((h >> 6) & 3) == 3;
+        size_t side_info = (version == 3) ? (mono ? 17 : 32) : (mono ? 9 : 17);
+        size_t x = i + 4 + side_info;
+        info->samples_per_frame = (version == 3) ? 1152 : 576;
+        if (x + 8 > n) break;
+        if (memcmp(buf + x, "Xing", 4) != 0 && memcmp(buf + x, "Info", 4) != 0) break;
+
+        uint32_t flags = be32(buf + x + 4);
+        size_t p = x + 8;
+        if (flags & 1) {
+            if (p + 4 > n) break;
+            info->xing_frames = be32(buf + p);
+            p += 4;
+        }
+        if (flags & 2) p += 4;   // byte count
+        if (flags & 4) p += 100; // TOC
+        if (flags & 8) p += 4;   // quality
+
+        // LAME extension: 9-byte encoder string ... delay/padding 12 bits each at +21
+        if (p + 24 <= n && (memcmp(buf + p, "LAME", 4) == 0 || memcmp(buf + p, "Lavc", 4) == 0 ||
+                            memcmp(buf + p, "Lavf", 4) == 0)) {
+            const unsigned char *d = buf + p + 21;
+            info->enc_delay = ((uint32_t)d[0] << 4) | (d[1] >> 4);
+            info->enc_padding = ((uint32_t)(d[1] & 0x0F) << 8) | d[2];
+            info->has_lame = true;
+        }
+        break;
+    }
+
+    return info->has_lame || info->has_smpb;
+}
+
+bool gapless_mp3_trim(const unsigned char *id3, size_t id3_size, const unsigned char *frame, size_t frame_size,
+                      uint64_t decoded_frames, uint64_t *lead, uint64_t *valid) {
+    Mp3GaplessInfo info;
+    if (decoded_frames == 0 || !read_mp3_gapless_info(id3, id3_size, frame, frame_size, &info)) return false;
+
+    if (info.has_lame && info.xing_frames > 0) {
+        uint64_t spf = info.samples_per_frame;
+        uint64_t raw = (uint64_t)info.xing_frames * spf;
+        uint64_t trim = (uint64_t)info.enc_delay + info.enc_padding;
+        uint64_t skip = (uint64_t)info.enc_delay + MP3_DECODER_DELAY;
+        bool known = true;
+
+        if (trim < raw && decoded_frames == raw - trim) {
+            skip = 0;                   // decoder already applies the trim
+        } else if (decoded_frames == raw + spf) {
+            skip += spf;                // decoder emits the Info frame as silence
+        } else if (decoded_frames != raw) {
+            known = false;              // unknown decoder behaviour, try iTunSMPB
+        }
+
+        if (known && trim < raw && skip + (raw - trim) <= decoded_frames) {
+            *lead = skip;
+            *valid = raw - trim;
+            return true;
+        }
+    }
+
+    if (info.has_smpb && info.smpb_delay + info.smpb_total <= decoded_frames) {
+        *lead = info.smpb_delay;
+        *valid = info.smpb_total;
+        return true;
+    }
+    return false;
+}
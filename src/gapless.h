@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Work out the MP3 encoder delay/padding trim from the LAME/Xing header or an
+// iTunSMPB tag. id3 is the ID3v2 tag (header included, may be NULL) and frame
+// the bytes starting at the first audio frame. decoded_frames is the decoder's
+// own PCM frame count, used to tell whether the decoder already emits or trims
+// the padding itself.
+// On success *lead is the number of decoded frames to drop at the start and
+// *valid the number of real audio frames that follow.
+bool gapless_mp3_trim(const unsigned char *id3, size_t id3_size, const unsigned char *frame, size_t frame_size,
+                      uint64_t decoded_frames, uint64_t *lead, uint64_t *valid);
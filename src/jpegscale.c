@@ -0,0 +1,449 @@
+#include "jpegscale.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#define JPEG_MAX_PIXELS (64 * 1024 * 1024)
+#define HUFF_FAST_BITS 9
+
+typedef struct {
+    uint16_t fast[1 << HUFF_FAST_BITS];     // (length << 8) | value for short codes, 0 if none
+    int32_t maxcode[17];                    // largest code of each length, -1 if none
+    int32_t mincode[17];
+    int valptr[17];
+    uint8_t vals[256];
+    bool present;
+} Huffman;
+
+typedef struct {
+    int id, h, v, tq;
+    int td, ta;                 // Huffman tables of the scan
+    int blocks_w, blocks_h;     // blocks across and down, padded to whole MCUs
+    int pred;                   // DC predictor
+    uint8_t *plane;             // samples at the reduced size
+    int plane_w, plane_h;
+} Component;
+
+typedef struct {
+    const uint8_t *p, *end;
+    uint32_t acc;               // bits, most significant first
+    int bits;
+    bool marker;                // reached a marker: only zeros follow
+} BitReader;
+
+typedef struct {
+    uint16_t quant[4][64];      // zigzag order
+    bool quant_present[4];
+    Huffman dc[4], ac[4];
+    Component comp[3];
+    int ncomp, width, height, hmax, vmax;
+    int restart_interval;
+    bool rgb;                   // Adobe transform 0: the components are R, G, B
+    int n;                      // output samples per block side (8 / scale)
+    float idct[8][8];           // [x][u]: basis of the n-point transform
+    BitReader br;
+} Decoder;
+
+static const uint8_t zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+static int be16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static bool build_huffman(Huffman *h, const uint8_t *counts, const uint8_t *vals, int total) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->vals, vals, (size_t)total);
+    int32_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+        h->valptr[len] = k;
+        h->mincode[len] = code;
+        for (int i = 0; i < counts[len - 1]; i++, k++, code++) {
+            if (len <= HUFF_FAST_BITS) {
+                int shift = HUFF_FAST_BITS - len;
+                for (int j = 0; j < (1 << shift); j++)
+                    h->fast[(code << shift) | j] = (uint16_t)((len << 8) | vals[k]);
+            }
+        }
+        h->maxcode[len] = counts[len - 1] ? code - 1 : -1;
+        if (code > (1 << len)) return false;
+        code <<= 1;
+    }
+    h->present = true;
+    return true;
+}
+
+static void fill_bits(BitReader *br) {
+    while (br->bits <= 24) {
+        uint32_t byte = 0;
+        if (!br->marker && br->p < br->end) {
+            byte = *br->p;
+            if (byte == 0xFF) {
+                if (br->p + 1 < br->end && br->p[1] == 0x00) {
+                    br->p += 2;
+                } else {
+                    br->marker = true;
+                    byte = 0;
+                }
+            } else {
+                br->p++;
+            }
+        }
+        br->acc |= byte << (24 - br->bits);
+        br->bits += 8;
+    }
+}
+
+static int get_bits(BitReader *br, int n) {
+    if (n == 0) return 0;
+    fill_bits(br);
+    int v = (int)(br->acc >> (32 - n));
+    br->acc <<= n;
+    br->bits -= n;
+    return v;
+}
+
+// An n-bit magnitude category value as a signed number
+static int receive_extend(BitReader *br, int n) {
+    int v = get_bits(br, n);
+    return v < (1 << (n - 1)) ? v - (1 << n) + 1 : v;
+}
+
+static int decode_huffman(BitReader *br, const Huffman *h) {
+    fill_bits(br);
+    int fast = h->fast[br->acc >> (32 - HUFF_FAST_BITS)];
+    if (fast) {
+        int len = fast >> 8;
+        br->acc <<= len;
+        br->bits -= len;
+        return fast & 0xFF;
+    }
+    for (int len = HUFF_FAST_BITS + 1; len <= 16; len++) {
+        int32_t code = (int32_t)(br->acc >> (32 - len));
+        if (code <= h->maxcode[len]) {
+            br->acc <<= len;
+            br->bits -= len;
+            return h->vals[h->valptr[len] + code - h->mincode[len]];
+        }
+    }
+    return -1;
+}
+
+// Skip to just past the next restart marker and start the predictors over
+static void restart(Decoder *d) {
+    BitReader *br = &d->br;
+    while (br->p + 1 < br->end && !(br->p[0] == 0xFF && br->p[1] >= 0xD0 && br->p[1] <= 0xD7)) br->p++;
+    if (br->p + 1 < br->end) br->p += 2;
+    br->acc = 0;
+    br->bits = 0;
+    br->marker = false;
+    for (int i = 0; i < d->ncomp; i++) d->comp[i].pred = 0;
+}
+
+// Decode one block and write its n x n reduced samples at (x, y) of the
+// component's plane. AC terms past the first n in each direction are read
+// past without being kept.
+static bool decode_block(Decoder *d, Component *c, int x, int y) {
+    BitReader *br = &d->br;
+    const uint16_t *q = d->quant[c->tq];
+    int n = d->n;
+    float coef[8][8];
+    for (int v = 0; v < n; v++) {
+        for (int u = 0; u < n; u++) coef[v][u] = 0.0f;
+    }
+
+    int t = decode_huffman(br, &d->dc[c->td]);
+    if (t < 0 || t > 11) return false;
+    c->pred += t ? receive_extend(br, t) : 0;
+    coef[0][0] = (float)(c->pred * q[0]);
+
+    for (int k = 1; k < 64;) {
+        int rs = decode_huffman(br, &d->ac[c->ta]);
+        if (rs < 0) return false;
+        int r = rs >> 4, s = rs & 15;
+        if (s == 0) {
+            if (r != 15) break;     // end of block
+            k += 16;
+            continue;
+        }
+        k += r;
+        if (k > 63) return false;
+        int z = zigzag[k];
+        if ((z & 7) < n && (z >> 3) < n) coef[z >> 3][z & 7] = (float)(receive_extend(br, s) * q[k]);
+        else get_bits(br, s);
+        k++;
+    }
+
+    // Separable n-point inverse DCT of the low-frequency corner
+    float rows[8][8];
+    for (int v = 0; v < n; v++) {
+        for (int xx = 0; xx < n; xx++) {
+            float sum = 0.0f;
+            for (int u = 0; u < n; u++) sum += coef[v][u] * d->idct[xx][u];
+            rows[v][xx] = sum;
+        }
+    }
+    for (int yy = 0; yy < n; yy++) {
+        uint8_t *out = c->plane + (size_t)(y + yy) * c->plane_w + x;
+        for (int xx = 0; xx < n; xx++) {
+            float sum = 128.0f;
+            for (int v = 0; v < n; v++) sum += rows[v][xx] * d->idct[yy][v];
+            out[xx] = (uint8_t)(sum <= 0.0f ? 0 : sum >= 255.0f ? 255 : (int)(sum + 0.5f));
+        }
+    }
+    return true;
+}
+
+static bool decode_scan(Decoder *d) {
+    int n = d->n;
+    int mcus_w, mcus_h;
+    if (d->ncomp == 1) {
+        // A lone component's MCU is one block, whatever its sampling factors
+        mcus_w = d->comp[0].blocks_w;
+        mcus_h = d->comp[0].blocks_h;
+    } else {
+        mcus_w = (d->width + 8 * d->hmax - 1) / (8 * d->hmax);
+        mcus_h = (d->height + 8 * d->vmax - 1) / (8 * d->vmax);
+    }
+
+    int todo = d->restart_interval;
+    for (int my = 0; my < mcus_h; my++) {
+        for (int mx = 0; mx < mcus_w; mx++) {
+            if (d->restart_interval) {
+                if (todo == 0) {
+                    restart(d);
+                    todo = d->restart_interval;
+                }
+                todo--;
+            }
+            for (int i = 0; i < d->ncomp; i++) {
+                Component *c = &d->comp[i];
+                int bh = d->ncomp == 1 ? 1 : c->h, bv = d->ncomp == 1 ? 1 : c->v;
+                for (int v = 0; v < bv; v++) {
+                    for (int u = 0; u < bh; u++) {
+                        if (!decode_block(d, c, (mx * bh + u) * n, (my * bv + v) * n)) return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Frame header: size, and each component's sampling factors and quantiser
+static bool read_frame(Decoder *d, const uint8_t *s, int len) {
+    if (len < 6 || s[0] != 8) return false;
+    d->height = be16(s + 1);
+    d->width = be16(s + 3);
+    d->ncomp = s[5];
+    if (d->width == 0 || d->height == 0 || (d->ncomp != 1 && d->ncomp != 3) || len < 6 + 3 * d->ncomp) return false;
+    if ((int64_t)d->width * d->height > JPEG_MAX_PIXELS) return false;
+    d->hmax = d->vmax = 1;
+    for (int i = 0; i < d->ncomp; i++) {
+        Component *c = &d->comp[i];
+        c->id = s[6 + i * 3];
+        c->h = s[7 + i * 3] >> 4;
+        c->v = s[7 + i * 3] & 15;
+        c->tq = s[8 + i * 3];
+        if (c->h < 1 || c->h > 2 || c->v < 1 || c->v > 2 || c->tq > 3) return false;
+        if (c->h > d->hmax) d->hmax = c->h;
+        if (c->v > d->vmax) d->vmax = c->v;
+    }
+    for (int i = 0; i < d->ncomp; i++) {
+        Component *c = &d->comp[i];
+        if (d->ncomp == 1) {
+            c->h = c->v = 1;
+            d->hmax = d->vmax = 1;
+        }
+        int mcus_w = (d->width + 8 * d->hmax - 1) / (8 * d->hmax);
+        int mcus_h = (d->height + 8 * d->vmax - 1) / (8 * d->vmax);
+        c->blocks_w = mcus_w * c->h;
+        c->blocks_h = mcus_h * c->v;
+    }
+    return true;
+}
+
+static bool read_tables(Decoder *d, int marker, const uint8_t *s, int len) {
+    if (marker == 0xDB) {
+        while (len > 0) {
+            int pq = s[0] >> 4, tq = s[0] & 15;
+            int need = 1 + 64 * (pq ? 2 : 1);
+            if (tq > 3 || pq > 1 || len < need) return false;
+            for (int k = 0; k < 64; k++) d->quant[tq][k] = (uint16_t)(pq ? be16(s + 1 + 2 * k) : s[1 + k]);
+            d->quant_present[tq] = true;
+            s += need;
+            len -= need;
+        }
+    } else {
+        while (len > 0) {
+            if (len < 17) return false;
+            int tc = s[0] >> 4, th = s[0] & 15;
+            int total = 0;
+            for (int i = 0; i < 16; i++) total += s[1 + i];
+            if (tc > 1 || th > 3 || total > 256 || len < 17 + total) return false;
+            if (!build_huffman(tc ? &d->ac[th] : &d->dc[th], s + 1, s + 17, total)) return false;
+            s += 17 + total;
+            len -= 17 + total;
+        }
+    }
+    return true;
+}
+
+// Scan header; only a scan with every component of the frame is decoded
+static bool read_scan(Decoder *d, const uint8_t *s, int len) {
+    int ns = len > 0 ? s[0] : 0;
+    if (ns != d->ncomp || len < 4 + 2 * ns) return false;
+    for (int i = 0; i < ns; i++) {
+        Component *c = NULL;
+        for (int j = 0; j < d->ncomp; j++) {
+            if (d->comp[j].id == s[1 + 2 * i]) c = &d->comp[j];
+        }
+        if (!c) return false;
+        c->td = s[2 + 2 * i] >> 4;
+        c->ta = s[2 + 2 * i] & 15;
+        if (c->td > 3 || c->ta > 3 || !d->dc[c->td].present || !d->ac[c->ta].present || !d->quant_present[c->tq])
+            return false;
+    }
+    const uint8_t *sel = s + 1 + 2 * ns;
+    return sel[0] == 0 && sel[1] == 63 && sel[2] == 0;
+}
+
+static uint8_t clamp_byte(int v) {
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// Combine the planes into RGB888, chroma taken from the nearest sample
+static void write_rgb(const Decoder *d, uint8_t *out, int w, int h) {
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row[3];
+        for (int i = 0; i < d->ncomp; i++) {
+            const Component *c = &d->comp[i];
+            row[i] = c->plane + (size_t)(y * c->v / d->vmax) * c->plane_w;
+        }
+        for (int x = 0; x < w; x++, out += 3) {
+            int y0 = row[0][x * d->comp[0].h / d->hmax];
+            if (d->ncomp == 1) {
+                out[0] = out[1] = out[2] = (uint8_t)y0;
+                continue;
+            }
+            int c1 = row[1][x * d->comp[1].h / d->hmax];
+            int c2 = row[2][x * d->comp[2].h / d->hmax];
+            if (d->rgb) {
+                out[0] = (uint8_t)y0;
+                out[1] = (uint8_t)c1;
+                out[2] = (uint8_t)c2;
+                continue;
+            }
+            // BT.601 full range, 16.16 fixed point
+            int cb = c1 - 128, cr = c2 - 128;
+            out[0] = clamp_byte(y0 + ((91881 * cr + 32768) >> 16));
+            out[1] = clamp_byte(y0 - ((22554 * cb + 46802 * cr - 32768) >> 16));
+            out[2] = clamp_byte(y0 + ((116130 * cb + 32768) >> 16));
+        }
+    }
+}
+
+static void setup_idct(Decoder *d) {
+    const float pi = 3.14159265f;
+    for (int x = 0; x < d->n; x++) {
+        for (int u = 0; u < d->n; u++) {
+            // Scaled like the 8-point transform, so the DC term keeps the block's mean
+            float cu = u == 0 ? 0.35355339f : 0.5f;
+            d->idct[x][u] = cu * cosf((2 * x + 1) * u * pi / (2.0f * d->n));
+        }
+    }
+}
+
+// Largest of 8, 4, 2 that keeps the image at least min_w x min_h (where it is that big), 1 for none
+static int pick_scale(int width, int height, int min_w, int min_h) {
+    int want_w = width < min_w ? width : min_w;
+    int want_h = height < min_h ? height : min_h;
+    for (int s = 8; s >= 2; s /= 2) {
+        if ((width + s - 1) / s >= want_w && (height + s - 1) / s >= want_h) return s;
+    }
+    return 1;
+}
+
+unsigned char *jpegscale_decode(const unsigned char *data, size_t size, int min_w, int min_h, int *w, int *h,
+                                const JpegAllocator *alloc) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return NULL;
+
+    Decoder *d = alloc->malloc(sizeof(Decoder), alloc->user);
+    if (!d) return NULL;
+    memset(d, 0, sizeof(*d));
+
+    // Header segments up to the start of the scan
+    const uint8_t *p = data + 2, *end = data + size;
+    bool frame = false, scan = false, ok = true;
+    while (ok && !scan && p + 4 <= end) {
+        if (p[0] != 0xFF) {
+            ok = false;
+            break;
+        }
+        int marker = p[1];
+        if (marker == 0xFF) {
+            p++;        // fill byte
+            continue;
+        }
+        int len = be16(p + 2) - 2;
+        const uint8_t *seg = p + 4;
+        if (len < 0 || seg + len > end) {
+            ok = false;
+            break;
+        }
+        if (marker == 0xC0 || marker == 0xC1) {
+            ok = read_frame(d, seg, len);
+            frame = ok;
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            ok = false;     // progressive, lossless, hierarchical or arithmetic
+        } else if (marker == 0xDB || marker == 0xC4) {
+            ok = read_tables(d, marker, seg, len);
+        } else if (marker == 0xDD) {
+            ok = len >= 2;
+            if (ok) d->restart_interval = be16(seg);
+        } else if (marker == 0xEE && len >= 12 && memcmp(seg, "Adobe", 5) == 0) {
+            d->rgb = seg[11] == 0;
+        } else if (marker == 0xDA) {
+            ok = frame && read_scan(d, seg, len);
+            scan = ok;
+        } else if (marker == 0xD9) {
+            ok = false;
+        }
+        p = seg + len;
+    }
+
+    unsigned char *out = NULL;
+    int scale = scan ? pick_scale(d->width, d->height, min_w, min_h) : 1;
+    if (scale > 1) {
+        d->n = 8 / scale;
+        setup_idct(d);
+        bool planes = true;
+        for (int i = 0; i < d->ncomp; i++) {
+            Component *c = &d->comp[i];
+            c->plane_w = c->blocks_w * d->n;
+            c->plane_h = c->blocks_h * d->n;
+            c->plane = alloc->malloc((size_t)c->plane_w * c->plane_h, alloc->user);
+            if (!c->plane) planes = false;
+        }
+        d->br.p = p;
+        d->br.end = end;
+        *w = (d->width + scale - 1) / scale;
+        *h = (d->height + scale - 1) / scale;
+        if (planes && decode_scan(d)) {
+            out = alloc->malloc((size_t)*w * *h * 3, alloc->user);
+            if (out) write_rgb(d, out, *w, *h);
+        }
+        // Newest first, as an arena reclaims only its last block
+        for (int i = d->ncomp - 1; i >= 0; i--) {
+            if (d->comp[i].plane) alloc->free(d->comp[i].plane, alloc->user);
+        }
+    }
+    alloc->free(d, alloc->user);
+    return out;
+}
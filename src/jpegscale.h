@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+
+// Baseline JPEG decoding at 1/2, 1/4 or 1/8 of the size, straight from the
+// DCT coefficients: only the low frequencies of each 8x8 block are
+// transformed (just the DC term at 1/8), so a 3000x3000 cover costs a
+// fraction of a full decode. Progressive, arithmetic-coded, 12-bit and CMYK
+// files are left to a full decoder.
+
+// Laid out like the dr_libs allocation callbacks (user is passed back)
+typedef struct {
+    void *user;
+    void *(*malloc)(size_t size, void *user);
+    void (*free)(void *p, void *user);
+} JpegAllocator;
+
+// Decode data to RGB888 at the largest reduction that is still at least
+// min_w x min_h (or the whole image, where it is smaller). NULL when no
+// reduction applies or data is not a JPEG this decoder handles; *w and *h
+// receive the decoded size. The pixels come from alloc.
+unsigned char *jpegscale_decode(const unsigned char *data, size_t size, int min_w, int min_h, int *w, int *h,
+                                const JpegAllocator *alloc);
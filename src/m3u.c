@@ -0,0 +1,405 @@
+#include "m3u.h"
+#include "fileio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define M3U_SSE2 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#define M3U_MAX_PATH 1024
+
+typedef enum { M3U_UTF8, M3U_UTF16_LE, M3U_UTF16_BE } M3uEncoding;
+
+static int strncasecmp_simple(const char *s1, const char *s2, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        char c1 = s1[i];
+        char c2 = s2[i];
+        if (!c1 || !c2) return c1 - c2;
+        if (c1 >= 'A' && c1 <= 'Z') c1 += 32;
+        if (c2 >= 'A' && c2 <= 'Z') c2 += 32;
+        if (c1 != c2) return c1 - c2;
+    }
+    return 0;
+}
+
+static int is_drive_letter(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static int is_localhost_host(const char *s, size_t len) {
+    return len == 9 && strncasecmp_simple(s, "localhost", 9) == 0;
+}
+
+static int is_absolute_path(const char *p) {
+    if (!p || !p[0]) return 0;
+    if (p[0] == '/' || p[0] == '\\') return 1;
+    return is_drive_letter(p[0]) && p[1] == ':';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void percent_decode_inplace(char *s) {
+    if (!s) return;
+    size_t r = 0;
+    size_t w = 0;
+    while (s[r]) {
+        if (s[r] == '%' && s[r + 1] && s[r + 2]) {
+            int hi = hex_value(s[r + 1]);
+            int lo = hex_value(s[r + 2]);
+            if (hi >= 0 && lo >= 0) {
+                s[w++] = (char)((hi << 4) | lo);
+                r += 3;
+                continue;
+            }
+        }
+        s[w++] = s[r++];
+    }
+    s[w] = '\0';
+}
+
+static char *file_uri_path_start(char *uri, bool *file_is_unc) {
+    if (!uri || !uri[0]) return uri;
+
+    // Keep Windows-style file://C:/... URIs unchanged.
+    if (is_drive_letter(uri[0]) && uri[1] == ':') return uri;
+
+    char *sep = uri;
+    while (*sep && *sep != '/' && *sep != '\\') sep++;
+
+    // file://hostname with no path: treat as UNC host.
+    if (!*sep) {
+        if (!is_localhost_host(uri, strlen(uri))) *file_is_unc = true;
+        return uri;
+    }
+
+    size_t host_len = (size_t)(sep - uri);
+    if (host_len == 0) {
+        // file:///path...
+        uri = sep;
+    } else if (is_localhost_host(uri, host_len)) {
+        // file://localhost/path...
+        uri = sep;
+    } else {
+        // file://server/share...
+        *file_is_unc = true;
+    }
+
+    // file:///C:/... -> C:/... (Windows drive path)
+    if ((uri[0] == '/' || uri[0] == '\\') && is_drive_letter(uri[1]) && uri[2] == ':')
+        uri++;
+
+    return uri;
+}
+
+// BOM, or a UTF-16 guess from the zero bytes of mostly-ASCII text.
+// Returns the number of BOM bytes to skip.
+static size_t detect_encoding(const unsigned char *buf, size_t size, M3uEncoding *enc) {
+    *enc = M3U_UTF8;
+    if (size >= 2 && buf[0] == 0xFF && buf[1] == 0xFE) {
+        *enc = M3U_UTF16_LE;
+        return 2;
+    }
+    if (size >= 2 && buf[0] == 0xFE && buf[1] == 0xFF) {
+        *enc = M3U_UTF16_BE;
+        return 2;
+    }
+    if (size >= 3 && buf[0] == 0xEF && buf[1] == 0xBB && buf[2] == 0xBF)
+        return 3; // UTF-8 BOM
+
+    size_t n = size < 64 ? size : 64;
+    if (n >= 4) {
+        size_t even_zero = 0;
+        size_t odd_zero = 0;
+        for (size_t i = 0; i + 1 < n; i += 2) {
+            if (buf[i] == 0) even_zero++;
+            if (buf[i + 1] == 0) odd_zero++;
+        }
+        if (odd_zero > even_zero * 2 && odd_zero >= 4) *enc = M3U_UTF16_LE;
+        else if (even_zero > odd_zero * 2 && even_zero >= 4) *enc = M3U_UTF16_BE;
+    }
+    return 0;
+}
+
+static inline uint32_t utf16_unit(const unsigned char *p, bool le) {
+    return le ? (uint32_t)(p[0] | (p[1] << 8)) : (uint32_t)(p[1] | (p[0] << 8));
+}
+
+// Transcode a whole UTF-16 buffer to NUL-terminated UTF-8. Surrogate pairs
+// become 4-byte sequences, unpaired surrogates U+FFFD, BOMs are dropped.
+static char *utf16_to_utf8(const unsigned char *src, size_t size, bool le, size_t *out_len) {
+    size_t units = size / 2;
+    char *out = malloc(units * 3 + 1);
+    if (!out) return NULL;
+    char *w = out;
+    size_t i = 0;
+    while (i < units) {
+#if defined(M3U_SSE2)
+        // Narrow runs of ASCII eight code units at a time
+        const __m128i high_bits = _mm_set1_epi16((short)0xFF80);
+        while (units - i >= 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+            if (!le) v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(v, high_bits), _mm_setzero_si128());
+            if (_mm_movemask_epi8(ascii) != 0xFFFF) break;
+            _mm_storel_epi64((__m128i*)w, _mm_packus_epi16(v, v));
+            w += 8;
+            i += 8;
+        }
+        if (i >= units) break;
+#endif
+        uint32_t c = utf16_unit(src + i * 2, le);
+        i++;
+        if (c >= 0xD800 && c < 0xDC00 && i < units) {
+            uint32_t c2 = utf16_unit(src + i * 2, le);
+            if (c2 >= 0xDC00 && c2 < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+                i++;
+            } else {
+                c = 0xFFFD;
+            }
+        } else if (c >= 0xD800 && c < 0xE000) {
+            c = 0xFFFD;
+        }
+
+        if (c == 0xFEFF) continue;
+        if (c < 0x80) {
+            *w++ = (char)c;
+        } else if (c < 0x800) {
+            *w++ = (char)(0xC0 | (c >> 6));
+            *w++ = (char)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            *w++ = (char)(0xE0 | (c >> 12));
+            *w++ = (char)(0x80 | ((c >> 6) & 0x3F));
+            *w++ = (char)(0x80 | (c & 0x3F));
+        } else {
+            *w++ = (char)(0xF0 | (c >> 18));
+            *w++ = (char)(0x80 | ((c >> 12) & 0x3F));
+            *w++ = (char)(0x80 | ((c >> 6) & 0x3F));
+            *w++ = (char)(0x80 | (c & 0x3F));
+        }
+    }
+    *w = '\0';
+    *out_len = (size_t)(w - out);
+    return out;
+}
+
+#if defined(M3U_SSE2)
+static inline int first_set_bit(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return (int)idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// First CR or LF at or after p, end if there is none
+static char *find_line_end(char *p, char *end) {
+#if defined(M3U_SSE2)
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        if (mask) return p + first_set_bit((unsigned)mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\n' && *p != '\r') p++;
+    return p;
+}
+
+// Directives seen since the last entry. Strings point into the playlist text.
+typedef struct {
+    int duration;               // #EXTINF, cleared after each entry
+    char *artist, *title;
+    char *album;                // #EXTALB / #EXTART / #EXTIMG hold until replaced
+    char *album_artist;
+    char art[M3U_MAX_PATH];
+} M3uHints;
+
+static char *trim_spaces(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t'))
+        s[--len] = '\0';
+    return s;
+}
+
+static char *strip_quotes(char *s) {
+    size_t len = strlen(s);
+    if (len >= 2 && ((s[0] == '"' && s[len - 1] == '"') || (s[0] == '\'' && s[len - 1] == '\''))) {
+        s[len - 1] = '\0';
+        s++;
+    }
+    return s;
+}
+
+// Turn an entry into a usable path, in place when it is already absolute,
+// otherwise into buf. NULL if it does not fit.
+static const char *resolve_entry(char *entry, const char *dir, char *buf, size_t buf_size) {
+    // Handle file:// URIs
+    bool file_is_unc = false;
+    if (strncasecmp_simple(entry, "file://", 7) == 0) {
+        entry = file_uri_path_start(entry + 7, &file_is_unc);
+        percent_decode_inplace(entry);
+    }
+
+    // Fix backslashes for standard C file handling
+    for (char *c = entry; *c; c++) {
+        if (*c == '\\') *c = '/';
+    }
+
+    // Absolute entries go in as they are, relative ones get the playlist folder
+    if (!file_is_unc && (is_absolute_path(entry) || !dir[0]))
+        return strlen(entry) < M3U_MAX_PATH ? entry : NULL;
+
+    int written = file_is_unc ? snprintf(buf, buf_size, "//%s", entry)
+                              : snprintf(buf, buf_size, "%s/%s", dir, entry);
+    if (written <= 0 || written >= (int)buf_size) return NULL;
+    return buf;
+}
+
+// #EXTINF:<seconds>[ attributes],[Artist - ]Title
+static void parse_extinf(M3uHints *h, char *value) {
+    h->duration = atoi(value);
+    if (h->duration < 0) h->duration = 0;
+    h->artist = h->title = NULL;
+
+    // The display text follows the first comma outside quoted attributes
+    bool quoted = false;
+    char *c = value;
+    for (; *c; c++) {
+        if (*c == '"') quoted = !quoted;
+        else if (*c == ',' && !quoted) break;
+    }
+    if (!*c) return;
+
+    char *text = trim_spaces(c + 1);
+    char *sep = strstr(text, " - ");
+    if (sep) {
+        *sep = '\0';
+        h->artist = trim_spaces(text);
+        text = trim_spaces(sep + 3);
+    }
+    h->title = text[0] ? text : NULL;
+}
+
+// Handle one NUL-terminated line in place: remember a directive or add an
+// entry. Returns false when the playlist cannot grow any further.
+static bool add_line(Playlist *pl, char *line, const char *dir, M3uHints *h) {
+    char *trimmed = trim_spaces(line);
+
+    // Strip a stray UTF-8 BOM (e.g. playlists concatenated together)
+    if ((unsigned char)trimmed[0] == 0xEF && (unsigned char)trimmed[1] == 0xBB &&
+        (unsigned char)trimmed[2] == 0xBF)
+        trimmed += 3;
+
+    if (trimmed[0] == '#') {
+        // Every directive used here has an 8-character prefix
+        if (strlen(trimmed) < 8) return true;
+        char *value = trimmed + 8;
+        if (strncasecmp_simple(trimmed, "#EXTINF:", 8) == 0) {
+            parse_extinf(h, value);
+        } else if (strncasecmp_simple(trimmed, "#EXTALB:", 8) == 0) {
+            value = trim_spaces(value);
+            h->album = value[0] ? value : NULL;
+        } else if (strncasecmp_simple(trimmed, "#EXTART:", 8) == 0) {
+            value = trim_spaces(value);
+            h->album_artist = value[0] ? value : NULL;
+        } else if (strncasecmp_simple(trimmed, "#EXTIMG:", 8) == 0) {
+            value = strip_quotes(trim_spaces(value));
+            const char *art = value[0] ? resolve_entry(value, dir, h->art, sizeof(h->art)) : NULL;
+            if (!art) h->art[0] = '\0';
+            else if (art != h->art) snprintf(h->art, sizeof(h->art), "%s", art);
+        }
+        return true;
+    }
+
+    trimmed = strip_quotes(trimmed);
+    if (trimmed[0] == '\0') return true;
+
+    char resolved[M3U_MAX_PATH];
+    const char *path = resolve_entry(trimmed, dir, resolved, sizeof(resolved));
+    if (!path) return true;
+
+    PlaylistInfo info = { .duration = h->duration, .artist = h->artist ? h->artist : h->album_artist,
+                          .title = h->title, .album = h->album, .art = h->art[0] ? h->art : NULL };
+    bool has_info = info.duration > 0 || info.artist || info.title || info.album || info.art;
+    h->duration = 0;
+    h->artist = h->title = NULL;
+    return playlist_add_info(pl, path, has_info ? &info : NULL);
+}
+
+bool m3u_load(Playlist *pl, const char *path) {
+    FileData file;
+    if (!file_load(&file, path)) return false;
+
+    M3uEncoding enc;
+    size_t skip = detect_encoding(file.data, file.size, &enc);
+
+    // One writable UTF-8 copy of the whole playlist, edited in place below
+    char *text;
+    size_t len;
+    if (enc == M3U_UTF8) {
+        len = file.size - skip;
+        text = malloc(len + 1);
+        if (text) {
+            memcpy(text, file.data + skip, len);
+            text[len] = '\0';
+        }
+    } else {
+        text = utf16_to_utf8(file.data + skip, file.size - skip, enc == M3U_UTF16_LE, &len);
+    }
+    file_unload(&file);
+    if (!text) {
+        fprintf(stderr, "[MusicCore] Out of memory reading M3U %s\n", path);
+        return false;
+    }
+
+    char dir[M3U_MAX_PATH];
+    const char *last = strrchr(path, '/');
+    const char *last_bs = strrchr(path, '\\');
+    if (!last || (last_bs && last_bs > last)) last = last_bs;
+    if (last) {
+        size_t dir_len = (size_t)(last - path);
+        if (dir_len >= sizeof(dir)) dir_len = sizeof(dir) - 1;
+        memcpy(dir, path, dir_len);
+        dir[dir_len] = '\0';
+        for (char *c = dir; *c; c++) {
+            if (*c == '\\') *c = '/';
+        }
+    } else {
+        strcpy(dir, ".");
+    }
+
+    int before = pl->count;
+    M3uHints hints;
+    memset(&hints, 0, sizeof(hints));
+    char *p = text;
+    char *end = text + len;
+    while (p < end) {
+        char *eol = find_line_end(p, end);
+        *eol = '\0';
+        if (!add_line(pl, p, dir, &hints)) break;
+        p = eol + 1;
+    }
+    free(text);
+
+    fprintf(stderr, "[MusicCore] Read %d entries from %s M3U\n", pl->count - before,
+            enc == M3U_UTF8 ? "UTF-8" : "UTF-16");
+    return true;
+}
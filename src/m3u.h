@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+#include "playlist.h"
+
+// Append the entries of an M3U/M3U8 playlist to pl. The file is loaded in one
+// go; UTF-16 playlists (BOM or detected) are transcoded to UTF-8 first.
+// Relative entries and file:// URIs are resolved against the playlist's folder.
+// #EXTINF duration/text, #EXTALB, #EXTART and #EXTIMG are kept as entry details.
+// Returns false if the file cannot be read.
+bool m3u_load(Playlist *pl, const char *path);
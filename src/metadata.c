@@ -1,10 +1,44 @@
 #include "metadata.h"
+#include "thread.h"
+#include "fileio.h"
+#include "embedart.h"
+#include "artdir.h"
+#include "artcache.h"
+#include "video.h"
+#include "jpegscale.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include "dr_flac.h"
 
+#include "arena.h"
+
+// Scratch for stb_image and art decoding. Each load runs on one thread with
+// its own arena, reset when the load finishes.
+#define META_ARENA_LIMIT (32 * 1024 * 1024)
+static Arena load_arena = { .limit = META_ARENA_LIMIT };
+static Arena prefetch_arena = { .limit = META_ARENA_LIMIT };
+static _Thread_local Arena *image_arena = NULL;
+
+static void *image_malloc(size_t size) {
+    return image_arena ? arena_alloc(image_arena, size) : malloc(size);
+}
+
+static void *image_realloc(void *p, size_t size) {
+    return image_arena ? arena_realloc(image_arena, p, size) : realloc(p, size);
+}
+
+static void image_free(void *p) {
+    if (image_arena) arena_release(image_arena, p);
+    else free(p);
+}
+
+#define STBI_MALLOC(sz) image_malloc(sz)
+#define STBI_REALLOC(p, sz) image_realloc(p, sz)
+#define STBI_FREE(p) image_free(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -16,12 +50,15 @@ typedef struct {
    char **comment_list;
 } stb_vorbis_comment;
 
-extern stb_vorbis *stb_vorbis_open_filename(const char *filename, int *error, const stb_vorbis_alloc *alloc);
+extern stb_vorbis *stb_vorbis_open_memory(const unsigned char *data, int len, int *error, const stb_vorbis_alloc *alloc);
+extern stb_vorbis *stb_vorbis_open_file(FILE *f, int close_handle_on_close, int *error, const stb_vorbis_alloc *alloc);
 extern void stb_vorbis_close(stb_vorbis *f);
 extern stb_vorbis_comment stb_vorbis_get_comment(stb_vorbis *f);
 
-uint16_t *art_buffer = NULL;
+const uint8_t *art_buffer = NULL;
 int art_w_src = 0, art_h_src = 0;
+uint32_t art_serial = 0;
+static const ArtImage *shown_art = NULL;   // art_buffer's cache entry
 char display_str[256];
 
 typedef struct {
@@ -29,8 +66,50 @@ typedef struct {
     char *title;
     char *album;
     int maxlen;
+    FileStream stream;      // the file the blocks are read from
 } FlacMetaContext;
 
+// Display text, tag text and RGB888 art for one track
+typedef struct {
+    char display[256];
+    char artist[META_TAG_LEN], title[META_TAG_LEN], album[META_TAG_LEN];
+    bool has_tags;
+    const ArtImage *art;    // referenced from the art cache
+    char art_path[1024];    // file the art came from, empty for none or a FLAC picture
+    uint64_t art_offset;    // image start within art_path when embedded
+    size_t art_size;        // and its length
+    bool art_known;         // the art search ran (or the hint made it unnecessary)
+} TrackMeta;
+
+// Copy of a playlist entry's details, kept while a load runs
+typedef struct {
+    char artist[META_TAG_LEN], title[META_TAG_LEN], album[META_TAG_LEN];
+    char art[1024];
+    uint64_t art_offset;
+    size_t art_size;
+    bool tags_known, art_known;
+    bool cue_track;
+} TrackHint;
+
+// Background load of the upcoming track's metadata, adopted by metadata_load
+static struct {
+    Thread *thread;
+    char track_path[1024];
+    char m3u_base_path[1024];
+    TrackTextMode mode;
+    TrackTags *tags;
+    TrackHint hint;
+    bool has_hint;
+    TrackMeta meta;
+} prefetch;
+
+// Tag text of the track on screen, reused when the text mode changes
+static char current_path[1024];
+static TrackMeta current_meta;
+
+#define MP3_FRAME_READ 4096
+#define OGG_HEADERS_READ (1024 * 1024)     // Ogg headers read into memory when stdio cannot open the file
+
 static int strcasecmp_simple(const char *s1, const char *s2) {
     while (*s1 && *s2) {
         char c1 = (*s1 >= 'A' && *s1 <= 'Z') ? *s1 + 32 : *s1;
@@ -68,17 +147,17 @@ static const char *basename_ptr(const char *path) {
     return b ? b + 1 : path;
 }
 
-static void set_display_from_filename(const char *track_path, int strip_ext) {
+static void set_display_from_filename(char *display, size_t display_size, const char *track_path, int strip_ext) {
     const char *base = basename_ptr(track_path);
     size_t len = strlen(base);
     if (strip_ext) {
         const char *dot = strrchr(base, '.');
         if (dot && dot > base) len = (size_t)(dot - base);
     }
-    if (len > 250) len = 250;
-    memcpy(display_str, base, len);
-    display_str[len] = '\0';
-    strncat(display_str, "   ", sizeof(display_str) - strlen(display_str) - 1);
+    if (len > display_size - 6) len = display_size - 6;
+    memcpy(display, base, len);
+    display[len] = '\0';
+    strncat(display, "   ", display_size - strlen(display) - 1);
 }
 
 static void copy_value(char *dest, int maxlen, const char *value) {
@@ -105,18 +184,28 @@ static void maybe_store_tag(const char *entry, char *artist, char *title, char *
     }
 }
 
+// Only the header packets are read: from the file when stdio opens it, else
+// from its first OGG_HEADERS_READ bytes
 static int parse_ogg_vorbis_tags(const char *path, char *artist, char *title, char *album, int maxlen) {
+    FileStream stream;
+    FileData file = {0};
     int err = 0;
-    stb_vorbis *ogg = stb_vorbis_open_filename(path, &err, NULL);
-    if (!ogg) return 0;
-
-    stb_vorbis_comment comments = stb_vorbis_get_comment(ogg);
-    for (int i = 0; i < comments.comment_list_length; i++) {
-        const char *entry = comments.comment_list[i];
-        if (entry) maybe_store_tag(entry, artist, title, album, maxlen);
+    stb_vorbis *ogg = NULL;
+    if (file_stream_open(&stream, path, true))
+        ogg = stb_vorbis_open_file(stream.fp, 0, &err, NULL);
+    else if (file_load_head(&file, path, OGG_HEADERS_READ))
+        ogg = stb_vorbis_open_memory(file.data, (int)file.size, &err, NULL);
+    if (ogg) {
+        stb_vorbis_comment comments = stb_vorbis_get_comment(ogg);
+        for (int i = 0; i < comments.comment_list_length; i++) {
+            const char *entry = comments.comment_list[i];
+            if (entry) maybe_store_tag(entry, artist, title, album, maxlen);
+        }
+        stb_vorbis_close(ogg);
     }
-
-    stb_vorbis_close(ogg);
+    file_stream_close(&stream);
+    file_unload(&file);
+    if (!ogg) return 0;
     return (title[0] || artist[0]) ? 1 : 0;
 }
 
@@ -142,6 +231,21 @@ static void flac_meta_proc(void *pUserData, drflac_metadata *pMetadata) {
     }
 }
 
+static size_t flac_read(void *user, void *buf, size_t bytes) {
+    return file_stream_read(&((FlacMetaContext*)user)->stream, buf, bytes);
+}
+
+static drflac_bool32 flac_seek(void *user, int offset, drflac_seek_origin origin) {
+    return file_stream_seek(&((FlacMetaContext*)user)->stream, offset,
+                            origin == DRFLAC_SEEK_SET ? SEEK_SET : origin == DRFLAC_SEEK_END ? SEEK_END : SEEK_CUR);
+}
+
+static drflac_bool32 flac_tell(void *user, drflac_int64 *cursor) {
+    *cursor = file_stream_tell(&((FlacMetaContext*)user)->stream);
+    return *cursor >= 0;
+}
+
+// The metadata blocks are read through a stream, never the audio after them
 static int parse_flac_vorbis_tags(const char *path, char *artist, char *title, char *album, int maxlen) {
     FlacMetaContext ctx;
     ctx.artist = artist;
@@ -149,41 +253,27 @@ static int parse_flac_vorbis_tags(const char *path, char *artist, char *title, c
     ctx.album = album;
     ctx.maxlen = maxlen;
 
-    drflac *flac = drflac_open_file_with_metadata(path, flac_meta_proc, &ctx, NULL);
+    if (!file_stream_open(&ctx.stream, path, false)) return 0;
+    drflac *flac = drflac_open_with_metadata(flac_read, flac_seek, flac_tell, flac_meta_proc, &ctx, NULL);
+    if (flac) drflac_close(flac);
+    file_stream_close(&ctx.stream);
     if (!flac) return 0;
-    drflac_close(flac);
     return (title[0] || artist[0]) ? 1 : 0;
 }
 
-int parse_id3v2(const char* path, char* artist, char* title, char* album, int maxlen) {
-    FILE* f = fopen(path, "rb");
-    if (!f) return 0;
-
-    // 1. Read and validate header
-    unsigned char hdr[10];
-    if (fread(hdr, 1, 10, f) != 10 || memcmp(hdr, "ID3", 3) != 0) {
-        fclose(f);
-        return 0;
-    }
+// Parse text frames from an ID3v2 tag in memory (tag[0..2] == "ID3")
+static int parse_id3v2_buffer(const unsigned char *tag, size_t tag_len, char* artist, char* title, char* album, int maxlen) {
+    if (!tag || tag_len < 10 || memcmp(tag, "ID3", 3) != 0) return 0;
 
-    uint8_t version = hdr[3];  // 2, 3, or 4
-    uint8_t flags = hdr[5];
-
-    // 2. Parse syncsafe tag size
-    uint32_t tag_size = ((uint32_t)hdr[6] << 21) | ((uint32_t)hdr[7] << 14) |
-                        ((uint32_t)hdr[8] << 7) | hdr[9];
-
-    // 3. Read tag data (limit to 64KB for safety)
-    if (tag_size > 65536) tag_size = 65536;
-    unsigned char* data = malloc(tag_size);
-    if (!data) { fclose(f); return 0; }
-    size_t bytes_read = fread(data, 1, tag_size, f);
-    fclose(f);
+    uint8_t version = tag[3];  // 2, 3, or 4
+    uint8_t flags = tag[5];
+    const unsigned char *data = tag + 10;
+    size_t bytes_read = tag_len - 10;
 
     // 4. Skip extended header if present
     size_t pos = 0;
     if (flags & 0x40) {  // Extended header flag
-        if (bytes_read < 4) { free(data); return 0; }
+        if (bytes_read < 4) return 0;
         uint32_t ext_size;
         if (version == 4) {
             // ID3v2.4: syncsafe size
@@ -194,7 +284,7 @@ int parse_id3v2(const char* path, char* artist, char* title, char* album, int ma
             ext_size = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
                        ((uint32_t)data[2] << 8) | data[3];
         }
-        if (ext_size >= bytes_read) { free(data); return 0; }  // >= rejects malformed headers
+        if (ext_size >= bytes_read) return 0;  // >= rejects malformed headers
         pos = ext_size;
     }
 
@@ -230,9 +320,9 @@ int parse_id3v2(const char* path, char* artist, char* title, char* album, int ma
 
         if (frame_size == 0 || frame_size > bytes_read - pos - header_size) break;
 
-        unsigned char* content = &data[pos + header_size];
+        const unsigned char* content = &data[pos + header_size];
         uint8_t encoding = content[0];
-        char* text = (char*)&content[1];
+        const char* text = (const char*)&content[1];
         int text_len = frame_size - 1;
 
         // 6. Match frame ID (v2.2 uses 3-char IDs, v2.3/2.4 use 4-char)
@@ -263,84 +353,369 @@ int parse_id3v2(const char* path, char* artist, char* title, char* album, int ma
         pos += header_size + frame_size;
     }
 
-    free(data);
     return (title[0] || artist[0]) ? 1 : 0;
 }
 
-void metadata_free_art(void) {
-    if (art_buffer) {
-        free(art_buffer);
-        art_buffer = NULL;
+// Tag size of an ID3v2 header at data, 0 if there is none
+static uint32_t id3v2_tag_size(const unsigned char *data, size_t size) {
+    if (size < 10 || memcmp(data, "ID3", 3) != 0) return 0;
+    return ((uint32_t)data[6] << 21) | ((uint32_t)data[7] << 14) | ((uint32_t)data[8] << 7) | data[9];
+}
+
+int parse_id3v2(const char* path, char* artist, char* title, char* album, int maxlen) {
+    // Tag size limited to 64KB for safety
+    FileData file;
+    if (!file_load_head(&file, path, 10 + 65536)) return 0;
+
+    int found = 0;
+    if (file.size >= 10 && memcmp(file.data, "ID3", 3) == 0) {
+        uint32_t tag_size = id3v2_tag_size(file.data, file.size);
+        if (tag_size > 65536) tag_size = 65536;
+        size_t len = (10 + (size_t)tag_size < file.size) ? 10 + (size_t)tag_size : file.size;
+        found = parse_id3v2_buffer(file.data, len, artist, title, album, maxlen);
     }
+    file_unload(&file);
+    return found;
 }
 
-static void metadata_build_display(const char *track_path, TrackTextMode track_text_mode, char *album_out, size_t album_out_size) {
-    char meta_title[64] = {0};
-    char meta_artist[64] = {0};
-    char cur_album[64] = {0};
-
-    if (track_text_mode == SHOW_ID) {
-        const char *ext = strrchr(track_path, '.');
-        int found = parse_id3v2(track_path, meta_artist, meta_title, cur_album, (int)sizeof(meta_title));
-        if (!found && ext && strcasecmp_simple(ext, ".ogg") == 0)
-            found = parse_ogg_vorbis_tags(track_path, meta_artist, meta_title, cur_album, (int)sizeof(meta_title));
-        if (!found && ext && strcasecmp_simple(ext, ".flac") == 0)
-            found = parse_flac_vorbis_tags(track_path, meta_artist, meta_title, cur_album, (int)sizeof(meta_title));
-
-        if (!found && ext && strcasecmp_simple(ext, ".mp3") == 0) {
-            // Fall back to ID3v1 for MP3s.
-            FILE* f = fopen(track_path, "rb");
-            if (f) {
-                if (fseek(f, -128, SEEK_END) == 0) {
-                    char tag[3];
-                    size_t r = fread(tag, 1, 3, f);
-                    if (r == 3 && strncmp(tag, "TAG", 3) == 0) {
-                        fread(meta_title, 1, 30, f);
-                        fread(meta_artist, 1, 30, f);
-                        fread(cur_album, 1, 30, f);
-                        meta_title[30] = '\0';
-                        meta_artist[30] = '\0';
-                        cur_album[30] = '\0';
-                    }
-                }
-                fclose(f);
+TrackTags *metadata_tags_create(const char *path) {
+    TrackTags *t = calloc(1, sizeof(TrackTags));
+    if (t) snprintf(t->path, sizeof(t->path), "%s", path);
+    return t;
+}
+
+void metadata_tags_free(TrackTags *t) {
+    if (!t) return;
+    free(t->picture);
+    free(t);
+}
+
+void metadata_tags_add_comment(TrackTags *t, const char *entry, size_t len) {
+    static const char picture_key[] = "METADATA_BLOCK_PICTURE=";
+    size_t key_len = sizeof(picture_key) - 1;
+    if (len > key_len && strncasecmp_simple(entry, picture_key, key_len) == 0) {
+        EmbeddedArt art;
+        if (!t->picture && embedart_from_comment(entry + key_len, len - key_len, &art)) {
+            metadata_tags_set_picture(t, art.data, art.size);
+            embedart_free(&art);
+        }
+        return;
+    }
+    char buf[512];
+    if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+    memcpy(buf, entry, len);
+    buf[len] = '\0';
+    maybe_store_tag(buf, t->artist, t->title, t->album, META_TAG_LEN);
+}
+
+void metadata_tags_set_picture(TrackTags *t, const void *data, size_t size) {
+    if (t->picture || !data || size == 0) return;
+    t->picture = malloc(size);
+    if (!t->picture) return;
+    memcpy(t->picture, data, size);
+    t->picture_size = size;
+}
+
+bool metadata_tags_read_mp3(TrackTags *t, const unsigned char *data, size_t size, bool whole_file) {
+    if (!data || size == 0) return false;
+
+    // ID3v2 tag, parsed where it lies
+    size_t audio_start = 0;
+    bool cut = false;
+    if (size >= 10 && memcmp(data, "ID3", 3) == 0) {
+        uint32_t tag_size = id3v2_tag_size(data, size);
+        audio_start = 10 + (size_t)tag_size + ((data[5] & 0x10) ? 10 : 0);
+        cut = tag_size > size - 10;
+        t->id3_size = 10 + (cut ? size - 10 : tag_size);
+    }
+
+    // First audio frame, for the Xing/LAME gapless header
+    if (audio_start < size) {
+        t->frame_offset = audio_start;
+        t->frame_size = (size - audio_start < MP3_FRAME_READ) ? size - audio_start : MP3_FRAME_READ;
+    }
+
+    // Only a picture that unsynchronisation altered has to be copied out
+    EmbeddedArt art;
+    if (t->id3_size && embedart_from_id3(data, t->id3_size, &art)) {
+        if (art.offset) {
+            t->art_offset = art.offset;
+            t->art_size = art.size;
+        } else {
+            metadata_tags_set_picture(t, art.data, art.size);
+        }
+        embedart_free(&art);
+    }
+
+    // ID3v1 tail
+    const char *v1 = (whole_file && size >= 128) ? (const char*)data + size - 128 : NULL;
+    bool has_v1 = v1 && memcmp(v1, "TAG", 3) == 0;
+
+    int found = t->id3_size ? parse_id3v2_buffer(data, t->id3_size, t->artist, t->title, t->album, META_TAG_LEN) : 0;
+    if (!found && has_v1) {
+        memcpy(t->title, v1 + 3, 30);
+        memcpy(t->artist, v1 + 33, 30);
+        memcpy(t->album, v1 + 63, 30);
+        t->title[30] = '\0';
+        t->artist[30] = '\0';
+        t->album[30] = '\0';
+    }
+    // A tag cut short may hold the picture or text further on
+    t->complete = !cut && (found || whole_file);
+    return true;
+}
+
+void metadata_free_art(void) {
+    artcache_release(shown_art);
+    shown_art = NULL;
+    art_buffer = NULL;
+    art_w_src = art_h_src = 0;
+    art_serial++;
+}
+
+void metadata_read_tags(const char *track_path, char *artist, char *title, char *album) {
+    artist[0] = title[0] = album[0] = '\0';
+
+    const char *ext = strrchr(track_path, '.');
+    int found = parse_id3v2(track_path, artist, title, album, META_TAG_LEN);
+    if (!found && ext && strcasecmp_simple(ext, ".ogg") == 0)
+        found = parse_ogg_vorbis_tags(track_path, artist, title, album, META_TAG_LEN);
+    if (!found && ext && strcasecmp_simple(ext, ".flac") == 0)
+        found = parse_flac_vorbis_tags(track_path, artist, title, album, META_TAG_LEN);
+
+    if (!found && ext && strcasecmp_simple(ext, ".mp3") == 0) {
+        // Fall back to ID3v1 for MP3s.
+        FileData file;
+        if (file_load_tail(&file, track_path, 128)) {
+            const char *tag = (file.size == 128) ? (const char*)file.data : NULL;
+            if (tag && strncmp(tag, "TAG", 3) == 0) {
+                memcpy(title, tag + 3, 30);
+                memcpy(artist, tag + 33, 30);
+                memcpy(album, tag + 63, 30);
+                title[30] = '\0';
+                artist[30] = '\0';
+                album[30] = '\0';
             }
+            file_unload(&file);
         }
     }
 
-    clean_meta_text(meta_title);
-    clean_meta_text(meta_artist);
-    clean_meta_text(cur_album);
+    clean_meta_text(title);
+    clean_meta_text(artist);
+    clean_meta_text(album);
+}
 
+// Fill the tag text from tags captured by the audio worker, or by reading the file
+static void read_tag_text(TrackMeta *m, const char *track_path, const TrackTags *tags) {
+    if (tags && tags->complete) {
+        memcpy(m->artist, tags->artist, sizeof(m->artist));
+        memcpy(m->title, tags->title, sizeof(m->title));
+        memcpy(m->album, tags->album, sizeof(m->album));
+        clean_meta_text(m->title);
+        clean_meta_text(m->artist);
+        clean_meta_text(m->album);
+    } else {
+        metadata_read_tags(track_path, m->artist, m->title, m->album);
+    }
+    m->has_tags = true;
+}
+
+// Returns false when info has nothing metadata can use
+static bool copy_hint(TrackHint *h, const PlaylistInfo *info) {
+    memset(h, 0, sizeof(*h));
+    if (!info) return false;
+    snprintf(h->artist, sizeof(h->artist), "%s", info->artist ? info->artist : "");
+    snprintf(h->title, sizeof(h->title), "%s", info->title ? info->title : "");
+    snprintf(h->album, sizeof(h->album), "%s", info->album ? info->album : "");
+    snprintf(h->art, sizeof(h->art), "%s", info->art ? info->art : "");
+    h->art_offset = info->art_offset;
+    h->art_size = info->art_size <= SIZE_MAX ? (size_t)info->art_size : 0;
+    h->tags_known = info->tags_known;
+    h->art_known = info->art_known;
+    h->cue_track = info->cue_track;
+    return h->title[0] || h->album[0] || h->art[0] || h->tags_known || h->art_known || h->cue_track;
+}
+
+// Fill tag text the file did not give from the playlist. A CUE track's text
+// wins: the tags of its file describe the whole album.
+static void apply_hint_text(TrackMeta *m, const TrackHint *h) {
+    if (!h->title[0] && !h->tags_known) return;
+    if (!m->title[0] || (h->cue_track && h->title[0])) memcpy(m->title, h->title, sizeof(m->title));
+    if (!m->artist[0] || (h->cue_track && h->artist[0])) memcpy(m->artist, h->artist, sizeof(m->artist));
+    if (!m->album[0] || (h->cue_track && h->album[0])) memcpy(m->album, h->album, sizeof(m->album));
+    m->has_tags = true;
+}
+
+static void metadata_build_display(TrackMeta *m, const char *track_path, TrackTextMode track_text_mode) {
     if (track_text_mode == SHOW_FILENAME_WITH_EXT) {
-        set_display_from_filename(track_path, 0);
+        set_display_from_filename(m->display, sizeof(m->display), track_path, 0);
     } else if (track_text_mode == SHOW_FILENAME_WITHOUT_EXT) {
-        set_display_from_filename(track_path, 1);
-    } else if (meta_title[0] != 0 && meta_artist[0] != 0) {
-        snprintf(display_str, sizeof(display_str), "%s - %s   ", meta_artist, meta_title);
-    } else if (meta_title[0] != 0) {
-        snprintf(display_str, sizeof(display_str), "%s   ", meta_title);
+        set_display_from_filename(m->display, sizeof(m->display), track_path, 1);
+    } else if (m->title[0] != 0 && m->artist[0] != 0) {
+        snprintf(m->display, sizeof(m->display), "%s - %s   ", m->artist, m->title);
+    } else if (m->title[0] != 0) {
+        snprintf(m->display, sizeof(m->display), "%s   ", m->title);
     } else {
-        set_display_from_filename(track_path, 0);
+        set_display_from_filename(m->display, sizeof(m->display), track_path, 0);
+    }
+}
+
+void metadata_refresh_display(const char *track_path, TrackTextMode track_text_mode, const PlaylistInfo *info) {
+    if (strcmp(current_path, track_path) != 0) {
+        memset(&current_meta, 0, sizeof(current_meta));
+        snprintf(current_path, sizeof(current_path), "%s", track_path);
+    }
+    if (track_text_mode == SHOW_ID && !current_meta.has_tags) {
+        // Only open the file when the playlist (or the prescan) has no text for it
+        TrackHint hint;
+        if (copy_hint(&hint, info) && (hint.title[0] || hint.tags_known)) apply_hint_text(&current_meta, &hint);
+        else read_tag_text(&current_meta, track_path, NULL);
+    }
+    metadata_build_display(&current_meta, track_path, track_text_mode);
+    memcpy(display_str, current_meta.display, sizeof(display_str));
+}
+
+static void *jpeg_malloc(size_t size, void *user) {
+    (void)user;
+    return image_malloc(size);
+}
+
+static void jpeg_free(void *p, void *user) {
+    (void)user;
+    image_free(p);
+}
+
+// Decode to RGB888 (freed with stbi_image_free). A JPEG larger than the
+// screen is decoded at 1/2, 1/4 or 1/8 size from its DCT blocks instead.
+static unsigned char *decode_image(const unsigned char *data, size_t size, int *w, int *h) {
+    if (size > INT_MAX) return NULL;
+    JpegAllocator alloc = { NULL, jpeg_malloc, jpeg_free };
+    unsigned char *img = jpegscale_decode(data, size, FB_WIDTH, FB_HEIGHT, w, h, &alloc);
+    if (img) return img;
+    return stbi_load_from_memory(data, (int)size, w, h, NULL, 3);
+}
+
+// Store decoded RGB888 (freed) in the art cache under key. Art is never drawn
+// larger than the screen, so a larger image is shrunk to fit it, keeping its shape.
+static const ArtImage *store_art(const char *key, unsigned char *img, int img_w, int img_h) {
+    if (!img) return NULL;
+    uint8_t *rgb = NULL;
+    int w = img_w, h = img_h;
+    if (w > FB_WIDTH) {
+        h = (int)((int64_t)h * FB_WIDTH / w);
+        w = FB_WIDTH;
+    }
+    if (h > FB_HEIGHT) {
+        w = (int)((int64_t)w * FB_HEIGHT / h);
+        h = FB_HEIGHT;
     }
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+    if (img_w > 0 && img_h > 0 && img_w <= 4096 && img_h <= 4096) {
+        rgb = malloc((size_t)w * h * 3);
+        if (rgb && (w != img_w || h != img_h)) video_shrink_rgb888(img, img_w, img_h, rgb, w, h);
+        else if (rgb) memcpy(rgb, img, (size_t)w * h * 3);
+    }
+    stbi_image_free(img);
+    return rgb ? artcache_put(key, rgb, w, h) : NULL;
+}
 
-    if (album_out && album_out_size > 0) {
-        strncpy(album_out, cur_album, album_out_size - 1);
-        album_out[album_out_size - 1] = '\0';
+// Decode an image file (art candidates) unless the cache has it from an
+// earlier track. NULL if it does not exist.
+static const ArtImage *load_image_file(const char *path) {
+    // A changed file is a new key
+    struct stat st;
+    if (stat(path, &st) != 0) return NULL;
+    char key[1100];
+    snprintf(key, sizeof(key), "%s:%lld:%lld", path, (long long)st.st_size, (long long)st.st_mtime);
+    const ArtImage *art = artcache_get(key);
+    if (art) return art;
+
+    FileData file;
+    if (!file_load(&file, path)) return NULL;
+    int img_w = 0, img_h = 0;
+    unsigned char *img = decode_image(file.data, file.size, &img_w, &img_h);
+    file_unload(&file);
+    return store_art(key, img, img_w, img_h);
+}
+
+// Decode an embedded picture, found in the cache by its bytes when another
+// track (of the same album, usually) carries the same one
+static const ArtImage *load_embedded_image(const unsigned char *data, size_t size) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++) {
+        h ^= data[i];
+        h *= 1099511628211ULL;
     }
+    char key[64];
+    snprintf(key, sizeof(key), "#%016llx:%zu", (unsigned long long)h, size);
+    const ArtImage *art = artcache_get(key);
+    if (art) return art;
+
+    int img_w = 0, img_h = 0;
+    unsigned char *img = decode_image(data, size, &img_w, &img_h);
+    return store_art(key, img, img_w, img_h);
 }
 
-void metadata_refresh_display(const char *track_path, TrackTextMode track_text_mode) {
-    metadata_build_display(track_path, track_text_mode, NULL, 0);
+// Decode the picture stored size bytes long, offset bytes into a track,
+// reading only those bytes
+static const ArtImage *load_image_span(const char *path, uint64_t offset, size_t size) {
+    FileData file;
+    if (!file_load_range(&file, path, offset, size)) return NULL;
+    const ArtImage *art = file.size == size ? load_embedded_image(file.data, file.size) : NULL;
+    file_unload(&file);
+    return art;
 }
 
-void metadata_load(const char *track_path, const char *m3u_base_path, TrackTextMode track_text_mode) {
-    char cur_album[64] = {0};
-    metadata_build_display(track_path, track_text_mode, cur_album, sizeof(cur_album));
+// Folder of path ("." when it names none) and its file name without the extension
+static void split_path(const char *path, char *dir, size_t dir_size, char *name, size_t name_size) {
+    const char *slash = strrchr(path, '/');
+    const char *bs = strrchr(path, '\\');
+    if (bs && (!slash || bs > slash)) slash = bs;
+    if (!slash) snprintf(dir, dir_size, ".");
+    else if (slash == path) snprintf(dir, dir_size, "/");
+    else snprintf(dir, dir_size, "%.*s", (int)(slash - path), path);
+    const char *base = slash ? slash + 1 : path;
+    const char *dot = strrchr(base, '.');
+    snprintf(name, name_size, "%.*s", dot ? (int)(dot - base) : (int)strlen(base), base);
+}
+
+// Decode dir/name.ext when the folder has it, in any letter case
+static const ArtImage *find_art(const char *dir, const char *name, const char *ext, char *path, size_t path_size) {
+    if (!name[0] || !artdir_find(dir, name, ext, path, path_size)) return NULL;
+    return load_image_file(path);
+}
+
+static void load_track_meta(TrackMeta *m, const char *track_path, const char *m3u_base_path, TrackTextMode track_text_mode,
+                            const TrackTags *tags, const TrackHint *hint, Arena *arena) {
+    memset(m, 0, sizeof(*m));
+    image_arena = arena;
+    // Captured tags are free to use, then the playlist's text; otherwise only
+    // read the file when the text needs them
+    bool hint_text = hint && (hint->title[0] || hint->tags_known);
+    if ((tags && tags->complete) || (track_text_mode == SHOW_ID && !hint_text))
+        read_tag_text(m, track_path, tags);
+    if (hint) apply_hint_text(m, hint);
+    metadata_build_display(m, track_path, track_text_mode);
+    const char *cur_album = (track_text_mode == SHOW_ID) ? m->album : "";
+    if (hint && hint->album[0]) cur_album = hint->album;
 
     // --- Load Artwork (The 5 Location Search) ---
-    metadata_free_art();
-    unsigned char* img_data = NULL;
+    const ArtImage *img = NULL;
+
+    // 0. Cover named by the playlist (#EXTIMG) or found last time (playlist index)
+    if (hint && hint->art[0]) {
+        img = hint->art_size ? load_image_span(hint->art, hint->art_offset, hint->art_size)
+                             : load_image_file(hint->art);
+        if (img) {
+            snprintf(m->art_path, sizeof(m->art_path), "%s", hint->art);
+            m->art_offset = hint->art_offset;
+            m->art_size = hint->art_size;
+        }
+    }
+    // Known to have no cover file: only what the decoder captured is looked
+    // at. A remembered cover that no longer loads is searched for again.
+    bool search = !(hint && hint->art_known) || (hint->art[0] && !img);
     char path_buf[1024];
     const char* exts[] = { ".jpg", ".jpeg", ".png", ".bmp" };
 
@@ -358,90 +733,160 @@ void metadata_load(const char *track_path, const char *m3u_base_path, TrackTextM
         parent_name[sizeof(parent_name) - 1] = '\0';
     }
 
-    // B. Main Search Loop
-    for (int i = 0; i < 4 && !img_data; i++) {
+    char track_dir[1024], track_name[256], m3u_dir[1024], m3u_name[256];
+    split_path(track_path, track_dir, sizeof(track_dir), track_name, sizeof(track_name));
+    bool has_m3u = m3u_base_path && m3u_base_path[0];
+    if (has_m3u) split_path(m3u_base_path, m3u_dir, sizeof(m3u_dir), m3u_name, sizeof(m3u_name));
+
+    // B. Main Search Loop, names looked up in each folder's cached listing
+    static const char *const cover_names[] = { "cover", "folder", "front" };
+    for (int i = 0; i < 4 && !img && search; i++) {
         // 1. Same name as MP3 (e.g., C:/Music/Song.jpg)
-        const char* dot = strrchr(track_path, '.');
-        if (dot) {
-            int base_len = (int)(dot - track_path);
-            if (base_len < 0) base_len = 0;
-            snprintf(path_buf, sizeof(path_buf), "%.*s%s", base_len, track_path, exts[i]);
-        } else {
-            snprintf(path_buf, sizeof(path_buf), "%s%s", track_path, exts[i]);
-        }
-        img_data = stbi_load(path_buf, &art_w_src, &art_h_src, NULL, 3);
-        if (img_data) break;
+        if ((img = find_art(track_dir, track_name, exts[i], path_buf, sizeof(path_buf)))) break;
 
         if (music_dir[0]) {
             // 2. Name of Parent Folder (e.g., C:/Music/AlbumName/AlbumName.jpg)
-            snprintf(path_buf, sizeof(path_buf), "%s/%s%s", music_dir, parent_name, exts[i]);
-            img_data = stbi_load(path_buf, &art_w_src, &art_h_src, NULL, 3);
-            if (img_data) break;
+            if ((img = find_art(track_dir, parent_name, exts[i], path_buf, sizeof(path_buf)))) break;
 
             // 3. Album Name from Metadata (e.g., C:/Music/AlbumName/MetadataAlbum.jpg)
-            if (cur_album[0]) {
-                snprintf(path_buf, sizeof(path_buf), "%s/%s%s", music_dir, cur_album, exts[i]);
-                img_data = stbi_load(path_buf, &art_w_src, &art_h_src, NULL, 3);
-                if (img_data) break;
-            }
+            if ((img = find_art(track_dir, cur_album, exts[i], path_buf, sizeof(path_buf)))) break;
         }
 
-        // 4. Same name as M3U file (e.g., if playlist is Playlist.m3u, looks for Playlist.jpg)
-        if (m3u_base_path && m3u_base_path[0]) {
-            const char* m3u_dot = strrchr(m3u_base_path, '.');
-            if (m3u_dot) {
-                int base_len = (int)(m3u_dot - m3u_base_path);
-                if (base_len < 0) base_len = 0;
-                snprintf(path_buf, sizeof(path_buf), "%.*s%s", base_len, m3u_base_path, exts[i]);
-            } else {
-                snprintf(path_buf, sizeof(path_buf), "%s%s", m3u_base_path, exts[i]);
-            }
-            img_data = stbi_load(path_buf, &art_w_src, &art_h_src, NULL, 3);
-            if (img_data) break;
-        }
+        // 4. The usual cover names (e.g., C:/Music/AlbumName/cover.jpg)
+        for (int n = 0; n < 3 && !img; n++)
+            img = find_art(track_dir, cover_names[n], exts[i], path_buf, sizeof(path_buf));
+        if (img) break;
+
+        // 5. Same name as M3U file (e.g., if playlist is Playlist.m3u, looks for Playlist.jpg)
+        if (has_m3u && (img = find_art(m3u_dir, m3u_name, exts[i], path_buf, sizeof(path_buf))))
+            break;
     }
 
-    // 5. Files Metadata (Aggressive APIC/PIC Scan)
-    if (!img_data) {
-        FILE* f_art = fopen(track_path, "rb");
-        if (f_art) {
-            // Scan 1MB: embedded art is often large and offset deep in the header
-            size_t scan_size = 1024 * 1024;
-            unsigned char* head = malloc(scan_size);
-            if (head) {
-                size_t bytes_read = fread(head, 1, scan_size, f_art);
-
-                // Scan for embedded JPEG/PNG by magic bytes
-                for (size_t i = 0; i + 10 < bytes_read; i++) {
-                    // Check for JPEG (FF D8 FF)
-                    if (head[i] == 0xFF && head[i+1] == 0xD8 && head[i+2] == 0xFF) {
-                        img_data = stbi_load_from_memory(head + i, (int)(bytes_read - i), &art_w_src, &art_h_src, NULL, 3);
-                        if (img_data) break;
-                    }
-                    // Check for PNG (89 50 4E 47)
-                    if (head[i] == 0x89 && head[i+1] == 0x50 && head[i+2] == 0x4E && head[i+3] == 0x47) {
-                        img_data = stbi_load_from_memory(head + i, (int)(bytes_read - i), &art_w_src, &art_h_src, NULL, 3);
-                        if (img_data) break;
-                    }
-                }
-                free(head);
-            }
-            fclose(f_art);
+    if (img && !m->art_path[0]) snprintf(m->art_path, sizeof(m->art_path), "%s", path_buf);
+
+    // 6. Picture in the track's tags: from what the decoder captured, or read
+    // from the file when it did not get to them
+    if (!img) {
+        EmbeddedArt art;
+        memset(&art, 0, sizeof(art));
+        bool found = false;
+        if (tags && tags->art_size) {
+            // Where the decoder saw it in the file
+            art.offset = tags->art_offset;
+            art.size = tags->art_size;
+            img = load_image_span(track_path, art.offset, art.size);
+        } else if (tags && tags->picture) {
+            art.data = tags->picture;
+            art.size = tags->picture_size;
+            found = true;
+        } else if (search && (!tags || !tags->complete || tags->picture_unread)) {
+            found = embedart_read(track_path, &art);
         }
+        if (found) img = load_embedded_image(art.data, art.size);
+        // Stored as is in the file: the next load can decode it from there
+        if (img && art.offset) {
+            snprintf(m->art_path, sizeof(m->art_path), "%s", track_path);
+            m->art_offset = art.offset;
+            m->art_size = art.size;
+        }
+        if (found) embedart_free(&art);
     }
+    m->art_known = true;
 
-    // Prepare for Rendering (RGB565)
-    if (img_data) {
-        if (art_w_src > 0 && art_h_src > 0 && art_w_src <= 4096 && art_h_src <= 4096) {
-            size_t art_size = (size_t)art_w_src * art_h_src * 2;
-            art_buffer = malloc(art_size);
-            if (art_buffer) {
-                for (int i = 0; i < art_w_src * art_h_src; i++) {
-                    uint8_t r = img_data[i*3], g = img_data[i*3+1], b = img_data[i*3+2];
-                    art_buffer[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
-                }
-            }
-        }
-        stbi_image_free(img_data);
+    m->art = img;
+    image_arena = NULL;
+    arena_reset(arena);
+}
+
+static void prefetch_worker(void *arg) {
+    (void)arg;
+    load_track_meta(&prefetch.meta, prefetch.track_path, prefetch.m3u_base_path, prefetch.mode, prefetch.tags,
+                    prefetch.has_hint ? &prefetch.hint : NULL, &prefetch_arena);
+}
+
+void metadata_cancel_prefetch(void) {
+    if (!prefetch.thread) return;
+    thread_join(prefetch.thread);
+    prefetch.thread = NULL;
+    metadata_tags_free(prefetch.tags);
+    prefetch.tags = NULL;
+    artcache_release(prefetch.meta.art);
+    prefetch.meta.art = NULL;
+}
+
+void metadata_prefetch(const char *track_path, const char *m3u_base_path, TrackTextMode track_text_mode,
+                       TrackTags *tags, const PlaylistInfo *info) {
+    metadata_cancel_prefetch();
+
+    snprintf(prefetch.track_path, sizeof(prefetch.track_path), "%s", track_path);
+    snprintf(prefetch.m3u_base_path, sizeof(prefetch.m3u_base_path), "%s", m3u_base_path ? m3u_base_path : "");
+    prefetch.mode = track_text_mode;
+    prefetch.tags = tags;
+    prefetch.has_hint = copy_hint(&prefetch.hint, info);
+    memset(&prefetch.meta, 0, sizeof(prefetch.meta));
+    prefetch.thread = thread_create(prefetch_worker, NULL);
+    if (!prefetch.thread) {
+        metadata_tags_free(tags);
+        prefetch.tags = NULL;
+    }
+}
+
+void metadata_load(const char *track_path, const char *m3u_base_path, TrackTextMode track_text_mode,
+                   TrackTags *tags, const PlaylistInfo *info) {
+    TrackMeta m;
+    TrackHint hint;
+    bool has_hint = copy_hint(&hint, info);
+
+    // CUE tracks share their file, so the details have to match as well
+    if (prefetch.thread &&
+        prefetch.mode == track_text_mode &&
+        strcmp(prefetch.track_path, track_path) == 0 &&
+        strcmp(prefetch.m3u_base_path, m3u_base_path ? m3u_base_path : "") == 0 &&
+        prefetch.has_hint == has_hint && (!has_hint || memcmp(&prefetch.hint, &hint, sizeof(hint)) == 0)) {
+        thread_join(prefetch.thread);
+        prefetch.thread = NULL;
+        m = prefetch.meta;
+        prefetch.meta.art = NULL;
+        metadata_tags_free(prefetch.tags);
+        prefetch.tags = NULL;
+    } else {
+        metadata_cancel_prefetch();
+        load_track_meta(&m, track_path, m3u_base_path, track_text_mode, tags, has_hint ? &hint : NULL, &load_arena);
     }
+    metadata_tags_free(tags);
+
+    metadata_free_art();
+    shown_art = m.art;
+    art_buffer = m.art ? m.art->rgb : NULL;
+    art_w_src = m.art ? m.art->w : 0;
+    art_h_src = m.art ? m.art->h : 0;
+    art_serial++;
+    memcpy(display_str, m.display, sizeof(display_str));
+
+    current_meta = m;
+    current_meta.art = NULL;
+    snprintf(current_path, sizeof(current_path), "%s", track_path);
+}
+
+void metadata_get_info(PlaylistInfo *info) {
+    memset(info, 0, sizeof(*info));
+    if (current_meta.has_tags) {
+        info->artist = current_meta.artist;
+        info->title = current_meta.title;
+        info->album = current_meta.album;
+        info->tags_known = true;
+    }
+    info->art = current_meta.art_path[0] ? current_meta.art_path : NULL;
+    info->art_offset = current_meta.art_offset;
+    info->art_size = current_meta.art_size;
+    info->art_known = current_meta.art_known;
+}
+
+void metadata_deinit(void) {
+    metadata_cancel_prefetch();
+    metadata_free_art();
+    arena_destroy(&load_arena);
+    arena_destroy(&prefetch_arena);
+    load_arena.limit = META_ARENA_LIMIT;
+    prefetch_arena.limit = META_ARENA_LIMIT;
 }
@@ -1,24 +1,84 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "config.h"
+#include "playlist.h"
 
-// Album art buffer (RGB565)
-extern uint16_t *art_buffer;
+// Album art buffer (RGB888), fitted within the framebuffer's size
+extern const uint8_t *art_buffer;
 extern int art_w_src, art_h_src;
+extern uint32_t art_serial;     // changes whenever art_buffer does
 
 // Display metadata
 extern char display_str[256];
 
+#define META_TAG_LEN 64
+
+// Tags captured while the audio worker opens a track, so metadata does not
+// have to open the file again
+typedef struct {
+    char path[1024];
+    char artist[META_TAG_LEN], title[META_TAG_LEN], album[META_TAG_LEN];
+    bool complete;                  // every tag source has been read
+    size_t id3_size;                // MP3: length of the ID3v2 tag at the start of the file, header included
+    size_t frame_offset;            // MP3: span from the first audio frame (Xing/LAME)
+    size_t frame_size;
+    uint64_t art_offset;            // MP3: where the tag's picture is stored in the file
+    size_t art_size;                // 0 when there is none (or it is in picture)
+    unsigned char *picture;         // FLAC: PICTURE block image data
+    size_t picture_size;
+    bool picture_unread;            // a PICTURE block exists but the decoder did not load it
+} TrackTags;
+
+TrackTags *metadata_tags_create(const char *path);
+void metadata_tags_free(TrackTags *t);
+
+// Store a Vorbis comment ("KEY=value", not NUL terminated)
+void metadata_tags_add_comment(TrackTags *t, const char *entry, size_t len);
+
+// Keep a copy of embedded picture data (first one wins)
+void metadata_tags_set_picture(TrackTags *t, const void *data, size_t size);
+
+// Parse an MP3's tags from the file contents the decoder was opened on, and
+// note where its ID3v2 tag, first audio frame and picture are in them. Unless
+// whole_file is set, data is only the start of the file: without ID3v2 text
+// the tags are left incomplete, as an ID3v1 tag would be at the end.
+bool metadata_tags_read_mp3(TrackTags *t, const unsigned char *data, size_t size, bool whole_file);
+
 // Parse ID3v2 tags, returns 1 if found
 int parse_id3v2(const char* path, char* artist, char* title, char* album, int maxlen);
 
 // Load metadata and album art for a track
-// Sets display_str and loads art_buffer
-void metadata_load(const char *track_path, const char *m3u_base_path, TrackTextMode track_text_mode);
+// Sets display_str and loads art_buffer. tags (may be NULL) is consumed.
+// info (may be NULL) holds the playlist's text and cover for the track; when
+// given, the file is not read for tags nor art candidates searched.
+void metadata_load(const char *track_path, const char *m3u_base_path, TrackTextMode track_text_mode,
+                   TrackTags *tags, const PlaylistInfo *info);
 
-// Refresh display_str for a track without reloading album art
-void metadata_refresh_display(const char *track_path, TrackTextMode track_text_mode);
+// Start loading a track's metadata and art in the background so a later
+// metadata_load for the same track only has to swap it in. tags (may be NULL) is consumed.
+void metadata_prefetch(const char *track_path, const char *m3u_base_path, TrackTextMode track_text_mode,
+                       TrackTags *tags, const PlaylistInfo *info);
+
+// Wait for and drop any pending prefetch
+void metadata_cancel_prefetch(void);
+
+// Refresh display_str for a track without reloading album art. info (may be
+// NULL) is the entry's details, used instead of reading the file for tags.
+void metadata_refresh_display(const char *track_path, TrackTextMode track_text_mode, const PlaylistInfo *info);
+
+// Read a file's tag text (META_TAG_LEN buffers, empty when missing). Safe to
+// call from any thread.
+void metadata_read_tags(const char *track_path, char *artist, char *title, char *album);
+
+// What the last load learned about the track on screen (tags, where its art
+// is), for the playlist index. Strings stay valid until the next load.
+void metadata_get_info(PlaylistInfo *info);
 
 // Free album art buffer
 void metadata_free_art(void);
+
+// Drop any prefetch, the art buffer and the load arenas
+void metadata_deinit(void);
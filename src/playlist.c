@@ -0,0 +1,143 @@
+#include "playlist.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAYLIST_MIN_TRACKS 64
+#define PLAYLIST_MIN_STRINGS (16 * 1024)
+#define PLAYLIST_NO_TEXT UINT32_MAX
+
+// Per-entry details, strings as offsets into the shared buffer
+struct PlaylistEntryInfo {
+    int32_t duration;
+    uint32_t artist, title, album, art;
+    uint32_t cue_start, cue_end;
+    bool cue_track;
+};
+
+static void clear_entry_info(PlaylistEntryInfo *e) {
+    memset(e, 0, sizeof(*e));
+    e->artist = e->title = e->album = e->art = PLAYLIST_NO_TEXT;
+}
+
+void playlist_init(Playlist *pl) {
+    memset(pl, 0, sizeof(*pl));
+}
+
+void playlist_free(Playlist *pl) {
+    free(pl->strings);
+    free(pl->offsets);
+    free(pl->info);
+    playlist_init(pl);
+}
+
+static bool append_string(Playlist *pl, const char *s, uint32_t *offset) {
+    size_t len = strlen(s) + 1;
+    // Offsets are 32-bit; a 4 GB playlist is not a playlist
+    if (len > PLAYLIST_NO_TEXT - pl->strings_used) return false;
+
+    if (len > pl->strings_cap - pl->strings_used) {
+        size_t cap = pl->strings_cap ? pl->strings_cap : PLAYLIST_MIN_STRINGS;
+        while (cap - pl->strings_used < len) cap *= 2;
+        char *strings = realloc(pl->strings, cap);
+        if (!strings) return false;
+        pl->strings = strings;
+        pl->strings_cap = cap;
+    }
+
+    memcpy(pl->strings + pl->strings_used, s, len);
+    *offset = (uint32_t)pl->strings_used;
+    pl->strings_used += len;
+    return true;
+}
+
+// Album and art directives usually repeat for a run of entries; share the
+// previous entry's copy when the text is the same
+static bool append_text(Playlist *pl, const char *s, uint32_t prev, uint32_t *offset) {
+    *offset = PLAYLIST_NO_TEXT;
+    if (!s || !s[0]) return true;
+    if (prev != PLAYLIST_NO_TEXT && strcmp(pl->strings + prev, s) == 0) {
+        *offset = prev;
+        return true;
+    }
+    return append_string(pl, s, offset);
+}
+
+static bool store_info(Playlist *pl, int idx, const PlaylistInfo *info) {
+    if (!pl->info) {
+        pl->info = malloc((size_t)pl->cap * sizeof(PlaylistEntryInfo));
+        if (!pl->info) return false;
+        for (int i = 0; i < pl->cap; i++) clear_entry_info(&pl->info[i]);
+    }
+
+    const PlaylistEntryInfo *prev = idx > 0 ? &pl->info[idx - 1] : NULL;
+    PlaylistEntryInfo *e = &pl->info[idx];
+    e->duration = info->duration > 0 ? info->duration : 0;
+    e->cue_start = info->cue_start;
+    e->cue_end = info->cue_end;
+    e->cue_track = info->cue_track;
+    return append_text(pl, info->artist, prev ? prev->artist : PLAYLIST_NO_TEXT, &e->artist) &&
+           append_text(pl, info->title, prev ? prev->title : PLAYLIST_NO_TEXT, &e->title) &&
+           append_text(pl, info->album, prev ? prev->album : PLAYLIST_NO_TEXT, &e->album) &&
+           append_text(pl, info->art, prev ? prev->art : PLAYLIST_NO_TEXT, &e->art);
+}
+
+bool playlist_add_info(Playlist *pl, const char *path, const PlaylistInfo *info) {
+    if (pl->count == pl->cap) {
+        int cap = pl->cap ? pl->cap * 2 : PLAYLIST_MIN_TRACKS;
+        uint32_t *offsets = realloc(pl->offsets, (size_t)cap * sizeof(uint32_t));
+        if (!offsets) return false;
+        pl->offsets = offsets;
+        if (pl->info) {
+            PlaylistEntryInfo *grown = realloc(pl->info, (size_t)cap * sizeof(PlaylistEntryInfo));
+            if (!grown) return false;
+            pl->info = grown;
+        }
+        pl->cap = cap;
+    }
+
+    size_t used = pl->strings_used;
+    if (!append_string(pl, path, &pl->offsets[pl->count])) return false;
+
+    if (pl->info) clear_entry_info(&pl->info[pl->count]);
+    if (info && !store_info(pl, pl->count, info)) {
+        pl->strings_used = used;
+        return false;
+    }
+    pl->count++;
+    return true;
+}
+
+bool playlist_add(Playlist *pl, const char *path) {
+    return playlist_add_info(pl, path, NULL);
+}
+
+const char *playlist_get(const Playlist *pl, int idx) {
+    if (idx < 0 || idx >= pl->count) return NULL;
+    return pl->strings + pl->offsets[idx];
+}
+
+static const char *text_at(const Playlist *pl, uint32_t offset) {
+    return offset == PLAYLIST_NO_TEXT ? NULL : pl->strings + offset;
+}
+
+bool playlist_get_info(const Playlist *pl, int idx, PlaylistInfo *info) {
+    memset(info, 0, sizeof(*info));
+    if (!pl->info || idx < 0 || idx >= pl->count) return false;
+    const PlaylistEntryInfo *e = &pl->info[idx];
+    info->duration = e->duration;
+    info->artist = text_at(pl, e->artist);
+    info->title = text_at(pl, e->title);
+    info->album = text_at(pl, e->album);
+    info->art = text_at(pl, e->art);
+    info->cue_start = e->cue_start;
+    info->cue_end = e->cue_end;
+    info->cue_track = e->cue_track;
+    return info->duration > 0 || info->artist || info->title || info->album || info->art || info->cue_track;
+}
+
+int playlist_find(const Playlist *pl, const char *path) {
+    for (int i = 0; i < pl->count; i++) {
+        if (strcmp(pl->strings + pl->offsets[i], path) == 0) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Track paths stored back to back in one growable buffer, indexed by an
+// offset table. Both grow geometrically, so adding a track does not allocate
+// on its own and the whole list is freed at once.
+typedef struct PlaylistEntryInfo PlaylistEntryInfo;
+
+typedef struct {
+    char *strings;
+    size_t strings_used, strings_cap;
+    uint32_t *offsets;
+    PlaylistEntryInfo *info;    // allocated once an entry comes with details
+    int count, cap;
+} Playlist;
+
+// Details known about an entry before it is opened: from an extended M3U
+// (#EXTINF and friends), a CUE sheet or the playlist index. Strings are NULL
+// when absent.
+typedef struct {
+    int duration;               // seconds, 0 if unknown
+    const char *artist;
+    const char *title;
+    const char *album;
+    const char *art;            // cover image path
+    uint64_t art_offset;        // image embedded this far into art (a track file), 0 for image files
+    uint64_t art_size;          // and its length there
+    bool tags_known;            // the text above is all the file has, even if empty
+    bool art_known;             // art (or no art when NULL) is all there is, nothing to search
+    bool cue_track;             // one track of a CUE sheet, playing part of the file
+    uint32_t cue_start;         // where it starts and ends in the file, in CUE frames
+    uint32_t cue_end;           // (1/75 s); cue_end 0 plays to the end of the file
+} PlaylistInfo;
+
+void playlist_init(Playlist *pl);
+
+// Release all storage and leave the playlist empty
+void playlist_free(Playlist *pl);
+
+// Append a copy of path, returns false when out of memory
+bool playlist_add(Playlist *pl, const char *path);
+
+// Append a copy of path and its details (info may be NULL)
+bool playlist_add_info(Playlist *pl, const char *path, const PlaylistInfo *info);
+
+// Path of entry idx, NULL when out of range
+const char *playlist_get(const Playlist *pl, int idx);
+
+// Index of the first entry equal to path, -1 if there is none
+int playlist_find(const Playlist *pl, const char *path);
+
+// Details of entry idx, false if it has none. The strings stay valid until
+// the playlist is next changed.
+bool playlist_get_info(const Playlist *pl, int idx, PlaylistInfo *info);
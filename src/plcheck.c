@@ -0,0 +1,245 @@
+#include "plcheck.h"
+#include "fileio.h"
+#include "thread.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define PLCHECK_SLOTS 8192          // results kept, a power of two
+#define PLCHECK_QUEUE 64            // paths waiting for the worker
+#define PLCHECK_PATH 1024
+#define PLCHECK_HEAD 16             // header bytes sniffed
+#define PLCHECK_RETRY 30            // seconds a bad mark holds, doubled per repeat failure
+#define PLCHECK_RETRY_DOUBLINGS 5   // so a path is tried again at least every 16 minutes
+
+typedef enum { CHECK_NONE, CHECK_QUEUED, CHECK_GOOD, CHECK_BAD } CheckState;
+
+static Thread *worker = NULL;
+static Mutex *lock = NULL;
+static Cond *wake = NULL;
+static bool quit = false;
+
+// Open-addressed table of path hashes (0 = empty slot) and their state. Bad
+// marks carry how often the path failed and when, so they can expire.
+static uint64_t keys[PLCHECK_SLOTS];
+static unsigned char states[PLCHECK_SLOTS];
+static unsigned char failures[PLCHECK_SLOTS];
+static time_t bad_since[PLCHECK_SLOTS];
+static int used = 0;
+
+static char queue[PLCHECK_QUEUE][PLCHECK_PATH];
+static int queue_head = 0, queue_len = 0;
+
+static uint64_t hash_path(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+// A failure on a share can be a timeout that clears, so a bad mark only holds
+// for a while, longer each time the path fails again
+static bool bad_fresh(unsigned char fails, time_t since, time_t now) {
+    int doublings = fails > 0 ? fails - 1 : 0;
+    if (doublings > PLCHECK_RETRY_DOUBLINGS) doublings = PLCHECK_RETRY_DOUBLINGS;
+    // A clock that went backwards also ends the mark; retrying is harmless
+    return now >= since && now - since < (time_t)PLCHECK_RETRY << doublings;
+}
+
+static bool is_bad(int slot, time_t now) {
+    return states[slot] == CHECK_BAD && bad_fresh(failures[slot], bad_since[slot], now);
+}
+
+// Slot holding h, or the empty slot where it would go
+static int probe(uint64_t h) {
+    int i = (int)(h & (PLCHECK_SLOTS - 1));
+    while (keys[i] != h && keys[i] != 0) i = (i + 1) & (PLCHECK_SLOTS - 1);
+    return i;
+}
+
+// Make room by dropping good results, which only cost a header read to redo.
+// Queued paths and bad marks stay; expired marks go too if that is not enough.
+static void evict(time_t now) {
+    static uint64_t old_keys[PLCHECK_SLOTS];
+    static unsigned char old_states[PLCHECK_SLOTS], old_failures[PLCHECK_SLOTS];
+    static time_t old_since[PLCHECK_SLOTS];
+    memcpy(old_keys, keys, sizeof(keys));
+    memcpy(old_states, states, sizeof(states));
+    memcpy(old_failures, failures, sizeof(failures));
+    memcpy(old_since, bad_since, sizeof(bad_since));
+
+    int kept = 0;
+    for (int i = 0; i < PLCHECK_SLOTS; i++)
+        if (old_keys[i] && (old_states[i] == CHECK_QUEUED || old_states[i] == CHECK_BAD)) kept++;
+    bool crowded = kept >= PLCHECK_SLOTS / 2;
+
+    memset(keys, 0, sizeof(keys));
+    memset(states, 0, sizeof(states));
+    memset(failures, 0, sizeof(failures));
+    memset(bad_since, 0, sizeof(bad_since));
+    used = 0;
+    for (int i = 0; i < PLCHECK_SLOTS; i++) {
+        if (!old_keys[i] || used >= PLCHECK_SLOTS / 2) continue;
+        bool keep = old_states[i] == CHECK_QUEUED ||
+                    (old_states[i] == CHECK_BAD &&
+                     (!crowded || bad_fresh(old_failures[i], old_since[i], now)));
+        if (!keep) continue;
+        int slot = probe(old_keys[i]);
+        keys[slot] = old_keys[i];
+        states[slot] = old_states[i];
+        failures[slot] = old_failures[i];
+        bad_since[slot] = old_since[i];
+        used++;
+    }
+}
+
+// Slot of hash, claiming an empty one when add is set; -1 if absent (lock held)
+static int find_slot(uint64_t h, bool add, time_t now) {
+    if (add && used >= PLCHECK_SLOTS * 3 / 4) evict(now);
+    int i = probe(h);
+    if (keys[i] == 0) {
+        if (!add) return -1;
+        keys[i] = h;
+        states[i] = CHECK_NONE;
+        failures[i] = 0;
+        used++;
+    }
+    return i;
+}
+
+static void set_state(const char *path, CheckState state) {
+    time_t now = time(NULL);
+    int slot = find_slot(hash_path(path), true, now);
+    if (state == CHECK_BAD) {
+        // A check and a play failing together count once
+        if (is_bad(slot, now)) return;
+        if (failures[slot] < 255) failures[slot]++;
+        bad_since[slot] = now;
+        states[slot] = CHECK_BAD;
+    } else if (!is_bad(slot, now)) {
+        // A failed play outranks a good header until the mark expires
+        states[slot] = (unsigned char)state;
+    }
+}
+
+static bool has_magic(const unsigned char *head, size_t size, const char *magic) {
+    size_t len = strlen(magic);
+    return size >= len && memcmp(head, magic, len) == 0;
+}
+
+// The header can be what the extension says. Only containers with a fixed
+// magic are judged; an MP3 decoder syncs past junk, so any content will do.
+static bool header_plausible(const char *path, const unsigned char *head, size_t size) {
+    const char *slash = strrchr(path, '/');
+    const char *ext = strrchr(slash ? slash : path, '.');
+    if (!ext) return true;
+    char e[8] = {0};
+    for (int i = 0; i < 7 && ext[i + 1]; i++) {
+        char c = ext[i + 1];
+        e[i] = (c >= 'A' && c <= 'Z') ? c + 32 : c;
+    }
+
+    if (strcmp(e, "ogg") == 0) return has_magic(head, size, "OggS");
+    if (strcmp(e, "flac") == 0) return has_magic(head, size, "fLaC") || has_magic(head, size, "ID3");
+    if (strcmp(e, "wav") == 0)
+        return has_magic(head, size, "RIFF") || has_magic(head, size, "RIFX") || has_magic(head, size, "RF64") ||
+               has_magic(head, size, "riff") || has_magic(head, size, "FORM");
+    return true;
+}
+
+static bool check_file(const char *path) {
+    FileData f;
+    if (!file_load_head(&f, path, PLCHECK_HEAD)) return false;
+    bool ok = header_plausible(path, f.data, f.size);
+    file_unload(&f);
+    if (!ok) fprintf(stderr, "[MusicCore] Not a playable file, skipping: %s\n", path);
+    return ok;
+}
+
+static void check_worker(void *arg) {
+    (void)arg;
+    char path[PLCHECK_PATH];
+    mutex_lock(lock);
+    for (;;) {
+        while (!quit && queue_len == 0) cond_wait(wake, lock);
+        if (quit) break;
+        memcpy(path, queue[queue_head], sizeof(path));
+        queue_head = (queue_head + 1) % PLCHECK_QUEUE;
+        queue_len--;
+        mutex_unlock(lock);
+
+        // May take as long as the file system needs (a share timing out); nobody waits on it
+        bool ok = check_file(path);
+
+        mutex_lock(lock);
+        set_state(path, ok ? CHECK_GOOD : CHECK_BAD);
+    }
+    mutex_unlock(lock);
+}
+
+void plcheck_stop(void) {
+    if (worker) {
+        mutex_lock(lock);
+        quit = true;
+        cond_signal(wake);
+        mutex_unlock(lock);
+        thread_join(worker);
+        worker = NULL;
+    }
+    if (lock) mutex_free(lock);
+    if (wake) cond_free(wake);
+    lock = NULL;
+    wake = NULL;
+    quit = false;
+    memset(keys, 0, sizeof(keys));
+    memset(states, 0, sizeof(states));
+    memset(failures, 0, sizeof(failures));
+    memset(bad_since, 0, sizeof(bad_since));
+    used = 0;
+    queue_head = queue_len = 0;
+}
+
+void plcheck_start(void) {
+    plcheck_stop();
+    lock = mutex_create();
+    wake = cond_create();
+    if (lock && wake) worker = thread_create(check_worker, NULL);
+    if (!worker) plcheck_stop();
+}
+
+void plcheck_queue(const char *path) {
+    if (!worker || !path || strlen(path) >= PLCHECK_PATH) return;
+    mutex_lock(lock);
+    if (queue_len < PLCHECK_QUEUE) {
+        time_t now = time(NULL);
+        int slot = find_slot(hash_path(path), true, now);
+        // An expired bad mark is checked again, keeping its failure count
+        if (states[slot] == CHECK_NONE || (states[slot] == CHECK_BAD && !is_bad(slot, now))) {
+            states[slot] = CHECK_QUEUED;
+            strcpy(queue[(queue_head + queue_len) % PLCHECK_QUEUE], path);
+            queue_len++;
+            cond_signal(wake);
+        }
+    }
+    mutex_unlock(lock);
+}
+
+bool plcheck_bad(const char *path) {
+    if (!lock || !path) return false;
+    mutex_lock(lock);
+    time_t now = time(NULL);
+    int slot = find_slot(hash_path(path), false, now);
+    bool bad = slot >= 0 && is_bad(slot, now);
+    mutex_unlock(lock);
+    return bad;
+}
+
+void plcheck_mark_bad(const char *path) {
+    if (!lock || !path) return;
+    mutex_lock(lock);
+    set_state(path, CHECK_BAD);
+    mutex_unlock(lock);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Background check of playlist entries before they are played: a worker opens
+// each queued path and sniffs its header, so dead entries (missing files,
+// unreachable shares, files that are not audio) are known before the frame
+// thread would block trying to play them. Results are kept by path; bad marks
+// expire so a path that failed while its share was unreachable is retried.
+
+// Start the worker with no results
+void plcheck_start(void);
+
+// Stop the worker and forget everything
+void plcheck_stop(void);
+
+// Queue path for checking unless it is known or queued already (an expired
+// bad mark counts as unknown). Never blocks
+// on the file system; requests beyond the queue's room are dropped.
+void plcheck_queue(const char *path);
+
+// True while path is marked unplayable
+bool plcheck_bad(const char *path);
+
+// Record that path failed to play
+void plcheck_mark_bad(const char *path);
@@ -0,0 +1,422 @@
+#include "plindex.h"
+#include "fileio.h"
+#include "thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_dir(p) _mkdir(p)
+#else
+#define make_dir(p) mkdir(p, 0755)
+#endif
+
+#define PLINDEX_VERSION 3
+#define PLINDEX_NO_TEXT UINT32_MAX
+
+// Entry flags
+#define ENTRY_LEARNED 1     // recorded from the opened track; file_size/mtime are set
+#define ENTRY_TAGS 2        // artist/title/album are everything the file has
+#define ENTRY_ART 4         // art (or none) is where the cover is
+
+// CHECK_ART_STALE: the track is unchanged, but its folder changed since no
+// art was found in it
+typedef enum { CHECK_PENDING, CHECK_VALID, CHECK_STALE, CHECK_ART_STALE } CheckState;
+
+// One entry, as stored on disk. Strings are offsets into the string block.
+typedef struct {
+    uint64_t file_size;
+    int64_t file_mtime;
+    uint64_t total_frames;
+    uint64_t art_offset;
+    uint64_t art_size;
+    int64_t art_dir_mtime;  // the track's folder, when no art was found in it
+    uint32_t rate;
+    uint32_t flags;
+    int32_t duration;       // seconds from #EXTINF, for entries not learned yet
+    uint32_t path, artist, title, album, art;
+} IndexEntry;
+
+// On-disk header, followed by the M3U path, count entries and the strings
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t m3u_size;
+    int64_t m3u_mtime;
+    uint32_t path_len;
+    uint32_t count;
+    uint64_t strings_size;
+} IndexFileHeader;
+
+static struct {
+    bool open;
+    bool dirty;
+    char file[1200];
+    char m3u_path[1024];
+    uint64_t m3u_size;
+    int64_t m3u_mtime;
+    IndexEntry *entries;
+    int count;
+    char *strings;
+    size_t strings_used, strings_cap;
+    atomic_uchar *checks;   // CheckState per entry
+} cache;
+
+// The background check works on its own copy of the entries
+static struct {
+    Thread *thread;
+    atomic_bool quit;
+    IndexEntry *entries;
+    char *strings;
+    int count;
+} checker;
+
+static uint64_t hash_path(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// <save>/ultimedia/playlists/<hash>.idx, creating the directories on write
+static bool cache_file_path(const char *dir, const char *m3u_path, bool create, char *out, size_t out_size) {
+    if (!dir || !dir[0]) return false;
+    char sub[1100];
+    snprintf(sub, sizeof(sub), "%s/ultimedia", dir);
+    if (create) make_dir(sub);
+    snprintf(sub, sizeof(sub), "%s/ultimedia/playlists", dir);
+    if (create) make_dir(sub);
+    int n = snprintf(out, out_size, "%s/%016llx.idx", sub, (unsigned long long)hash_path(m3u_path));
+    return n > 0 && (size_t)n < out_size;
+}
+
+static bool file_identity(const char *path, uint64_t *size, int64_t *mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+static bool entry_current(const IndexEntry *e, const char *strings) {
+    uint64_t size;
+    int64_t mtime;
+    return file_identity(strings + e->path, &size, &mtime) && size == e->file_size && mtime == e->file_mtime;
+}
+
+// mtime of the folder holding path, 0 when it cannot be read
+static int64_t folder_mtime(const char *path) {
+    char dir[1024];
+    const char *slash = strrchr(path, '/');
+    const char *bs = strrchr(path, '\\');
+    if (bs && (!slash || bs > slash)) slash = bs;
+    size_t len = slash ? (size_t)(slash - path) : 0;
+    if (slash && len == 0) len = 1;     // "/file"
+    if (len >= sizeof(dir)) return 0;
+    if (slash) {
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+    uint64_t size;
+    int64_t mtime;
+    return file_identity(dir, &size, &mtime) ? mtime : 0;
+}
+
+// A cover added to (or removed from) the folder shows in its mtime
+static unsigned char check_entry(const IndexEntry *e, const char *strings) {
+    if (!entry_current(e, strings)) return CHECK_STALE;
+    if ((e->flags & ENTRY_ART) && e->art == PLINDEX_NO_TEXT && folder_mtime(strings + e->path) != e->art_dir_mtime)
+        return CHECK_ART_STALE;
+    return CHECK_VALID;
+}
+
+static uint32_t add_string(const char *s) {
+    if (!s) return PLINDEX_NO_TEXT;
+    // Text handed out by plindex_get is already stored (and would move on realloc)
+    if (cache.strings && (uintptr_t)s >= (uintptr_t)cache.strings &&
+        (uintptr_t)s < (uintptr_t)cache.strings + cache.strings_used)
+        return (uint32_t)(s - cache.strings);
+    size_t len = strlen(s) + 1;
+    if (len > PLINDEX_NO_TEXT - cache.strings_used) return PLINDEX_NO_TEXT;
+    if (len > cache.strings_cap - cache.strings_used) {
+        size_t cap = cache.strings_cap ? cache.strings_cap : 16 * 1024;
+        while (cap - cache.strings_used < len) cap *= 2;
+        char *strings = realloc(cache.strings, cap);
+        if (!strings) return PLINDEX_NO_TEXT;
+        cache.strings = strings;
+        cache.strings_cap = cap;
+    }
+    memcpy(cache.strings + cache.strings_used, s, len);
+    uint32_t offset = (uint32_t)cache.strings_used;
+    cache.strings_used += len;
+    return offset;
+}
+
+// offset when it already holds s, so an unchanged entry stays unchanged
+static uint32_t keep_string(uint32_t offset, const char *s) {
+    if (s && offset != PLINDEX_NO_TEXT && strcmp(cache.strings + offset, s) == 0) return offset;
+    return add_string(s);
+}
+
+static const char *text_at(uint32_t offset) {
+    return offset == PLINDEX_NO_TEXT ? NULL : cache.strings + offset;
+}
+
+// Stat every learned track in the background so plindex_get rarely has to
+static void check_worker(void *arg) {
+    (void)arg;
+    for (int i = 0; i < checker.count && !atomic_load(&checker.quit); i++) {
+        const IndexEntry *e = &checker.entries[i];
+        if (!(e->flags & ENTRY_LEARNED)) continue;
+        unsigned char expected = CHECK_PENDING;
+        unsigned char result = check_entry(e, checker.strings);
+        atomic_compare_exchange_strong(&cache.checks[i], &expected, result);
+    }
+}
+
+static void stop_checker(void) {
+    if (checker.thread) {
+        atomic_store(&checker.quit, true);
+        thread_join(checker.thread);
+        checker.thread = NULL;
+    }
+    free(checker.entries);
+    free(checker.strings);
+    checker.entries = NULL;
+    checker.strings = NULL;
+    checker.count = 0;
+}
+
+static void start_checker(void) {
+    checker.entries = malloc((size_t)cache.count * sizeof(IndexEntry));
+    checker.strings = malloc(cache.strings_used);
+    if (!checker.entries || !checker.strings) {
+        stop_checker();
+        return;
+    }
+    memcpy(checker.entries, cache.entries, (size_t)cache.count * sizeof(IndexEntry));
+    memcpy(checker.strings, cache.strings, cache.strings_used);
+    checker.count = cache.count;
+    atomic_store(&checker.quit, false);
+    checker.thread = thread_create(check_worker, NULL);
+}
+
+// Write with the strings compacted, dropping text replaced by later updates
+static void save_index(void) {
+    IndexEntry *out = malloc((size_t)cache.count * sizeof(IndexEntry));
+    char *old_strings = cache.strings;
+    size_t old_used = cache.strings_used, old_cap = cache.strings_cap;
+    if (!out) return;
+
+    cache.strings = NULL;
+    cache.strings_used = cache.strings_cap = 0;
+    bool ok = true;
+    for (int i = 0; ok && i < cache.count; i++) {
+        const IndexEntry *e = &cache.entries[i];
+        out[i] = *e;
+        out[i].path = add_string(old_strings + e->path);
+        out[i].artist = e->artist == PLINDEX_NO_TEXT ? PLINDEX_NO_TEXT : add_string(old_strings + e->artist);
+        out[i].title = e->title == PLINDEX_NO_TEXT ? PLINDEX_NO_TEXT : add_string(old_strings + e->title);
+        out[i].album = e->album == PLINDEX_NO_TEXT ? PLINDEX_NO_TEXT : add_string(old_strings + e->album);
+        out[i].art = e->art == PLINDEX_NO_TEXT ? PLINDEX_NO_TEXT : add_string(old_strings + e->art);
+        ok = out[i].path != PLINDEX_NO_TEXT;
+    }
+
+    FILE *f = ok ? fopen(cache.file, "wb") : NULL;
+    if (f) {
+        IndexFileHeader h;
+        memcpy(h.magic, "UMPL", 4);
+        h.version = PLINDEX_VERSION;
+        h.m3u_size = cache.m3u_size;
+        h.m3u_mtime = cache.m3u_mtime;
+        h.path_len = (uint32_t)strlen(cache.m3u_path);
+        h.count = (uint32_t)cache.count;
+        h.strings_size = cache.strings_used;
+        ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(cache.m3u_path, 1, h.path_len, f) == h.path_len &&
+             fwrite(out, sizeof(IndexEntry), (size_t)cache.count, f) == (size_t)cache.count &&
+             fwrite(cache.strings, 1, cache.strings_used, f) == cache.strings_used;
+        fclose(f);
+        if (!ok) remove(cache.file);
+    }
+    free(out);
+    free(cache.strings);
+    cache.strings = old_strings;
+    cache.strings_used = old_used;
+    cache.strings_cap = old_cap;
+}
+
+void plindex_close(void) {
+    stop_checker();
+    if (cache.open && cache.dirty) save_index();
+    free(cache.entries);
+    free(cache.strings);
+    free(cache.checks);
+    memset(&cache, 0, sizeof(cache));
+}
+
+// Common setup; the file path and M3U identity decide whether an cache is kept at all
+static bool open_index(const char *m3u_path, const char *save_dir, bool create) {
+    plindex_close();
+    if (strlen(m3u_path) >= sizeof(cache.m3u_path)) return false;
+    if (!cache_file_path(save_dir, m3u_path, create, cache.file, sizeof(cache.file))) return false;
+    if (!file_identity(m3u_path, &cache.m3u_size, &cache.m3u_mtime)) return false;
+    strcpy(cache.m3u_path, m3u_path);
+    return true;
+}
+
+bool plindex_load(Playlist *pl, const char *m3u_path, const char *save_dir) {
+    if (!open_index(m3u_path, save_dir, false)) return false;
+
+    FileData file;
+    if (!file_load(&file, cache.file)) return false;
+
+    bool ok = false;
+    IndexFileHeader h;
+    size_t path_len = strlen(m3u_path);
+    if (file.size >= sizeof(h)) {
+        memcpy(&h, file.data, sizeof(h));
+        uint64_t entries_size = (uint64_t)h.count * sizeof(IndexEntry);
+        ok = memcmp(h.magic, "UMPL", 4) == 0 && h.version == PLINDEX_VERSION &&
+             h.m3u_size == cache.m3u_size && h.m3u_mtime == cache.m3u_mtime &&
+             h.path_len == path_len && h.count > 0 && h.count <= INT32_MAX && h.strings_size > 0 &&
+             h.strings_size < PLINDEX_NO_TEXT &&
+             file.size == sizeof(h) + path_len + entries_size + h.strings_size &&
+             memcmp(file.data + sizeof(h), m3u_path, path_len) == 0;
+    }
+
+    if (ok) {
+        const unsigned char *entries = file.data + sizeof(h) + path_len;
+        const unsigned char *strings = entries + (size_t)h.count * sizeof(IndexEntry);
+        cache.count = (int)h.count;
+        cache.entries = malloc((size_t)h.count * sizeof(IndexEntry));
+        cache.strings = malloc((size_t)h.strings_size);
+        cache.checks = malloc((size_t)h.count * sizeof(atomic_uchar));
+        ok = cache.entries && cache.strings && cache.checks && strings[h.strings_size - 1] == '\0';
+        if (ok) {
+            memcpy(cache.entries, entries, (size_t)h.count * sizeof(IndexEntry));
+            memcpy(cache.strings, strings, (size_t)h.strings_size);
+            cache.strings_used = cache.strings_cap = (size_t)h.strings_size;
+        }
+    }
+    file_unload(&file);
+
+    for (int i = 0; ok && i < cache.count; i++) {
+        const IndexEntry *e = &cache.entries[i];
+        uint32_t size = (uint32_t)cache.strings_used;
+        ok = e->path < size && (e->artist == PLINDEX_NO_TEXT || e->artist < size) &&
+             (e->title == PLINDEX_NO_TEXT || e->title < size) && (e->album == PLINDEX_NO_TEXT || e->album < size) &&
+             (e->art == PLINDEX_NO_TEXT || e->art < size) &&
+             playlist_add(pl, cache.strings + e->path);
+        if (ok) atomic_init(&cache.checks[i], (e->flags & ENTRY_LEARNED) ? CHECK_PENDING : CHECK_VALID);
+    }
+
+    if (!ok) {
+        playlist_free(pl);
+        plindex_close();
+        return false;
+    }
+    cache.open = true;
+    start_checker();
+    fprintf(stderr, "[MusicCore] Playlist index: %d entries from %s\n", cache.count, cache.file);
+    return true;
+}
+
+void plindex_begin(const Playlist *pl, const char *m3u_path, const char *save_dir) {
+    if (pl->count == 0 || !open_index(m3u_path, save_dir, true)) {
+        plindex_close();
+        return;
+    }
+
+    cache.entries = calloc((size_t)pl->count, sizeof(IndexEntry));
+    cache.checks = malloc((size_t)pl->count * sizeof(atomic_uchar));
+    if (!cache.entries || !cache.checks) {
+        plindex_close();
+        return;
+    }
+    cache.count = pl->count;
+    for (int i = 0; i < pl->count; i++) {
+        IndexEntry *e = &cache.entries[i];
+        PlaylistInfo info;
+        playlist_get_info(pl, i, &info);
+        e->duration = info.duration;
+        e->path = add_string(playlist_get(pl, i));
+        e->artist = add_string(info.artist);
+        e->title = add_string(info.title);
+        e->album = add_string(info.album);
+        e->art = add_string(info.art);
+        atomic_init(&cache.checks[i], CHECK_VALID);
+        if (e->path == PLINDEX_NO_TEXT) {
+            plindex_close();
+            return;
+        }
+    }
+    cache.open = true;
+    cache.dirty = true;
+}
+
+bool plindex_get(int idx, PlaylistInfo *info) {
+    memset(info, 0, sizeof(*info));
+    if (!cache.open || idx < 0 || idx >= cache.count) return false;
+
+    const IndexEntry *e = &cache.entries[idx];
+    unsigned char state = atomic_load(&cache.checks[idx]);
+    if (state == CHECK_PENDING) {
+        // Not reached by the background check yet
+        unsigned char result = check_entry(e, cache.strings);
+        atomic_compare_exchange_strong(&cache.checks[idx], &state, result);
+        state = atomic_load(&cache.checks[idx]);
+    }
+    info->artist = text_at(e->artist);
+    info->title = text_at(e->title);
+    info->album = text_at(e->album);
+    if (state == CHECK_STALE) {
+        // The track changed: its old text may still fill gaps the way playlist text
+        // does, but length and art have to be found again
+        return info->title != NULL;
+    }
+    info->duration = (e->flags & ENTRY_LEARNED) && e->rate ? (int)(e->total_frames / e->rate) : e->duration;
+    info->art = text_at(e->art);
+    info->art_offset = e->art_offset;
+    info->art_size = e->art_size;
+    info->tags_known = (e->flags & ENTRY_TAGS) != 0;
+    info->art_known = (e->flags & ENTRY_ART) && state != CHECK_ART_STALE;
+    return info->duration > 0 || info->artist || info->title || info->album || info->art ||
+           info->tags_known || info->art_known;
+}
+
+void plindex_update(int idx, const char *path, const PlaylistInfo *info, uint64_t total_frames, uint32_t rate) {
+    if (!cache.open || idx < 0 || idx >= cache.count) return;
+    IndexEntry *e = &cache.entries[idx];
+    if (strcmp(cache.strings + e->path, path) != 0) return;
+
+    IndexEntry u = *e;
+    if (!file_identity(path, &u.file_size, &u.file_mtime)) return;
+    u.total_frames = total_frames;
+    u.rate = rate;
+    u.flags = ENTRY_LEARNED;
+    if (info->tags_known) {
+        u.flags |= ENTRY_TAGS;
+        u.artist = keep_string(e->artist, info->artist);
+        u.title = keep_string(e->title, info->title);
+        u.album = keep_string(e->album, info->album);
+    }
+    if (info->art_known) {
+        u.flags |= ENTRY_ART;
+        u.art = keep_string(e->art, info->art);
+        u.art_offset = info->art ? info->art_offset : 0;
+        u.art_size = info->art ? info->art_size : 0;
+        u.art_dir_mtime = info->art ? 0 : folder_mtime(path);
+    }
+    if (memcmp(&u, e, sizeof(u)) == 0) return;
+    *e = u;
+    atomic_store(&cache.checks[idx], CHECK_VALID);
+    cache.dirty = true;
+}
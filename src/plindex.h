@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "playlist.h"
+
+// Binary index of an M3U, cached under <save dir>/ultimedia/playlists and keyed
+// by the playlist's size and mtime. It holds the resolved entries and what
+// playback learned about each track (length, tags, where the art is), so a
+// reload neither parses the M3U nor reads tags and searches for art.
+
+// Fill the empty pl from the index of m3u_path when it is current. Returns
+// false when there is none and the M3U has to be parsed.
+bool plindex_load(Playlist *pl, const char *m3u_path, const char *save_dir);
+
+// Start a new index for a playlist just parsed from m3u_path
+void plindex_begin(const Playlist *pl, const char *m3u_path, const char *save_dir);
+
+// Cached details of entry idx, false when there are none. When the track's
+// size or mtime changed since they were recorded only its text is given.
+bool plindex_get(int idx, PlaylistInfo *info);
+
+// Record what loading entry idx (at path) found out
+void plindex_update(int idx, const char *path, const PlaylistInfo *info, uint64_t total_frames, uint32_t rate);
+
+// Write the index if anything changed, then drop it
+void plindex_close(void);
@@ -0,0 +1,336 @@
+#include "prescan.h"
+#include "metadata.h"
+#include "fileio.h"
+#include "thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#define PRESCAN_WORKERS 2               // leaves the other cores to decoding
+#define PRESCAN_HEAD (128 * 1024)       // bytes read for headers
+#define PRESCAN_OGG_TAIL (64 * 1024)    // bytes searched for the last Ogg page
+#define PRESCAN_TEXT_CHUNK (64 * 1024)
+
+typedef enum { SCAN_PENDING, SCAN_BUSY, SCAN_DONE, SCAN_SKIP } ScanState;
+
+// One table row; the fields are written before state becomes SCAN_DONE
+typedef struct {
+    atomic_uchar state;
+    int32_t duration;
+    const char *artist, *title, *album;
+} ScanEntry;
+
+// Text is copied into chunks that never move, so readers need no lock
+typedef struct TextChunk {
+    struct TextChunk *next;
+    size_t used;
+    char data[PRESCAN_TEXT_CHUNK];
+} TextChunk;
+
+static struct {
+    Playlist paths;
+    ScanEntry *entries;
+    int count;
+    atomic_int cursor;          // next entry to look at, wraps around
+    atomic_int left;            // entries not scanned yet
+    atomic_bool quit;
+    Thread *workers[PRESCAN_WORKERS];
+    Mutex *text_lock;
+    TextChunk *text;
+} scan;
+
+static const char *store_text(const char *s) {
+    if (!s[0]) return NULL;
+    size_t len = strlen(s) + 1;
+    mutex_lock(scan.text_lock);
+    if (!scan.text || PRESCAN_TEXT_CHUNK - scan.text->used < len) {
+        TextChunk *c = malloc(sizeof(TextChunk));
+        if (!c) {
+            mutex_unlock(scan.text_lock);
+            return NULL;
+        }
+        c->next = scan.text;
+        c->used = 0;
+        scan.text = c;
+    }
+    char *out = scan.text->data + scan.text->used;
+    memcpy(out, s, len);
+    scan.text->used += len;
+    mutex_unlock(scan.text_lock);
+    return out;
+}
+
+static uint32_t be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t le32(const unsigned char *p) {
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+// Bytes taken by an ID3v2 tag at the start of the file
+static size_t id3v2_skip(const unsigned char *d, size_t size) {
+    if (size < 10 || memcmp(d, "ID3", 3) != 0) return 0;
+    size_t len = ((size_t)(d[6] & 0x7F) << 21) | ((size_t)(d[7] & 0x7F) << 14) | ((size_t)(d[8] & 0x7F) << 7) | (d[9] & 0x7F);
+    return 10 + len + ((d[5] & 0x10) ? 10 : 0);
+}
+
+static int flac_seconds(const unsigned char *d, size_t size) {
+    size_t p = id3v2_skip(d, size);
+    // "fLaC", then STREAMINFO is always the first block
+    if (p + 26 > size || memcmp(d + p, "fLaC", 4) != 0 || (d[p + 4] & 0x7F) != 0) return 0;
+    const unsigned char *si = d + p + 8;
+    uint32_t rate = ((uint32_t)si[10] << 12) | ((uint32_t)si[11] << 4) | (si[12] >> 4);
+    uint64_t total = ((uint64_t)(si[13] & 0x0F) << 32) | be32(si + 14);
+    return rate ? (int)(total / rate) : 0;
+}
+
+static int wav_seconds(const unsigned char *d, size_t size, uint64_t file_size) {
+    if (size < 12 || memcmp(d, "RIFF", 4) != 0 || memcmp(d + 8, "WAVE", 4) != 0) return 0;
+    uint32_t byte_rate = 0;
+    for (size_t p = 12; p + 8 <= size;) {
+        uint32_t len = le32(d + p + 4);
+        if (memcmp(d + p, "fmt ", 4) == 0 && p + 20 <= size) {
+            byte_rate = le32(d + p + 16);
+        } else if (memcmp(d + p, "data", 4) == 0) {
+            // Streamed files leave the size unset; the data runs to the end
+            uint64_t bytes = (len == 0 || len == 0xFFFFFFFF) && file_size > p + 8 ? file_size - (p + 8) : len;
+            return byte_rate ? (int)(bytes / byte_rate) : 0;
+        }
+        p += 8 + (uint64_t)len + (len & 1);
+    }
+    return 0;
+}
+
+// Vorbis sample rate from the identification header on the first page
+static uint32_t ogg_rate(const unsigned char *d, size_t size) {
+    if (size < 28 || memcmp(d, "OggS", 4) != 0) return 0;
+    size_t packet = 27 + d[26];
+    if (packet + 16 > size || memcmp(d + packet, "\x01vorbis", 7) != 0) return 0;
+    return le32(d + packet + 12);
+}
+
+// Length from the granule position of the last page, found in the file's tail
+static int ogg_seconds(uint32_t rate, const unsigned char *tail, size_t size) {
+    if (!rate || size < 14) return 0;
+    size_t stop = size > PRESCAN_OGG_TAIL ? size - PRESCAN_OGG_TAIL : 0;
+    for (size_t p = size - 14; p > stop; p--) {
+        if (tail[p] == 'O' && memcmp(tail + p, "OggS", 4) == 0) {
+            uint64_t granule = (uint64_t)le32(tail + p + 6) | ((uint64_t)le32(tail + p + 10) << 32);
+            return granule == UINT64_MAX ? 0 : (int)(granule / rate);
+        }
+    }
+    return 0;
+}
+
+static const uint16_t mp3_kbps[2][3][16] = {
+    {   // MPEG 1: layer I, II, III
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+    },
+    {   // MPEG 2 / 2.5
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+    },
+};
+static const uint32_t mp3_rates[3] = { 44100, 48000, 32000 };
+
+typedef struct {
+    uint32_t rate, kbps, samples, length;
+    bool mpeg1, mono;
+} Mp3Frame;
+
+static bool mp3_frame(const unsigned char *h, Mp3Frame *f) {
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return false;
+    int version = (h[1] >> 3) & 3;      // 0 = 2.5, 2 = 2, 3 = 1
+    int layer = 4 - ((h[1] >> 1) & 3);  // 1..3, 4 = reserved
+    int br = h[2] >> 4, sr = (h[2] >> 2) & 3;
+    if (version == 1 || layer == 4 || br == 0 || br == 15 || sr == 3) return false;
+
+    f->mpeg1 = version == 3;
+    f->rate = mp3_rates[sr] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    f->kbps = mp3_kbps[f->mpeg1 ? 0 : 1][layer - 1][br];
+    f->samples = layer == 1 ? 384 : (layer == 2 || f->mpeg1) ? 1152 : 576;
+    f->mono = (h[3] >> 6) == 3;
+    uint32_t pad = (h[2] >> 1) & 1;
+    f->length = layer == 1 ? (12 * f->kbps * 1000 / f->rate + pad) * 4
+                           : f->samples / 8 * f->kbps * 1000 / f->rate + pad;
+    return f->length > 4;
+}
+
+// Frame count from a Xing/Info or VBRI header, or failing that the bitrate.
+// d holds size bytes of the file from offset at.
+static int mp3_seconds(const unsigned char *d, size_t size, uint64_t at, uint64_t file_size) {
+    size_t p = id3v2_skip(d, size);
+    Mp3Frame f;
+    for (; p + 4 <= size; p++) {
+        // Take a sync only when another frame follows it
+        if (mp3_frame(d + p, &f)) {
+            Mp3Frame next;
+            if (p + f.length + 4 > size || mp3_frame(d + p + f.length, &next)) break;
+        }
+    }
+    if (p + 4 > size) return 0;
+
+    size_t side = f.mpeg1 ? (f.mono ? 17 : 32) : (f.mono ? 9 : 17);
+    const unsigned char *x = d + p + 4 + side;
+    if (p + 4 + side + 12 <= size && (memcmp(x, "Xing", 4) == 0 || memcmp(x, "Info", 4) == 0) && (x[7] & 1))
+        return (int)((uint64_t)be32(x + 8) * f.samples / f.rate);
+    const unsigned char *v = d + p + 36;
+    if (p + 36 + 18 <= size && memcmp(v, "VBRI", 4) == 0)
+        return (int)((uint64_t)be32(v + 14) * f.samples / f.rate);
+
+    if (file_size <= at + p) return 0;
+    uint64_t bytes = file_size - (at + p);
+    if (bytes > 128 && at + size == file_size && memcmp(d + size - 128, "TAG", 3) == 0) bytes -= 128;
+    return (int)(bytes * 8 / ((uint64_t)f.kbps * 1000));
+}
+
+static uint64_t file_size_of(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+
+// Length in seconds from the headers, 0 when it cannot be told
+static int track_seconds(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *ext = strrchr(slash ? slash : path, '.');
+    if (!ext) return 0;
+    char e[8] = {0};
+    for (int i = 0; i < 7 && ext[i + 1]; i++) {
+        char c = ext[i + 1];
+        e[i] = (c >= 'A' && c <= 'Z') ? c + 32 : c;
+    }
+
+    FileData f;
+    if (!file_load_head(&f, path, PRESCAN_HEAD)) return 0;
+    uint64_t size = f.source == FILE_SOURCE_MMAP ? f.size : file_size_of(path);
+
+    // An ID3v2 tag with large art can run past the head; read the first
+    // frames after it instead
+    size_t skip = id3v2_skip(f.data, f.size);
+    if (skip > f.size && (strcmp(e, "mp3") == 0 || strcmp(e, "flac") == 0)) {
+        file_unload(&f);
+        if (!file_load_range(&f, path, skip, PRESCAN_HEAD)) return 0;
+    } else {
+        skip = 0;
+    }
+
+    int seconds = 0;
+    if (strcmp(e, "ogg") == 0) {
+        // The length is in the last page; a mapped file has it already
+        uint32_t rate = ogg_rate(f.data, f.size);
+        FileData tail;
+        if (f.source == FILE_SOURCE_MMAP) seconds = ogg_seconds(rate, f.data, f.size);
+        else if (rate && file_load_tail(&tail, path, PRESCAN_OGG_TAIL)) {
+            seconds = ogg_seconds(rate, tail.data, tail.size);
+            file_unload(&tail);
+        }
+    } else if (strcmp(e, "flac") == 0) seconds = flac_seconds(f.data, f.size);
+    else if (strcmp(e, "wav") == 0) seconds = wav_seconds(f.data, f.size, size);
+    else if (strcmp(e, "mp3") == 0) seconds = mp3_seconds(f.data, f.size, skip, size);
+    file_unload(&f);
+    return seconds;
+}
+
+static void scan_entry(int idx) {
+    ScanEntry *e = &scan.entries[idx];
+    const char *path = playlist_get(&scan.paths, idx);
+    char artist[META_TAG_LEN], title[META_TAG_LEN], album[META_TAG_LEN];
+    metadata_read_tags(path, artist, title, album);
+    e->artist = store_text(artist);
+    e->title = store_text(title);
+    e->album = store_text(album);
+    e->duration = track_seconds(path);
+    atomic_store_explicit(&e->state, SCAN_DONE, memory_order_release);
+}
+
+// Take entries from the cursor on; a full lap without finding one means the rest are in hand
+static void scan_worker(void *arg) {
+    (void)arg;
+    int misses = 0;
+    while (!atomic_load(&scan.quit) && atomic_load(&scan.left) > 0 && misses < scan.count) {
+        int idx = atomic_fetch_add(&scan.cursor, 1) % scan.count;
+        if (idx < 0) idx += scan.count;
+        unsigned char expected = SCAN_PENDING;
+        if (!atomic_compare_exchange_strong(&scan.entries[idx].state, &expected, SCAN_BUSY)) {
+            misses++;
+            continue;
+        }
+        misses = 0;
+        scan_entry(idx);
+        atomic_fetch_sub(&scan.left, 1);
+    }
+}
+
+void prescan_stop(void) {
+    atomic_store(&scan.quit, true);
+    for (int i = 0; i < PRESCAN_WORKERS; i++) {
+        if (scan.workers[i]) thread_join(scan.workers[i]);
+        scan.workers[i] = NULL;
+    }
+    while (scan.text) {
+        TextChunk *next = scan.text->next;
+        free(scan.text);
+        scan.text = next;
+    }
+    if (scan.text_lock) mutex_free(scan.text_lock);
+    scan.text_lock = NULL;
+    free(scan.entries);
+    scan.entries = NULL;
+    scan.count = 0;
+    playlist_free(&scan.paths);
+}
+
+void prescan_start(const Playlist *pl) {
+    prescan_stop();
+    if (pl->count == 0) return;
+
+    scan.entries = malloc((size_t)pl->count * sizeof(ScanEntry));
+    scan.text_lock = mutex_create();
+    if (!scan.entries || !scan.text_lock) {
+        prescan_stop();
+        return;
+    }
+    int left = 0;
+    for (int i = 0; i < pl->count; i++) {
+        PlaylistInfo info;
+        bool cue = playlist_get_info(pl, i, &info) && info.cue_track;
+        if (!playlist_add(&scan.paths, playlist_get(pl, i))) {
+            prescan_stop();
+            return;
+        }
+        ScanEntry *e = &scan.entries[i];
+        atomic_init(&e->state, cue ? SCAN_SKIP : SCAN_PENDING);
+        e->duration = 0;
+        e->artist = e->title = e->album = NULL;
+        if (!cue) left++;
+    }
+    scan.count = pl->count;
+    atomic_store(&scan.cursor, 0);
+    atomic_store(&scan.left, left);
+    atomic_store(&scan.quit, false);
+    if (left == 0) return;
+    for (int i = 0; i < PRESCAN_WORKERS; i++) scan.workers[i] = thread_create(scan_worker, NULL);
+}
+
+void prescan_focus(int idx) {
+    if (scan.count > 0 && idx >= 0 && idx < scan.count) atomic_store(&scan.cursor, idx);
+}
+
+bool prescan_get(int idx, PlaylistInfo *info) {
+    memset(info, 0, sizeof(*info));
+    if (idx < 0 || idx >= scan.count) return false;
+    const ScanEntry *e = &scan.entries[idx];
+    if (atomic_load_explicit(&e->state, memory_order_acquire) != SCAN_DONE) return false;
+    info->duration = e->duration;
+    info->artist = e->artist;
+    info->title = e->title;
+    info->album = e->album;
+    info->tags_known = true;
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include "playlist.h"
+
+// Tags and length of every playlist entry, read ahead of playback by a small
+// worker pool into one table, so a track's text is a lookup by the time it
+// plays. Lengths come from headers only (STREAMINFO, the WAV data chunk, the
+// last Ogg granule, the MP3 Xing/VBRI frame count or its bitrate).
+
+// Scan the entries of pl (copied), any previous scan is stopped. CUE tracks
+// are left out: their file's tags and length are the whole album's.
+void prescan_start(const Playlist *pl);
+
+// Stop the workers and drop the table
+void prescan_stop(void);
+
+// Scan from entry idx on next (the track coming up)
+void prescan_focus(int idx);
+
+// Tags (tags_known) and length of entry idx, false until it has been scanned.
+// The strings stay valid until prescan_stop.
+bool prescan_get(int idx, PlaylistInfo *info);
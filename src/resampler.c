@@ -0,0 +1,373 @@
+#include "resampler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RESAMPLER_SSE2 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RESAMPLER_AVX2 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_NEON 1
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TABLE_CACHE_SIZE 6
+
+struct ResampleTable {
+    uint32_t in_rate, out_rate;
+    int quality;
+    int taps;
+    int phases;
+    int refs;
+    float *coefs;   // phases * taps, phase-major, 32-byte aligned
+    void *coef_mem;
+};
+
+// Per-tier filter length (at unity ratio), Kaiser beta and passband edge
+static const struct { int taps; double beta; double rolloff; } tiers[3] = {
+    {  8, 5.0, 0.85 },  // Fast
+    { 24, 7.5, 0.91 },  // Balanced
+    { 48, 9.5, 0.95 },  // High
+};
+
+static ResampleTable *table_cache[TABLE_CACHE_SIZE];
+
+typedef void (*dot2_fn)(const float *l, const float *r, const float *h, int taps, float *out_l, float *out_r);
+static dot2_fn dot2 = NULL;
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 64; k++) {
+        double t = x / (2.0 * k);
+        term *= t * t;
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+    return sum;
+}
+
+static void dot2_scalar(const float *l, const float *r, const float *h, int taps, float *out_l, float *out_r) {
+    float al = 0.0f, ar = 0.0f;
+    for (int k = 0; k < taps; k++) {
+        al += l[k] * h[k];
+        ar += r[k] * h[k];
+    }
+    *out_l = al;
+    *out_r = ar;
+}
+
+#ifdef RESAMPLER_SSE2
+static float hsum_ps(__m128 v) {
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+static void dot2_sse2(const float *l, const float *r, const float *h, int taps, float *out_l, float *out_r) {
+    __m128 al = _mm_setzero_ps(), ar = _mm_setzero_ps();
+    for (int k = 0; k < taps; k += 4) {
+        __m128 c = _mm_load_ps(h + k);
+        al = _mm_add_ps(al, _mm_mul_ps(_mm_loadu_ps(l + k), c));
+        ar = _mm_add_ps(ar, _mm_mul_ps(_mm_loadu_ps(r + k), c));
+    }
+    *out_l = hsum_ps(al);
+    *out_r = hsum_ps(ar);
+}
+#endif
+
+#ifdef RESAMPLER_AVX2
+__attribute__((target("avx2,fma")))
+static void dot2_avx2(const float *l, const float *r, const float *h, int taps, float *out_l, float *out_r) {
+    __m256 al = _mm256_setzero_ps(), ar = _mm256_setzero_ps();
+    for (int k = 0; k < taps; k += 8) {
+        __m256 c = _mm256_load_ps(h + k);
+        al = _mm256_fmadd_ps(_mm256_loadu_ps(l + k), c, al);
+        ar = _mm256_fmadd_ps(_mm256_loadu_ps(r + k), c, ar);
+    }
+    __m128 sl = _mm_add_ps(_mm256_castps256_ps128(al), _mm256_extractf128_ps(al, 1));
+    __m128 sr = _mm_add_ps(_mm256_castps256_ps128(ar), _mm256_extractf128_ps(ar, 1));
+    sl = _mm_add_ps(sl, _mm_movehl_ps(sl, sl));
+    sr = _mm_add_ps(sr, _mm_movehl_ps(sr, sr));
+    sl = _mm_add_ss(sl, _mm_shuffle_ps(sl, sl, 1));
+    sr = _mm_add_ss(sr, _mm_shuffle_ps(sr, sr, 1));
+    *out_l = _mm_cvtss_f32(sl);
+    *out_r = _mm_cvtss_f32(sr);
+}
+#endif
+
+#ifdef RESAMPLER_NEON
+static void dot2_neon(const float *l, const float *r, const float *h, int taps, float *out_l, float *out_r) {
+    float32x4_t al = vdupq_n_f32(0.0f), ar = vdupq_n_f32(0.0f);
+    for (int k = 0; k < taps; k += 4) {
+        float32x4_t c = vld1q_f32(h + k);
+        al = vmlaq_f32(al, vld1q_f32(l + k), c);
+        ar = vmlaq_f32(ar, vld1q_f32(r + k), c);
+    }
+    float32x2_t sl = vadd_f32(vget_low_f32(al), vget_high_f32(al));
+    float32x2_t sr = vadd_f32(vget_low_f32(ar), vget_high_f32(ar));
+    *out_l = vget_lane_f32(vpadd_f32(sl, sl), 0);
+    *out_r = vget_lane_f32(vpadd_f32(sr, sr), 0);
+}
+#endif
+
+static void select_kernel(void) {
+    if (dot2) return;
+    dot2 = dot2_scalar;
+#ifdef RESAMPLER_SSE2
+    dot2 = dot2_sse2;
+#endif
+#ifdef RESAMPLER_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        dot2 = dot2_avx2;
+#endif
+#ifdef RESAMPLER_NEON
+    dot2 = dot2_neon;
+#endif
+}
+
+static void table_destroy(ResampleTable *t) {
+    if (!t) return;
+    free(t->coef_mem);
+    free(t);
+}
+
+static ResampleTable *table_build(uint32_t in_rate, uint32_t out_rate, int quality) {
+    uint32_t g = gcd_u32(in_rate, out_rate);
+    uint32_t up = out_rate / g;
+
+    double ratio = (double)out_rate / (double)in_rate;
+    double cutoff = ((ratio < 1.0) ? ratio : 1.0) * tiers[quality].rolloff;
+
+    // Widen the kernel when downsampling so the transition band stays the same in output terms.
+    int taps = tiers[quality].taps;
+    if (ratio < 1.0) taps = (int)ceil(taps / ratio);
+    taps = (taps + 7) & ~7;
+    if (taps > RESAMPLE_MAX_TAPS) taps = RESAMPLE_MAX_TAPS;
+    int phases = (up <= RESAMPLE_MAX_PHASES) ? (int)up : RESAMPLE_MAX_PHASES;
+
+    ResampleTable *t = calloc(1, sizeof(ResampleTable));
+    if (!t) return NULL;
+
+    t->coef_mem = malloc((size_t)phases * taps * sizeof(float) + 32);
+    if (!t->coef_mem) {
+        free(t);
+        return NULL;
+    }
+    float *coefs = (float*)(((uintptr_t)t->coef_mem + 31) & ~(uintptr_t)31);
+
+    int half = taps / 2;
+    double beta = tiers[quality].beta;
+    double i0_beta = bessel_i0(beta);
+    for (int p = 0; p < phases; p++) {
+        float *h = coefs + (size_t)p * taps;
+        double frac = (double)p / (double)phases;
+        double sum = 0.0;
+        for (int k = 0; k < taps; k++) {
+            double x = (double)(k - (half - 1)) - frac;
+            double s = (x == 0.0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double w = x / (double)half;
+            double win = (w <= -1.0 || w >= 1.0) ? 0.0 : bessel_i0(beta * sqrt(1.0 - w * w)) / i0_beta;
+            double v = cutoff * s * win;
+            h[k] = (float)v;
+            sum += v;
+        }
+        // Unity DC gain for every phase
+        if (sum != 0.0) {
+            for (int k = 0; k < taps; k++) h[k] = (float)(h[k] / sum);
+        }
+    }
+
+    t->in_rate = in_rate;
+    t->out_rate = out_rate;
+    t->quality = quality;
+    t->taps = taps;
+    t->phases = phases;
+    t->coefs = coefs;
+    return t;
+}
+
+static ResampleTable *table_acquire(uint32_t in_rate, uint32_t out_rate, int quality) {
+    for (int i = 0; i < TABLE_CACHE_SIZE; i++) {
+        ResampleTable *t = table_cache[i];
+        if (t && t->in_rate == in_rate && t->out_rate == out_rate && t->quality == quality) {
+            t->refs++;
+            return t;
+        }
+    }
+
+    ResampleTable *t = table_build(in_rate, out_rate, quality);
+    if (!t) return NULL;
+
+    // Take an empty slot, or evict an unused table.
+    int slot = -1;
+    for (int i = 0; i < TABLE_CACHE_SIZE && slot < 0; i++)
+        if (!table_cache[i]) slot = i;
+    for (int i = 0; i < TABLE_CACHE_SIZE && slot < 0; i++)
+        if (table_cache[i]->refs == 0) slot = i;
+    if (slot >= 0) {
+        table_destroy(table_cache[slot]);
+        table_cache[slot] = t;
+    }
+    t->refs = (slot >= 0) ? 1 : -1; // -1: uncached, destroyed on release
+    return t;
+}
+
+static void table_release(ResampleTable *t) {
+    if (!t) return;
+    if (t->refs < 0) table_destroy(t);
+    else if (t->refs > 0) t->refs--;
+}
+
+void resampler_free(Resampler *rs) {
+    table_release(rs->table);
+    rs->table = NULL;
+}
+
+void resampler_reset(Resampler *rs) {
+    // Pre-fill half a kernel of silence so the first output has left context.
+    int lead = rs->table ? rs->half - 1 : 0;
+    memset(rs->l, 0, (size_t)lead * sizeof(float));
+    memset(rs->r, 0, (size_t)lead * sizeof(float));
+    rs->pos = lead;
+    rs->len = lead;
+    rs->end = -1;
+    rs->frac = 0;
+}
+
+void resampler_init(Resampler *rs, uint32_t in_rate, uint32_t out_rate, ResampleQuality quality) {
+    select_kernel();
+    resampler_free(rs);
+
+    if ((int)quality < RESAMPLE_FAST || quality > RESAMPLE_HIGH) quality = RESAMPLE_BALANCED;
+    if (in_rate == 0) in_rate = out_rate;
+    rs->in_rate = in_rate;
+    rs->out_rate = out_rate;
+    rs->quality = quality;
+
+    uint32_t g = gcd_u32(in_rate, out_rate);
+    rs->den = out_rate / g;
+    rs->step_int = (in_rate / g) / rs->den;
+    rs->step_frac = (in_rate / g) % rs->den;
+
+    rs->table = (in_rate != out_rate) ? table_acquire(in_rate, out_rate, quality) : NULL;
+    rs->half = rs->table ? rs->table->taps / 2 : 1;
+    resampler_reset(rs);
+}
+
+int resampler_input_needed(const Resampler *rs, int out_frames) {
+    if (out_frames <= 0) return 0;
+    int need;
+    if (!rs->table) {
+        need = rs->pos + out_frames - rs->len;
+    } else {
+        uint64_t step = (uint64_t)rs->step_int * rs->den + rs->step_frac;
+        uint64_t last = (uint64_t)rs->pos + ((uint64_t)rs->frac + (uint64_t)(out_frames - 1) * step) / rs->den;
+        uint64_t want = last + (uint64_t)rs->half + 1;
+        if (want > RESAMPLE_BUF_FRAMES) want = RESAMPLE_BUF_FRAMES;
+        need = (int)want - rs->len;
+    }
+    int space = RESAMPLE_BUF_FRAMES - rs->len;
+    if (need > space) need = space;
+    return (need > 0) ? need : 0;
+}
+
+int resampler_input_space(Resampler *rs, float **l, float **r) {
+    *l = rs->l + rs->len;
+    *r = rs->r + rs->len;
+    return (rs->end >= 0) ? 0 : RESAMPLE_BUF_FRAMES - rs->len;
+}
+
+void resampler_commit(Resampler *rs, int frames) {
+    if (frames > 0) rs->len += frames;
+}
+
+void resampler_flush(Resampler *rs) {
+    if (rs->end >= 0) return;
+    rs->end = rs->len;
+    // Zero right context for the last real frames.
+    int tail = rs->table ? rs->half : 0;
+    if (tail > RESAMPLE_BUF_FRAMES - rs->len) tail = RESAMPLE_BUF_FRAMES - rs->len;
+    memset(rs->l + rs->len, 0, (size_t)tail * sizeof(float));
+    memset(rs->r + rs->len, 0, (size_t)tail * sizeof(float));
+    rs->len += tail;
+}
+
+static int16_t float_to_i16(float v) {
+    if (v > 32767.0f) return 32767;
+    if (v < -32768.0f) return -32768;
+    return (int16_t)v;
+}
+
+int resampler_process(Resampler *rs, int16_t *out, int max_frames) {
+    int n = 0;
+    int limit = (rs->end >= 0) ? rs->end : rs->len;
+
+    if (!rs->table) {
+        n = limit - rs->pos;
+        if (n > max_frames) n = max_frames;
+        if (n < 0) n = 0;
+        for (int i = 0; i < n; i++) {
+            out[i * 2] = float_to_i16(rs->l[rs->pos + i]);
+            out[i * 2 + 1] = float_to_i16(rs->r[rs->pos + i]);
+        }
+        rs->pos += n;
+    } else {
+        const ResampleTable *t = rs->table;
+        int taps = t->taps;
+        int half = rs->half;
+        bool exact = (uint32_t)t->phases == rs->den;
+        while (n < max_frames && rs->pos < limit && rs->pos + half < rs->len) {
+            uint32_t phase = exact ? rs->frac : (uint32_t)(((uint64_t)rs->frac * (uint32_t)t->phases) / rs->den);
+            const float *h = t->coefs + (size_t)phase * taps;
+            int base = rs->pos - (half - 1);
+            float ol, orr;
+            dot2(rs->l + base, rs->r + base, h, taps, &ol, &orr);
+            out[n * 2] = float_to_i16(ol);
+            out[n * 2 + 1] = float_to_i16(orr);
+            n++;
+
+            rs->pos += (int)rs->step_int;
+            rs->frac += rs->step_frac;
+            if (rs->frac >= rs->den) {
+                rs->frac -= rs->den;
+                rs->pos++;
+            }
+        }
+    }
+
+    // Slide consumed input out, keeping the left context of the next output.
+    int keep_from = rs->pos - (rs->table ? rs->half - 1 : 0);
+    if (keep_from > rs->len) keep_from = rs->len;
+    if (keep_from > 0) {
+        int remain = rs->len - keep_from;
+        memmove(rs->l, rs->l + keep_from, (size_t)remain * sizeof(float));
+        memmove(rs->r, rs->r + keep_from, (size_t)remain * sizeof(float));
+        rs->pos -= keep_from;
+        rs->len = remain;
+        if (rs->end >= 0) rs->end = (rs->end > keep_from) ? rs->end - keep_from : 0;
+    }
+    return n;
+}
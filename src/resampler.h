@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RESAMPLE_MAX_TAPS 256
+#define RESAMPLE_MAX_PHASES 1024
+#define RESAMPLE_BUF_FRAMES (8192 + RESAMPLE_MAX_TAPS * 2)
+
+typedef enum { RESAMPLE_FAST = 0, RESAMPLE_BALANCED = 1, RESAMPLE_HIGH = 2 } ResampleQuality;
+
+typedef struct ResampleTable ResampleTable;
+
+// Streaming polyphase windowed-sinc resampler for float stereo input.
+// Coefficient tables are shared per in/out rate pair and quality; they are
+// built and cached on first use and must only be touched from one thread
+// (the decode worker).
+typedef struct {
+    ResampleTable *table;       // NULL when in_rate == out_rate (straight copy)
+    uint32_t in_rate, out_rate;
+    int quality;
+    int half;                   // taps / 2
+    uint32_t step_int;          // source advance per output frame: step_int + step_frac / den
+    uint32_t step_frac;
+    uint32_t den;
+    uint32_t frac;              // fractional source position, in 1/den units
+    int pos;                    // buffer index of the current output's base frame
+    int len;                    // frames held in the buffer
+    int end;                    // frames of real input after a flush, -1 while streaming
+    float l[RESAMPLE_BUF_FRAMES];
+    float r[RESAMPLE_BUF_FRAMES];
+} Resampler;
+
+// Set up for a rate pair and quality tier, clears history
+void resampler_init(Resampler *rs, uint32_t in_rate, uint32_t out_rate, ResampleQuality quality);
+
+// Release the coefficient table reference
+void resampler_free(Resampler *rs);
+
+// Drop buffered input (after a seek)
+void resampler_reset(Resampler *rs);
+
+// Input frames still needed before out_frames can be produced, capped at free space
+int resampler_input_needed(const Resampler *rs, int out_frames);
+
+// Free space for new input; write up to the returned count, then commit
+int resampler_input_space(Resampler *rs, float **l, float **r);
+void resampler_commit(Resampler *rs, int frames);
+
+// Mark the end of input so the filter tail can be drained
+void resampler_flush(Resampler *rs);
+
+// Produce up to max_frames interleaved stereo frames, returns the number written
+int resampler_process(Resampler *rs, int16_t *out, int max_frames);
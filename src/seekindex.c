@@ -0,0 +1,332 @@
+#include "seekindex.h"
+#include "thread.h"
+#include "fileio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_dir(p) _mkdir(p)
+#else
+#define make_dir(p) mkdir(p, 0755)
+#endif
+
+#define SEEKINDEX_SLOTS 4
+#define SEEKINDEX_VERSION 1
+#define SEEKINDEX_MIN_POINTS 16
+
+typedef enum { JOB_EMPTY, JOB_PENDING, JOB_BUILDING, JOB_READY } JobState;
+
+typedef struct {
+    JobState state;
+    char path[1024];
+    uint64_t total_frames;
+    uint32_t rate;
+    drmp3_seek_point *points;
+    uint32_t count;
+    unsigned order;     // request order, oldest is evicted first
+} IndexJob;
+
+// On-disk header, followed by the path bytes and count packed seek points
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t file_size;
+    int64_t file_mtime;
+    uint32_t path_len;
+    uint32_t count;
+} IndexFileHeader;
+
+static IndexJob jobs[SEEKINDEX_SLOTS];
+static Thread *builder = NULL;
+static Mutex *job_mutex = NULL;
+static Cond *job_cond = NULL;
+static bool builder_quit = false;
+static unsigned request_order = 0;
+static atomic_int ready_count;
+static char cache_dir[1024];
+
+static uint64_t hash_path(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// <save>/ultimedia/seek/<hash>.idx, creating the directories on write
+static bool cache_file_path(const char *dir, const char *track_path, bool create, char *out, size_t out_size) {
+    if (!dir[0]) return false;
+    char sub[1100];
+    snprintf(sub, sizeof(sub), "%s/ultimedia", dir);
+    if (create) make_dir(sub);
+    snprintf(sub, sizeof(sub), "%s/ultimedia/seek", dir);
+    if (create) make_dir(sub);
+    int n = snprintf(out, out_size, "%s/%016llx.idx", sub, (unsigned long long)hash_path(track_path));
+    return n > 0 && (size_t)n < out_size;
+}
+
+static bool file_identity(const char *path, uint64_t *size, int64_t *mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+static bool load_cached(const char *dir, const char *path, drmp3_seek_point **points, uint32_t *count) {
+    char file[1200];
+    uint64_t size;
+    int64_t mtime;
+    if (!cache_file_path(dir, path, false, file, sizeof(file)) || !file_identity(path, &size, &mtime)) return false;
+
+    FILE *f = fopen(file, "rb");
+    if (!f) return false;
+
+    bool ok = false;
+    IndexFileHeader h;
+    size_t path_len = strlen(path);
+    char stored_path[1024];
+    if (fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, "UMSK", 4) == 0 &&
+        h.version == SEEKINDEX_VERSION && h.file_size == size && h.file_mtime == mtime &&
+        h.path_len == path_len && path_len < sizeof(stored_path) &&
+        h.count > 0 && h.count <= SEEKINDEX_MAX_POINTS &&
+        fread(stored_path, 1, path_len, f) == path_len && memcmp(stored_path, path, path_len) == 0) {
+        drmp3_seek_point *pts = malloc(h.count * sizeof(drmp3_seek_point));
+        uint32_t i = 0;
+        for (; pts && i < h.count; i++) {
+            uint64_t pos, frame;
+            uint16_t discard[2];
+            if (fread(&pos, 8, 1, f) != 1 || fread(&frame, 8, 1, f) != 1 || fread(discard, 2, 2, f) != 2) break;
+            pts[i].seekPosInBytes = pos;
+            pts[i].pcmFrameIndex = frame;
+            pts[i].mp3FramesToDiscard = discard[0];
+            pts[i].pcmFramesToDiscard = discard[1];
+        }
+        if (pts && i == h.count) {
+            *points = pts;
+            *count = h.count;
+            ok = true;
+        } else {
+            free(pts);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static void save_cached(const char *dir, const char *path, const drmp3_seek_point *points, uint32_t count) {
+    char file[1200];
+    IndexFileHeader h;
+    if (!cache_file_path(dir, path, true, file, sizeof(file)) || !file_identity(path, &h.file_size, &h.file_mtime)) return;
+
+    FILE *f = fopen(file, "wb");
+    if (!f) return;
+    memcpy(h.magic, "UMSK", 4);
+    h.version = SEEKINDEX_VERSION;
+    h.path_len = (uint32_t)strlen(path);
+    h.count = count;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(path, 1, h.path_len, f) == h.path_len;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        uint16_t discard[2] = { points[i].mp3FramesToDiscard, points[i].pcmFramesToDiscard };
+        ok = fwrite(&points[i].seekPosInBytes, 8, 1, f) == 1 &&
+             fwrite(&points[i].pcmFrameIndex, 8, 1, f) == 1 &&
+             fwrite(discard, 2, 2, f) == 2;
+    }
+    fclose(f);
+    if (!ok) remove(file);
+}
+
+static size_t scan_read(void *user, void *buf, size_t bytes) {
+    return file_stream_read((FileStream*)user, buf, bytes);
+}
+
+static drmp3_bool32 scan_seek(void *user, int offset, drmp3_seek_origin origin) {
+    return file_stream_seek((FileStream*)user, offset,
+                            origin == DRMP3_SEEK_SET ? SEEK_SET : origin == DRMP3_SEEK_END ? SEEK_END : SEEK_CUR);
+}
+
+static drmp3_bool32 scan_tell(void *user, drmp3_int64 *cursor) {
+    *cursor = file_stream_tell((FileStream*)user);
+    return *cursor >= 0;
+}
+
+// Scan the file on a private decoder; frame headers only, no PCM is produced.
+// A mapped file is scanned in place, anything else is read as it goes.
+static bool build_table(const char *path, uint64_t total_frames, uint32_t rate, drmp3_seek_point **points, uint32_t *count) {
+    uint64_t seconds = rate ? total_frames / rate : 0;
+    uint32_t want = (seconds > SEEKINDEX_MAX_POINTS) ? SEEKINDEX_MAX_POINTS : (uint32_t)seconds;
+    if (want < SEEKINDEX_MIN_POINTS) want = SEEKINDEX_MIN_POINTS;
+
+    FileData file;
+    FileStream stream;
+    bool mapped = file_map(&file, path);
+    if (!mapped && !file_stream_open(&stream, path, false)) return false;
+
+    drmp3 *mp3 = malloc(sizeof(drmp3));
+    drmp3_seek_point *pts = malloc(want * sizeof(drmp3_seek_point));
+    bool ok = false;
+    if (mp3 && pts &&
+        (mapped ? drmp3_init_memory(mp3, file.data, file.size, NULL)
+                : drmp3_init(mp3, scan_read, scan_seek, scan_tell, NULL, &stream, NULL))) {
+        ok = drmp3_calculate_seek_points(mp3, &want, pts) && want > 0;
+        drmp3_uninit(mp3);
+    }
+    free(mp3);
+    if (mapped) file_unload(&file);
+    else file_stream_close(&stream);
+
+    if (!ok) {
+        free(pts);
+        return false;
+    }
+    *points = pts;
+    *count = want;
+    return true;
+}
+
+static IndexJob *oldest_job(JobState state) {
+    IndexJob *best = NULL;
+    for (int i = 0; i < SEEKINDEX_SLOTS; i++) {
+        if (jobs[i].state == state && (!best || jobs[i].order < best->order)) best = &jobs[i];
+    }
+    return best;
+}
+
+static void clear_job(IndexJob *job) {
+    if (job->state == JOB_READY) atomic_fetch_sub(&ready_count, 1);
+    free(job->points);
+    job->points = NULL;
+    job->count = 0;
+    job->state = JOB_EMPTY;
+}
+
+static void index_builder(void *arg) {
+    (void)arg;
+    mutex_lock(job_mutex);
+    while (!builder_quit) {
+        IndexJob *job = oldest_job(JOB_PENDING);
+        if (!job) {
+            cond_wait(job_cond, job_mutex);
+            continue;
+        }
+
+        job->state = JOB_BUILDING;
+        char path[1024], dir[1024];
+        strcpy(path, job->path);
+        strcpy(dir, cache_dir);
+        uint64_t total = job->total_frames;
+        uint32_t rate = job->rate;
+        mutex_unlock(job_mutex);
+
+        drmp3_seek_point *points = NULL;
+        uint32_t count = 0;
+        bool ok = load_cached(dir, path, &points, &count);
+        if (!ok && build_table(path, total, rate, &points, &count)) {
+            save_cached(dir, path, points, count);
+            ok = true;
+        }
+
+        mutex_lock(job_mutex);
+        if (ok) {
+            job->points = points;
+            job->count = count;
+            job->state = JOB_READY;
+            atomic_fetch_add(&ready_count, 1);
+        } else {
+            job->state = JOB_EMPTY;
+        }
+    }
+    mutex_unlock(job_mutex);
+}
+
+void seekindex_init(void) {
+    if (builder) return;
+    memset(jobs, 0, sizeof(jobs));
+    atomic_store(&ready_count, 0);
+    builder_quit = false;
+    job_mutex = mutex_create();
+    job_cond = cond_create();
+    if (job_mutex && job_cond)
+        builder = thread_create(index_builder, NULL);
+    if (!builder)
+        fprintf(stderr, "[MusicCore] Failed to start seek index builder\n");
+}
+
+void seekindex_deinit(void) {
+    if (builder) {
+        mutex_lock(job_mutex);
+        builder_quit = true;
+        cond_signal(job_cond);
+        mutex_unlock(job_mutex);
+        thread_join(builder);
+        builder = NULL;
+    }
+    for (int i = 0; i < SEEKINDEX_SLOTS; i++) clear_job(&jobs[i]);
+    cond_free(job_cond);
+    mutex_free(job_mutex);
+    job_cond = NULL;
+    job_mutex = NULL;
+}
+
+void seekindex_set_cache_dir(const char *dir) {
+    if (!job_mutex) return;
+    mutex_lock(job_mutex);
+    cache_dir[0] = '\0';
+    if (dir) {
+        strncpy(cache_dir, dir, sizeof(cache_dir) - 1);
+        cache_dir[sizeof(cache_dir) - 1] = '\0';
+    }
+    mutex_unlock(job_mutex);
+}
+
+void seekindex_request(const char *path, uint64_t total_frames, uint32_t rate) {
+    if (!builder || !path || strlen(path) >= sizeof(jobs[0].path)) return;
+    if (total_frames < (uint64_t)rate * SEEKINDEX_MIN_SECONDS) return;
+
+    mutex_lock(job_mutex);
+    for (int i = 0; i < SEEKINDEX_SLOTS; i++) {
+        if (jobs[i].state != JOB_EMPTY && strcmp(jobs[i].path, path) == 0) {
+            mutex_unlock(job_mutex);
+            return;
+        }
+    }
+
+    IndexJob *job = oldest_job(JOB_EMPTY);
+    if (!job) job = oldest_job(JOB_READY);
+    if (!job) job = oldest_job(JOB_PENDING);
+    if (job) {
+        clear_job(job);
+        strcpy(job->path, path);
+        job->total_frames = total_frames;
+        job->rate = rate;
+        job->order = ++request_order;
+        job->state = JOB_PENDING;
+        cond_signal(job_cond);
+    }
+    mutex_unlock(job_mutex);
+}
+
+bool seekindex_take(const char *path, drmp3_seek_point **points, uint32_t *count) {
+    if (atomic_load_explicit(&ready_count, memory_order_acquire) == 0) return false;
+
+    bool found = false;
+    mutex_lock(job_mutex);
+    for (int i = 0; i < SEEKINDEX_SLOTS; i++) {
+        IndexJob *job = &jobs[i];
+        if (job->state == JOB_READY && strcmp(job->path, path) == 0) {
+            *points = job->points;
+            *count = job->count;
+            job->points = NULL;
+            clear_job(job);
+            found = true;
+            break;
+        }
+    }
+    mutex_unlock(job_mutex);
+    return found;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dr_mp3.h"
+
+#define SEEKINDEX_MAX_POINTS 8192
+#define SEEKINDEX_MIN_SECONDS 60
+
+// Start the background index builder
+void seekindex_init(void);
+
+// Stop the builder and drop any tables not yet taken
+void seekindex_deinit(void);
+
+// Directory for the on-disk cache (the frontend save directory); NULL disables it
+void seekindex_set_cache_dir(const char *dir);
+
+// Queue an MP3 for indexing. The table is loaded from the cache when the
+// file's size and mtime match, otherwise built by scanning frame headers.
+void seekindex_request(const char *path, uint64_t total_frames, uint32_t rate);
+
+// Hand over a finished table for path. The caller owns *points (free()).
+// Cheap when nothing is ready, so it can be polled from the decode loop.
+bool seekindex_take(const char *path, drmp3_seek_point **points, uint32_t *count);
@@ -0,0 +1,125 @@
+#include "thread.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+struct Thread { HANDLE handle; thread_func_t fn; void *arg; };
+struct Mutex { CRITICAL_SECTION cs; };
+struct Cond { CONDITION_VARIABLE cv; };
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+    Thread *t = (Thread*)param;
+    t->fn(t->arg);
+    return 0;
+}
+
+Thread *thread_create(thread_func_t fn, void *arg) {
+    Thread *t = calloc(1, sizeof(Thread));
+    if (!t) return NULL;
+    t->fn = fn;
+    t->arg = arg;
+    t->handle = CreateThread(NULL, 0, thread_trampoline, t, 0, NULL);
+    if (!t->handle) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void thread_join(Thread *t) {
+    if (!t) return;
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    free(t);
+}
+
+Mutex *mutex_create(void) {
+    Mutex *m = malloc(sizeof(Mutex));
+    if (m) InitializeCriticalSection(&m->cs);
+    return m;
+}
+
+void mutex_free(Mutex *m) {
+    if (!m) return;
+    DeleteCriticalSection(&m->cs);
+    free(m);
+}
+
+void mutex_lock(Mutex *m) { EnterCriticalSection(&m->cs); }
+void mutex_unlock(Mutex *m) { LeaveCriticalSection(&m->cs); }
+
+Cond *cond_create(void) {
+    Cond *c = malloc(sizeof(Cond));
+    if (c) InitializeConditionVariable(&c->cv);
+    return c;
+}
+
+void cond_free(Cond *c) { free(c); }
+void cond_wait(Cond *c, Mutex *m) { SleepConditionVariableCS(&c->cv, &m->cs, INFINITE); }
+void cond_signal(Cond *c) { WakeConditionVariable(&c->cv); }
+void cond_broadcast(Cond *c) { WakeAllConditionVariable(&c->cv); }
+
+#else
+#include <pthread.h>
+
+struct Thread { pthread_t handle; thread_func_t fn; void *arg; };
+struct Mutex { pthread_mutex_t mtx; };
+struct Cond { pthread_cond_t cv; };
+
+static void *thread_trampoline(void *param) {
+    Thread *t = (Thread*)param;
+    t->fn(t->arg);
+    return NULL;
+}
+
+Thread *thread_create(thread_func_t fn, void *arg) {
+    Thread *t = calloc(1, sizeof(Thread));
+    if (!t) return NULL;
+    t->fn = fn;
+    t->arg = arg;
+    if (pthread_create(&t->handle, NULL, thread_trampoline, t) != 0) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void thread_join(Thread *t) {
+    if (!t) return;
+    pthread_join(t->handle, NULL);
+    free(t);
+}
+
+Mutex *mutex_create(void) {
+    Mutex *m = malloc(sizeof(Mutex));
+    if (m) pthread_mutex_init(&m->mtx, NULL);
+    return m;
+}
+
+void mutex_free(Mutex *m) {
+    if (!m) return;
+    pthread_mutex_destroy(&m->mtx);
+    free(m);
+}
+
+void mutex_lock(Mutex *m) { pthread_mutex_lock(&m->mtx); }
+void mutex_unlock(Mutex *m) { pthread_mutex_unlock(&m->mtx); }
+
+Cond *cond_create(void) {
+    Cond *c = malloc(sizeof(Cond));
+    if (c) pthread_cond_init(&c->cv, NULL);
+    return c;
+}
+
+void cond_free(Cond *c) {
+    if (!c) return;
+    pthread_cond_destroy(&c->cv);
+    free(c);
+}
+
+void cond_wait(Cond *c, Mutex *m) { pthread_cond_wait(&c->cv, &m->mtx); }
+void cond_signal(Cond *c) { pthread_cond_signal(&c->cv); }
+void cond_broadcast(Cond *c) { pthread_cond_broadcast(&c->cv); }
+
+#endif
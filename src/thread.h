@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Minimal portable threading wrappers (Win32 or pthreads).
+// Handles are opaque so platform headers stay out of the rest of the core.
+typedef struct Thread Thread;
+typedef struct Mutex Mutex;
+typedef struct Cond Cond;
+
+typedef void (*thread_func_t)(void *arg);
+
+// Start a thread running fn(arg), returns NULL on failure
+Thread *thread_create(thread_func_t fn, void *arg);
+
+// Wait for a thread to finish and free its handle
+void thread_join(Thread *t);
+
+Mutex *mutex_create(void);
+void mutex_free(Mutex *m);
+void mutex_lock(Mutex *m);
+void mutex_unlock(Mutex *m);
+
+Cond *cond_create(void);
+void cond_free(Cond *c);
+
+// Atomically release m and wait for a signal, re-acquires m before returning
+void cond_wait(Cond *c, Mutex *m);
+
+void cond_signal(Cond *c);
+void cond_broadcast(Cond *c);
@@ -33,6 +33,58 @@ void draw_pixel(int x, int y, uint16_t color) {
     }
 }
 
+void video_blit(int x, int y, const uint16_t *src, int w, int h) {
+    if (!framebuffer) return;
+    int x0 = x < 0 ? -x : 0, x1 = x + w > FB_WIDTH ? FB_WIDTH - x : w;
+    int y0 = y < 0 ? -y : 0, y1 = y + h > FB_HEIGHT ? FB_HEIGHT - y : h;
+    if (x0 >= x1) return;
+    for (int row = y0; row < y1; row++)
+        memcpy(framebuffer + (y + row) * FB_WIDTH + x + x0, src + row * w + x0, (size_t)(x1 - x0) * sizeof(uint16_t));
+}
+
+// Average of the source pixels covered by destination pixel (dx, dy)
+static void box_average(const uint8_t *src, int sw, int sh, int dx, int dy, int dw, int dh, uint32_t rgb[3]) {
+    int y0 = (int)((int64_t)dy * sh / dh), y1 = (int)((int64_t)(dy + 1) * sh / dh);
+    if (y1 <= y0) y1 = y0 + 1;
+    int x0 = (int)((int64_t)dx * sw / dw), x1 = (int)((int64_t)(dx + 1) * sw / dw);
+    if (x1 <= x0) x1 = x0 + 1;
+    uint32_t r = 0, g = 0, b = 0;
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *p = src + ((size_t)y * sw + x0) * 3;
+        for (int x = x0; x < x1; x++, p += 3) {
+            r += p[0];
+            g += p[1];
+            b += p[2];
+        }
+    }
+    uint32_t n = (uint32_t)(y1 - y0) * (uint32_t)(x1 - x0);
+    rgb[0] = r / n;
+    rgb[1] = g / n;
+    rgb[2] = b / n;
+}
+
+void video_scale_rgb888(const uint8_t *src, int sw, int sh, uint16_t *dst, int dw, int dh) {
+    uint32_t c[3];
+    for (int dy = 0; dy < dh; dy++) {
+        for (int dx = 0; dx < dw; dx++) {
+            box_average(src, sw, sh, dx, dy, dw, dh, c);
+            dst[dy * dw + dx] = (uint16_t)(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+        }
+    }
+}
+
+void video_shrink_rgb888(const uint8_t *src, int sw, int sh, uint8_t *dst, int dw, int dh) {
+    uint32_t c[3];
+    for (int dy = 0; dy < dh; dy++) {
+        for (int dx = 0; dx < dw; dx++, dst += 3) {
+            box_average(src, sw, sh, dx, dy, dw, dh, c);
+            dst[0] = (uint8_t)c[0];
+            dst[1] = (uint8_t)c[1];
+            dst[2] = (uint8_t)c[2];
+        }
+    }
+}
+
 void draw_text(int x, int y, const char* txt, uint16_t color) {
     while (*txt) {
         uint8_t c = (*txt++) - 32;
@@ -25,3 +25,14 @@ void draw_text(int x, int y, const char* txt, uint16_t color);
 
 // Draw text clipped to a horizontal region [clip_x, clip_x + clip_w)
 void draw_text_clipped(int x, int y, const char* txt, uint16_t color, int clip_x, int clip_w);
+
+// Copy a w x h image to (x, y), clipped to the framebuffer
+void video_blit(int x, int y, const uint16_t *src, int w, int h);
+
+// Scale an RGB888 image (sw x sh) into an RGB565 one (dw x dh). Each
+// destination pixel is the average of the source pixels it covers, or the
+// nearest one when enlarging.
+void video_scale_rgb888(const uint8_t *src, int sw, int sh, uint16_t *dst, int dw, int dh);
+
+// The same into an RGB888 image, for keeping a smaller copy at full color depth
+void video_shrink_rgb888(const uint8_t *src, int sw, int sh, uint8_t *dst, int dw, int dh);